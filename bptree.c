@@ -0,0 +1,1084 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#ifndef _POSIX_C_SOURCE
+# define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bptree.h"
+
+/*
+ * File layout, all pages are BPTREE_PAGE_SIZE bytes:
+ * page 0 and 1: meta pages, the one with highest valid txn is current.
+ * page 2...   : tree pages.
+ *
+ * Leaf page:   header | keys[cap] | values[cap]
+ * Branch page: header | children[cap + 1] | keys[cap]
+ * Child i of a branch holds the keys k with key[i - 1] <= k < key[i].
+ *
+ * Every page records the transaction that wrote it. A page written in
+ * the current transaction is not referenced by any committed tree, and
+ * can be updated in place. Any other page is copied before it's updated.
+ */
+
+#define MAGIC 0x42505452
+#define VERSION 1
+#define PAGE BPTREE_PAGE_SIZE
+/* Depth of a tree with at least 4 keys per page is far less */
+#define MAX_DEPTH 32
+#define MIN_CAP 4
+
+#define FLAG_LEAF 0x1
+
+struct meta
+{
+        uint32_t magic;
+        uint32_t version;
+        uint64_t txn;
+        uint64_t root;
+        uint64_t npages;
+        uint64_t count;
+        uint32_t key_len;
+        uint32_t val_len;
+        uint32_t page_size;
+        uint32_t checksum;
+};
+
+struct hdr
+{
+        uint64_t txn;
+        uint16_t flags;
+        uint16_t n;
+        uint32_t pad;
+};
+
+struct pglist
+{
+        uint64_t* pg;
+        size_t len;
+        size_t cap;
+};
+
+/**
+ * A step on the path from the root, the page and the index of the
+ * child taken (branch) or the entry position (leaf).
+ */
+struct step
+{
+        uint64_t pg;
+        size_t idx;
+};
+
+struct bptree
+{
+        int fd;
+        unsigned char* map;
+        size_t map_len;
+        btree_cmp cmp;
+        size_t key_len;
+        size_t val_len;
+        size_t leaf_cap;
+        size_t branch_cap;
+        uint64_t root;
+        /* Number of branch levels above the leaves */
+        int height;
+        uint64_t npages;
+        uint64_t count;
+        /* Current (uncommitted) transaction */
+        uint64_t txn;
+        unsigned int flags;
+        int dirty;
+        /* Pages that can be reused */
+        struct pglist free;
+        /* Pages released in the current transaction */
+        struct pglist pending;
+        /* Two pages of scratch memory used during splits */
+        unsigned char* scratch;
+        /* Separator key passed up during splits */
+        unsigned char* sep;
+};
+
+#define HDR(t, pg) ((struct hdr*)page(t, pg))
+#define LKEY(t, pg, i) (page(t, pg) + sizeof(struct hdr) + (i) * (t)->key_len)
+#define LVAL(t, pg, i) (page(t, pg) + sizeof(struct hdr) + \
+                        (t)->leaf_cap * (t)->key_len + (i) * (t)->val_len)
+#define BCHILD(t, pg) ((uint64_t*)(page(t, pg) + sizeof(struct hdr)))
+#define BKEY(t, pg, i) (page(t, pg) + sizeof(struct hdr) + \
+                        ((t)->branch_cap + 1) * sizeof(uint64_t) + \
+                        (i) * (t)->key_len)
+
+static unsigned char* page(const struct bptree*, uint64_t);
+static uint32_t checksum(const struct meta*);
+/**
+ * Make sure the file and mapping holds at least npages pages.
+ * On failure the current mapping is left as it is.
+ * @param the tree.
+ * @param number of pages.
+ * @return 0 on success.
+ */
+static int ensure(struct bptree*, uint64_t);
+/**
+ * Allocate a page, from the free list if possible.
+ * Any pointer into the mapping is invalid after this call.
+ * @param the tree.
+ * @return the page number, or 0 on failure.
+ */
+static uint64_t alloc_page(struct bptree*, uint16_t);
+/**
+ * Make sure a number of pages can be allocated without failure, from
+ * the free list or by growing the file.
+ * @param the tree.
+ * @param number of pages.
+ * @return 0 on success.
+ */
+static int reserve(struct bptree*, size_t);
+static void free_page(struct bptree*, uint64_t);
+static int pglist_push(struct pglist*, uint64_t);
+/**
+ * Return a page that can be updated in place, copying it if needed.
+ * @param the tree.
+ * @param the page number.
+ * @return the page number of the writable page, 0 on failure.
+ */
+static uint64_t writable(struct bptree*, uint64_t);
+/**
+ * Make all pages on a path writable, and update the references to any
+ * copied page.
+ * @param the tree.
+ * @param the path.
+ * @param the length of the path.
+ * @return 0 on success.
+ */
+static int touch(struct bptree*, struct step*, int);
+/**
+ * Descend from the root towards a key.
+ * Branches are verified when the file is opened, the leaf header is
+ * verified here so leaves are not read until they are needed.
+ * @param the tree.
+ * @param the key, NULL for the first key.
+ * @param the path, written.
+ * @param set to 1 if the key was found in the leaf.
+ * @return the length of the path, 0 if the leaf is damaged.
+ */
+static int descend(const struct bptree*, const void*, struct step*, int*);
+/**
+ * Insert a separator and right page into the branch at level lvl of
+ * the path, splitting it and propagating upwards if needed.
+ * @param the tree.
+ * @param the path.
+ * @param level of the branch, -1 creates a new root.
+ * @param the right page.
+ * @return 0 on success.
+ */
+static int insert_branch(struct bptree*, struct step*, int, uint64_t);
+/**
+ * Check that a page referenced as a leaf is one.
+ * @param the tree.
+ * @param the page.
+ * @return 1 if the page is a leaf with a valid key count.
+ */
+static int leaf_ok(const struct bptree*, uint64_t);
+static int commit(struct bptree*);
+static int load(struct bptree*);
+static int init(struct bptree*);
+/**
+ * Mark all pages reachable from pg in the bitmap, and verify that each
+ * page is within the file and is reached only once, and that each
+ * branch holds no more keys than fits in a page.
+ * Leaves are never read, so opening a file only faults in the branches.
+ * @param the tree.
+ * @param the page.
+ * @param number of levels below the page.
+ * @param the bitmap, one byte per page.
+ * @return 0 if the pages are valid, -1 otherwise.
+ */
+static int mark(const struct bptree*, uint64_t, int, unsigned char*);
+static void bptree_free(struct bptree*);
+
+struct bptree* bptree_open(const char* path,
+                           btree_cmp cmp,
+                           size_t key_len,
+                           size_t val_len,
+                           unsigned int flags)
+{
+        struct bptree* t = calloc(1, sizeof(struct bptree));
+        struct stat st;
+        int oflags = O_RDWR;
+
+        if (t == NULL)
+        {
+                return NULL;
+        }
+        if (key_len == 0)
+        {
+                free(t);
+                return NULL;
+        }
+        if (flags & BPTREE_CREATE)
+        {
+                oflags |= O_CREAT;
+        }
+
+        t->cmp = cmp;
+        t->key_len = key_len;
+        t->val_len = val_len;
+        t->flags = flags;
+        t->leaf_cap = (PAGE - sizeof(struct hdr)) / (key_len + val_len);
+        t->branch_cap = (PAGE - sizeof(struct hdr) - sizeof(uint64_t)) /
+                (key_len + sizeof(uint64_t));
+        t->map = NULL;
+        t->fd = -1;
+        t->scratch = malloc(2 * PAGE);
+        t->sep = malloc(key_len);
+        if (t->leaf_cap < MIN_CAP || t->branch_cap < MIN_CAP ||
+            t->scratch == NULL || t->sep == NULL)
+        {
+                bptree_free(t);
+                return NULL;
+        }
+
+        t->fd = open(path, oflags, 0644);
+        if (t->fd < 0 || fstat(t->fd, &st))
+        {
+                bptree_free(t);
+                return NULL;
+        }
+
+        if (st.st_size == 0)
+        {
+                if (!(flags & BPTREE_CREATE) || init(t))
+                {
+                        bptree_free(t);
+                        return NULL;
+                }
+        }
+        else
+        {
+                t->map_len = (size_t)st.st_size;
+                t->map = mmap(NULL, t->map_len, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, t->fd, 0);
+                if (t->map == MAP_FAILED)
+                {
+                        t->map = NULL;
+                        bptree_free(t);
+                        return NULL;
+                }
+                if (load(t))
+                {
+                        bptree_free(t);
+                        return NULL;
+                }
+        }
+
+        return t;
+}
+
+int bptree_close(struct bptree* t)
+{
+        int ret = commit(t);
+
+        bptree_free(t);
+
+        return ret;
+}
+
+int bptree_insert(struct bptree* t, const void* key, const void* val)
+{
+        struct step path[MAX_DEPTH];
+        int found;
+        int depth = descend(t, key, path, &found);
+        uint64_t leaf;
+        uint64_t right;
+        size_t pos;
+        size_t n;
+        size_t half;
+        unsigned char* keys;
+        unsigned char* vals;
+        int lvl;
+
+        if (depth == 0 || touch(t, path, depth))
+        {
+                return -1;
+        }
+        pos = path[depth - 1].idx;
+        leaf = path[depth - 1].pg;
+        n = HDR(t, leaf)->n;
+        t->dirty = 1;
+
+        if (found)
+        {
+                memcpy(LVAL(t, leaf, pos), val, t->val_len);
+                return t->flags & BPTREE_SYNC ? commit(t) : 0;
+        }
+
+        if (n < t->leaf_cap)
+        {
+                memmove(LKEY(t, leaf, pos + 1), LKEY(t, leaf, pos),
+                        (n - pos) * t->key_len);
+                memmove(LVAL(t, leaf, pos + 1), LVAL(t, leaf, pos),
+                        (n - pos) * t->val_len);
+                memcpy(LKEY(t, leaf, pos), key, t->key_len);
+                memcpy(LVAL(t, leaf, pos), val, t->val_len);
+                HDR(t, leaf)->n = (uint16_t)(n + 1);
+                t->count++;
+                return t->flags & BPTREE_SYNC ? commit(t) : 0;
+        }
+
+        /* The split propagates through all full branches above the
+           leaf, and grows the tree if the root is split. Reserve all
+           pages up front so the split can't fail half way through. */
+        lvl = depth - 2;
+        while (lvl >= 0 && HDR(t, path[lvl].pg)->n == t->branch_cap)
+        {
+                lvl--;
+        }
+        if (reserve(t, (size_t)(depth - lvl - (lvl >= 0 ? 1 : 0))))
+        {
+                return -1;
+        }
+
+        /* Split the leaf, collect all n + 1 entries in scratch memory */
+        right = alloc_page(t, FLAG_LEAF);
+        keys = t->scratch;
+        vals = t->scratch + (n + 1) * t->key_len;
+        memcpy(keys, LKEY(t, leaf, 0), pos * t->key_len);
+        memcpy(keys + pos * t->key_len, key, t->key_len);
+        memcpy(keys + (pos + 1) * t->key_len, LKEY(t, leaf, pos),
+               (n - pos) * t->key_len);
+        memcpy(vals, LVAL(t, leaf, 0), pos * t->val_len);
+        memcpy(vals + pos * t->val_len, val, t->val_len);
+        memcpy(vals + (pos + 1) * t->val_len, LVAL(t, leaf, pos),
+               (n - pos) * t->val_len);
+
+        half = (n + 1) / 2;
+        memcpy(LKEY(t, leaf, 0), keys, half * t->key_len);
+        memcpy(LVAL(t, leaf, 0), vals, half * t->val_len);
+        HDR(t, leaf)->n = (uint16_t)half;
+        memcpy(LKEY(t, right, 0), keys + half * t->key_len,
+               (n + 1 - half) * t->key_len);
+        memcpy(LVAL(t, right, 0), vals + half * t->val_len,
+               (n + 1 - half) * t->val_len);
+        HDR(t, right)->n = (uint16_t)(n + 1 - half);
+        memcpy(t->sep, LKEY(t, right, 0), t->key_len);
+        t->count++;
+
+        if (insert_branch(t, path, depth - 2, right))
+        {
+                return -1;
+        }
+
+        return t->flags & BPTREE_SYNC ? commit(t) : 0;
+}
+
+const void* bptree_find(const struct bptree* t, const void* key)
+{
+        struct step path[MAX_DEPTH];
+        int found;
+        int depth = descend(t, key, path, &found);
+
+        if (!found)
+        {
+                return NULL;
+        }
+
+        return LVAL(t, path[depth - 1].pg, path[depth - 1].idx);
+}
+
+int bptree_remove(struct bptree* t, const void* key)
+{
+        struct step path[MAX_DEPTH];
+        int found;
+        int depth = descend(t, key, path, &found);
+        uint64_t leaf;
+        size_t pos;
+        size_t n;
+        int i;
+
+        if (!found)
+        {
+                return -1;
+        }
+        pos = path[depth - 1].idx;
+        if (touch(t, path, depth))
+        {
+                return -1;
+        }
+        leaf = path[depth - 1].pg;
+        n = HDR(t, leaf)->n;
+        t->dirty = 1;
+
+        memmove(LKEY(t, leaf, pos), LKEY(t, leaf, pos + 1),
+                (n - pos - 1) * t->key_len);
+        memmove(LVAL(t, leaf, pos), LVAL(t, leaf, pos + 1),
+                (n - pos - 1) * t->val_len);
+        HDR(t, leaf)->n = (uint16_t)(n - 1);
+        t->count--;
+
+        /* Release empty pages upwards */
+        i = depth - 1;
+        while (i > 0 && HDR(t, path[i].pg)->n == 0 &&
+               ((HDR(t, path[i].pg)->flags & FLAG_LEAF) ||
+                BCHILD(t, path[i].pg)[0] == 0))
+        {
+                uint64_t parent = path[i - 1].pg;
+                size_t idx = path[i - 1].idx;
+                size_t pn = HDR(t, parent)->n;
+
+                free_page(t, path[i].pg);
+                if (pn == 0)
+                {
+                        /* The parent's only child, parent is empty */
+                        BCHILD(t, parent)[0] = 0;
+                        i--;
+                        continue;
+                }
+
+                /* Remove the child and one of the keys bounding it */
+                if (idx > 0)
+                {
+                        memmove(BKEY(t, parent, idx - 1),
+                                BKEY(t, parent, idx),
+                                (pn - idx) * t->key_len);
+                }
+                else
+                {
+                        memmove(BKEY(t, parent, 0), BKEY(t, parent, 1),
+                                (pn - 1) * t->key_len);
+                }
+                memmove(&BCHILD(t, parent)[idx], &BCHILD(t, parent)[idx + 1],
+                        (pn - idx) * sizeof(uint64_t));
+                HDR(t, parent)->n = (uint16_t)(pn - 1);
+                break;
+        }
+        if (i == 0 && !(HDR(t, t->root)->flags & FLAG_LEAF) &&
+            BCHILD(t, t->root)[0] == 0)
+        {
+                /* Everything is gone, start over with an empty leaf */
+                uint64_t root = alloc_page(t, FLAG_LEAF);
+
+                if (root == 0)
+                {
+                        return -1;
+                }
+                free_page(t, t->root);
+                t->root = root;
+                t->height = 0;
+        }
+
+        /* Shrink the tree while the root has a single child */
+        while (!(HDR(t, t->root)->flags & FLAG_LEAF) &&
+               HDR(t, t->root)->n == 0)
+        {
+                uint64_t old = t->root;
+
+                t->root = BCHILD(t, old)[0];
+                t->height--;
+                free_page(t, old);
+        }
+
+        return t->flags & BPTREE_SYNC ? commit(t) : 0;
+}
+
+int bptree_range(const struct bptree* t,
+                 const void* lo,
+                 const void* hi,
+                 bptree_visit fn,
+                 void* arg)
+{
+        struct step path[MAX_DEPTH];
+        int found;
+        int depth = descend(t, lo, path, &found);
+        size_t pos;
+
+        if (depth == 0)
+        {
+                return -1;
+        }
+        pos = path[depth - 1].idx;
+        for (;;)
+        {
+                uint64_t leaf = path[depth - 1].pg;
+                size_t n = HDR(t, leaf)->n;
+                int lvl;
+
+                for (; pos < n; pos++)
+                {
+                        int r;
+
+                        if (hi && t->cmp(LKEY(t, leaf, pos), hi) >= 0)
+                        {
+                                return 0;
+                        }
+                        r = fn(LKEY(t, leaf, pos), LVAL(t, leaf, pos), arg);
+                        if (r)
+                        {
+                                return r;
+                        }
+                }
+
+                /* Move to the next leaf, find the closest ancestor with
+                   a child to the right */
+                lvl = depth - 2;
+                while (lvl >= 0 && path[lvl].idx >= HDR(t, path[lvl].pg)->n)
+                {
+                        lvl--;
+                }
+                if (lvl < 0)
+                {
+                        return 0;
+                }
+                path[lvl].idx++;
+                for (int i = lvl + 1; i < depth; i++)
+                {
+                        path[i].pg = BCHILD(t, path[i - 1].pg)[path[i - 1].idx];
+                        path[i].idx = 0;
+                }
+                if (!leaf_ok(t, path[depth - 1].pg))
+                {
+                        return -1;
+                }
+                pos = 0;
+        }
+}
+
+int bptree_sync(struct bptree* t)
+{
+        return commit(t);
+}
+
+size_t bptree_size(const struct bptree* t)
+{
+        return (size_t)t->count;
+}
+
+static unsigned char* page(const struct bptree* t, uint64_t pg)
+{
+        return t->map + pg * PAGE;
+}
+
+static uint32_t checksum(const struct meta* m)
+{
+        /* FNV-1a over all fields but the checksum */
+        const unsigned char* p = (const unsigned char*)m;
+        uint32_t h = 2166136261u;
+
+        for (size_t i = 0; i < offsetof(struct meta, checksum); i++)
+        {
+                h ^= p[i];
+                h *= 16777619u;
+        }
+
+        return h;
+}
+
+static int ensure(struct bptree* t, uint64_t npages)
+{
+        size_t len = t->map_len ? t->map_len : 4 * PAGE;
+        void* map;
+
+        if (npages * PAGE <= t->map_len)
+        {
+                return 0;
+        }
+        while (len < npages * PAGE)
+        {
+                len *= 2;
+        }
+
+        if (ftruncate(t->fd, (off_t)len))
+        {
+                return -1;
+        }
+        /* Keep the old mapping until the new one is in place */
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+        if (map == MAP_FAILED)
+        {
+                return -1;
+        }
+        if (t->map)
+        {
+                munmap(t->map, t->map_len);
+        }
+        t->map = map;
+        t->map_len = len;
+
+        return 0;
+}
+
+static uint64_t alloc_page(struct bptree* t, uint16_t flags)
+{
+        uint64_t pg;
+        struct hdr* h;
+
+        if (t->free.len)
+        {
+                pg = t->free.pg[--t->free.len];
+        }
+        else
+        {
+                if (ensure(t, t->npages + 1))
+                {
+                        return 0;
+                }
+                pg = t->npages++;
+        }
+
+        h = HDR(t, pg);
+        h->txn = t->txn;
+        h->flags = flags;
+        h->n = 0;
+        h->pad = 0;
+
+        return pg;
+}
+
+static int reserve(struct bptree* t, size_t n)
+{
+        if (n <= t->free.len)
+        {
+                return 0;
+        }
+
+        return ensure(t, t->npages + (n - t->free.len));
+}
+
+static void free_page(struct bptree* t, uint64_t pg)
+{
+        /* Pages from a committed tree may be needed after a crash until
+           the current transaction is committed */
+        if (HDR(t, pg)->txn == t->txn)
+        {
+                pglist_push(&t->free, pg);
+        }
+        else
+        {
+                pglist_push(&t->pending, pg);
+        }
+}
+
+static int pglist_push(struct pglist* l, uint64_t pg)
+{
+        if (l->len == l->cap)
+        {
+                size_t cap = l->cap ? l->cap * 2 : 64;
+                uint64_t* new = realloc(l->pg, cap * sizeof(uint64_t));
+
+                if (new == NULL)
+                {
+                        /* The page is leaked until the file is opened
+                           again */
+                        return -1;
+                }
+                l->pg = new;
+                l->cap = cap;
+        }
+        l->pg[l->len++] = pg;
+
+        return 0;
+}
+
+static uint64_t writable(struct bptree* t, uint64_t pg)
+{
+        uint64_t new;
+
+        if (HDR(t, pg)->txn == t->txn)
+        {
+                return pg;
+        }
+
+        new = alloc_page(t, 0);
+        if (new == 0)
+        {
+                return 0;
+        }
+        memcpy(page(t, new), page(t, pg), PAGE);
+        HDR(t, new)->txn = t->txn;
+        free_page(t, pg);
+
+        return new;
+}
+
+static int touch(struct bptree* t, struct step* path, int depth)
+{
+        for (int i = 0; i < depth; i++)
+        {
+                uint64_t pg = writable(t, path[i].pg);
+
+                if (pg == 0)
+                {
+                        return -1;
+                }
+                if (pg != path[i].pg)
+                {
+                        if (i == 0)
+                        {
+                                t->root = pg;
+                        }
+                        else
+                        {
+                                BCHILD(t, path[i - 1].pg)[path[i - 1].idx] = pg;
+                        }
+                        path[i].pg = pg;
+                }
+        }
+
+        return 0;
+}
+
+static int descend(const struct bptree* t,
+                   const void* key,
+                   struct step* path,
+                   int* found)
+{
+        uint64_t pg = t->root;
+        int depth = 0;
+
+        *found = 0;
+        for (;;)
+        {
+                struct hdr* h = HDR(t, pg);
+                size_t lo = 0;
+                size_t hi = h->n;
+
+                path[depth].pg = pg;
+                if (depth == t->height)
+                {
+                        if (!leaf_ok(t, pg))
+                        {
+                                return 0;
+                        }
+                        /* First key >= key */
+                        while (key && lo < hi)
+                        {
+                                size_t mid = (lo + hi) / 2;
+
+                                if (t->cmp(LKEY(t, pg, mid), key) < 0)
+                                {
+                                        lo = mid + 1;
+                                }
+                                else
+                                {
+                                        hi = mid;
+                                }
+                        }
+                        if (key && lo < h->n &&
+                            t->cmp(LKEY(t, pg, lo), key) == 0)
+                        {
+                                *found = 1;
+                        }
+                        path[depth].idx = key ? lo : 0;
+                        return depth + 1;
+                }
+
+                /* Number of keys <= key */
+                while (key && lo < hi)
+                {
+                        size_t mid = (lo + hi) / 2;
+
+                        if (t->cmp(BKEY(t, pg, mid), key) <= 0)
+                        {
+                                lo = mid + 1;
+                        }
+                        else
+                        {
+                                hi = mid;
+                        }
+                }
+                path[depth].idx = key ? lo : 0;
+                pg = BCHILD(t, pg)[path[depth].idx];
+                depth++;
+        }
+}
+
+static int insert_branch(struct bptree* t,
+                         struct step* path,
+                         int lvl,
+                         uint64_t right)
+{
+        while (lvl >= 0)
+        {
+                uint64_t pg = path[lvl].pg;
+                size_t idx = path[lvl].idx;
+                size_t n = HDR(t, pg)->n;
+                uint64_t new;
+                unsigned char* keys;
+                uint64_t* child;
+                size_t m;
+
+                if (n < t->branch_cap)
+                {
+                        memmove(BKEY(t, pg, idx + 1), BKEY(t, pg, idx),
+                                (n - idx) * t->key_len);
+                        memmove(&BCHILD(t, pg)[idx + 2],
+                                &BCHILD(t, pg)[idx + 1],
+                                (n - idx) * sizeof(uint64_t));
+                        memcpy(BKEY(t, pg, idx), t->sep, t->key_len);
+                        BCHILD(t, pg)[idx + 1] = right;
+                        HDR(t, pg)->n = (uint16_t)(n + 1);
+                        return 0;
+                }
+
+                /* Split, n + 1 keys and n + 2 children */
+                new = alloc_page(t, 0);
+                if (new == 0)
+                {
+                        return -1;
+                }
+                child = (uint64_t*)t->scratch;
+                keys = t->scratch + (n + 2) * sizeof(uint64_t);
+                memcpy(child, BCHILD(t, pg), (idx + 1) * sizeof(uint64_t));
+                child[idx + 1] = right;
+                memcpy(child + idx + 2, &BCHILD(t, pg)[idx + 1],
+                       (n - idx) * sizeof(uint64_t));
+                memcpy(keys, BKEY(t, pg, 0), idx * t->key_len);
+                memcpy(keys + idx * t->key_len, t->sep, t->key_len);
+                memcpy(keys + (idx + 1) * t->key_len, BKEY(t, pg, idx),
+                       (n - idx) * t->key_len);
+
+                /* Key m moves up */
+                m = (n + 1) / 2;
+                memcpy(BCHILD(t, pg), child, (m + 1) * sizeof(uint64_t));
+                memcpy(BKEY(t, pg, 0), keys, m * t->key_len);
+                HDR(t, pg)->n = (uint16_t)m;
+                memcpy(BCHILD(t, new), child + m + 1,
+                       (n + 1 - m) * sizeof(uint64_t));
+                memcpy(BKEY(t, new, 0), keys + (m + 1) * t->key_len,
+                       (n - m) * t->key_len);
+                HDR(t, new)->n = (uint16_t)(n - m);
+                memcpy(t->sep, keys + m * t->key_len, t->key_len);
+
+                right = new;
+                lvl--;
+        }
+
+        /* The root was split, grow the tree */
+        {
+                uint64_t root = alloc_page(t, 0);
+
+                if (root == 0)
+                {
+                        return -1;
+                }
+                BCHILD(t, root)[0] = t->root;
+                BCHILD(t, root)[1] = right;
+                memcpy(BKEY(t, root, 0), t->sep, t->key_len);
+                HDR(t, root)->n = 1;
+                t->root = root;
+                t->height++;
+        }
+
+        return 0;
+}
+
+static int commit(struct bptree* t)
+{
+        struct meta* m;
+
+        if (!t->dirty)
+        {
+                return 0;
+        }
+
+        /* All pages must be on disk before the meta page refers to
+           them */
+        if (msync(t->map, t->npages * PAGE, MS_SYNC))
+        {
+                return -1;
+        }
+
+        m = (struct meta*)page(t, t->txn % 2);
+        memset(m, 0, sizeof(struct meta));
+        m->magic = MAGIC;
+        m->version = VERSION;
+        m->txn = t->txn;
+        m->root = t->root;
+        m->npages = t->npages;
+        m->count = t->count;
+        m->key_len = (uint32_t)t->key_len;
+        m->val_len = (uint32_t)t->val_len;
+        m->page_size = PAGE;
+        m->checksum = checksum(m);
+        if (msync(m, PAGE, MS_SYNC))
+        {
+                return -1;
+        }
+
+        /* Pages released by this transaction are no longer referenced
+           by the current meta page */
+        for (size_t i = 0; i < t->pending.len; i++)
+        {
+                pglist_push(&t->free, t->pending.pg[i]);
+        }
+        t->pending.len = 0;
+        t->txn++;
+        t->dirty = 0;
+
+        return 0;
+}
+
+static int init(struct bptree* t)
+{
+        t->txn = 1;
+        t->npages = 2;
+        if (ensure(t, 3))
+        {
+                return -1;
+        }
+        memset(t->map, 0, 2 * PAGE);
+        t->root = alloc_page(t, FLAG_LEAF);
+        t->height = 0;
+        t->dirty = 1;
+
+        return commit(t);
+}
+
+static int load(struct bptree* t)
+{
+        struct meta* best = NULL;
+        unsigned char* reach;
+        int height = 0;
+
+        if (t->map_len < 3 * PAGE)
+        {
+                return -1;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+                struct meta* m = (struct meta*)page(t, (uint64_t)i);
+
+                if (m->magic == MAGIC && m->checksum == checksum(m) &&
+                    (best == NULL || m->txn > best->txn))
+                {
+                        best = m;
+                }
+        }
+        if (best == NULL ||
+            best->version != VERSION ||
+            best->page_size != PAGE ||
+            best->key_len != t->key_len ||
+            best->val_len != t->val_len ||
+            best->npages > t->map_len / PAGE ||
+            best->root < 2 ||
+            best->root >= best->npages)
+        {
+                return -1;
+        }
+
+        t->root = best->root;
+        t->npages = best->npages;
+        t->count = best->count;
+        t->txn = best->txn + 1;
+
+        /* Any page not reachable from the root is free */
+        reach = calloc((size_t)t->npages, 1);
+        if (reach == NULL)
+        {
+                return -1;
+        }
+        /* All leaves are at the same depth, verified by mark */
+        for (uint64_t pg = t->root;
+             !(HDR(t, pg)->flags & FLAG_LEAF);
+             pg = BCHILD(t, pg)[0])
+        {
+                if (++height == MAX_DEPTH ||
+                    HDR(t, pg)->n > t->branch_cap ||
+                    BCHILD(t, pg)[0] < 2 ||
+                    BCHILD(t, pg)[0] >= t->npages)
+                {
+                        free(reach);
+                        return -1;
+                }
+        }
+        /* A lone root leaf is cheap to check up front */
+        if ((height == 0 && !leaf_ok(t, t->root)) ||
+            mark(t, t->root, height, reach))
+        {
+                free(reach);
+                return -1;
+        }
+        t->height = height;
+        for (uint64_t pg = 2; pg < t->npages; pg++)
+        {
+                if (!reach[pg])
+                {
+                        pglist_push(&t->free, pg);
+                }
+        }
+        free(reach);
+
+        return 0;
+}
+
+static int mark(const struct bptree* t,
+                uint64_t pg,
+                int height,
+                unsigned char* reach)
+{
+        const struct hdr* h;
+
+        if (pg < 2 || pg >= t->npages || reach[pg])
+        {
+                return -1;
+        }
+        reach[pg] = 1;
+        if (height == 0)
+        {
+                return 0;
+        }
+        h = HDR(t, pg);
+        if ((h->flags & FLAG_LEAF) || h->n > t->branch_cap)
+        {
+                return -1;
+        }
+        for (size_t i = 0; i <= h->n; i++)
+        {
+                if (mark(t, BCHILD(t, pg)[i], height - 1, reach))
+                {
+                        return -1;
+                }
+        }
+
+        return 0;
+}
+
+static int leaf_ok(const struct bptree* t, uint64_t pg)
+{
+        const struct hdr* h = HDR(t, pg);
+
+        return (h->flags & FLAG_LEAF) && h->n <= t->leaf_cap;
+}
+
+static void bptree_free(struct bptree* t)
+{
+        if (t->map)
+        {
+                munmap(t->map, t->map_len);
+        }
+        if (t->fd >= 0)
+        {
+                close(t->fd);
+        }
+        free(t->free.pg);
+        free(t->pending.pg);
+        free(t->scratch);
+        free(t->sep);
+        free(t);
+}
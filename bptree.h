@@ -0,0 +1,134 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#ifndef __BPTREE_H__
+#define __BPTREE_H__
+
+#include <stddef.h>
+#include "btree.h"
+
+struct bptree;
+
+/*
+ * File backed B+tree with fixed size keys and values.
+ * The file is memory mapped and all reads are served from the mapping.
+ * Updates never overwrite a page that is part of the last committed
+ * tree, instead the page is copied (copy on write). A commit flushes the
+ * new pages and then writes one of two alternating meta pages, so after
+ * a crash the file is opened at the last successful commit.
+ *
+ * Keys are ordered by a btree_cmp method, which is called with pointers
+ * to key_len bytes. The key pointers are not guaranteed to be aligned.
+ *
+ * No methods are thread safe, external locking is required.
+ */
+
+/* Create the file if it does not exist */
+#define BPTREE_CREATE 0x1
+/* Commit and flush to disk after every update */
+#define BPTREE_SYNC   0x2
+
+/* Size of a page in the file */
+#define BPTREE_PAGE_SIZE 4096
+
+/**
+ * Visitor method for range scans.
+ * @param pointer to the key.
+ * @param pointer to the value.
+ * @param the user provided argument.
+ * @return 0 to continue the scan, non zero to stop.
+ */
+typedef int (*bptree_visit)(const void*, const void*, void*);
+
+/**
+ * Open an index file.
+ * The header of every page reachable from the root is verified, so a
+ * damaged file is rejected rather than read out of bounds.
+ * @param path to the file.
+ * @param the compare method for keys.
+ * @param size of a key in bytes.
+ * @param size of a value in bytes.
+ * @param flags, BPTREE_CREATE and/or BPTREE_SYNC.
+ * @return the tree, or NULL if the file could not be opened, is damaged
+ *         or was created with a different key or value size.
+ */
+extern struct bptree* bptree_open(const char*, btree_cmp, size_t, size_t,
+                                  unsigned int);
+
+/**
+ * Commit any pending updates and close the file.
+ * @param the tree.
+ * @return 0 if the commit succeeded.
+ */
+extern int bptree_close(struct bptree*);
+
+/**
+ * Insert a key and value.
+ * If the key is present, the value is replaced.
+ * All pages needed by a split are reserved before any page is changed,
+ * so a failed insert leaves the tree unchanged.
+ * @param the tree.
+ * @param the key.
+ * @param the value.
+ * @return 0 on success, -1 on failure.
+ */
+extern int bptree_insert(struct bptree*, const void*, const void*);
+
+/**
+ * Search for a key.
+ * @param the tree.
+ * @param the key.
+ * @return pointer to the value in the mapping, valid until the tree is
+ *         modified, or NULL if not found.
+ */
+extern const void* bptree_find(const struct bptree*, const void*);
+
+/**
+ * Remove a key.
+ * Pages are released when they become empty, they are not merged with
+ * their siblings.
+ * @param the tree.
+ * @param the key.
+ * @return 0 if the key was removed, -1 if not found or on failure.
+ */
+extern int bptree_remove(struct bptree*, const void*);
+
+/**
+ * Visit all keys in [lo, hi) in order.
+ * The tree must not be modified during the scan.
+ * @param the tree.
+ * @param the lower bound (inclusive), NULL to start at the first key.
+ * @param the upper bound (exclusive), NULL to scan to the last key.
+ * @param the visitor.
+ * @param argument passed to the visitor.
+ * @return 0 if the range was scanned, the visitor's return value if the
+ *         scan was stopped, -1 if a damaged leaf was reached.
+ */
+extern int bptree_range(const struct bptree*, const void*, const void*,
+                        bptree_visit, void*);
+
+/**
+ * Commit all updates and flush them to disk.
+ * @param the tree.
+ * @return 0 on success, -1 on failure.
+ */
+extern int bptree_sync(struct bptree*);
+
+/**
+ * Return the number of keys in the tree.
+ * @param the tree.
+ * @return the number of keys.
+ */
+extern size_t bptree_size(const struct bptree*);
+
+#endif /* __BPTREE_H__ */
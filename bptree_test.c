@@ -0,0 +1,530 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#ifndef _XOPEN_SOURCE
+# define _XOPEN_SOURCE 600
+#endif
+
+#include <scut.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "bptree.h"
+
+static int test_bpt_insert(void);
+static int test_bpt_remove(void);
+static int test_bpt_range(void);
+static int test_bpt_reopen(void);
+static int test_bpt_crash(void);
+static int test_bpt_corrupt(void);
+static int test_bpt_grow_fail(void);
+static int cmp_u64(const void*, const void*);
+static void tmp_path(char*);
+
+struct scan
+{
+        uint64_t next;
+        uint64_t step;
+        long count;
+};
+
+int test_bptree(void)
+{
+        int ret;
+
+        scut_create("Test B+tree file");
+
+        SCUT_ADD(test_bpt_insert);
+        SCUT_ADD(test_bpt_remove);
+        SCUT_ADD(test_bpt_range);
+        SCUT_ADD(test_bpt_reopen);
+        SCUT_ADD(test_bpt_crash);
+        SCUT_ADD(test_bpt_corrupt);
+        SCUT_ADD(test_bpt_grow_fail);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+        uint64_t k1;
+        uint64_t k2;
+
+        /* Keys in the file are not aligned */
+        memcpy(&k1, a, sizeof(uint64_t));
+        memcpy(&k2, b, sizeof(uint64_t));
+        if (k1 > k2)
+        {
+                return 1;
+        }
+        if (k1 < k2)
+        {
+                return -1;
+        }
+
+        return 0;
+}
+
+static void tmp_path(char* path)
+{
+        int fd;
+
+        strcpy(path, "/tmp/bptree_test.XXXXXX");
+        fd = mkstemp(path);
+        close(fd);
+}
+
+static int visit_check(const void* k, const void* v, void* arg)
+{
+        struct scan* s = arg;
+        uint64_t key;
+        uint64_t val;
+
+        memcpy(&key, k, sizeof(uint64_t));
+        memcpy(&val, v, sizeof(uint64_t));
+        if (key != s->next || val != key * 3)
+        {
+                return 1;
+        }
+        s->next += s->step;
+        s->count++;
+
+        return 0;
+}
+
+static int test_bpt_insert(void)
+{
+        char path[64];
+        struct bptree* t;
+        uint64_t n = 20000;
+
+        tmp_path(path);
+        t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_CREATE);
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_IE(bptree_size(t), 0);
+
+        for (uint64_t i = 1; i <= n; i++)
+        {
+                uint64_t k = (i * 7919) % n + 1;
+                uint64_t v = k * 3;
+
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &v), 0);
+        }
+        SCUT_ASSERT_IE(bptree_size(t), n);
+
+        for (uint64_t k = 1; k <= n; k++)
+        {
+                const void* v = bptree_find(t, &k);
+                uint64_t val;
+
+                SCUT_ASSERT_TRUE(v);
+                memcpy(&val, v, sizeof(uint64_t));
+                SCUT_ASSERT_IE(val, k * 3);
+        }
+        {
+                uint64_t k = n + 1;
+                uint64_t v = 7;
+
+                SCUT_ASSERT_FALSE(bptree_find(t, &k));
+                /* Replace */
+                k = 1;
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &v), 0);
+                SCUT_ASSERT_IE(bptree_size(t), n);
+                SCUT_ASSERT_IE(memcmp(bptree_find(t, &k), &v, 8), 0);
+        }
+
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+        unlink(path);
+
+        return 0;
+}
+
+static int test_bpt_remove(void)
+{
+        char path[64];
+        struct bptree* t;
+        uint64_t n = 20000;
+        struct scan s = {1, 2, 0};
+
+        tmp_path(path);
+        t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_CREATE);
+
+        for (uint64_t k = 1; k <= n; k++)
+        {
+                uint64_t v = k * 3;
+
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &v), 0);
+        }
+        for (uint64_t k = 2; k <= n; k += 2)
+        {
+                SCUT_ASSERT_IE(bptree_remove(t, &k), 0);
+        }
+        {
+                uint64_t k = 2;
+
+                SCUT_ASSERT_IE(bptree_remove(t, &k), -1);
+        }
+        SCUT_ASSERT_IE(bptree_size(t), n / 2);
+        SCUT_ASSERT_IE(bptree_range(t, NULL, NULL, &visit_check, &s), 0);
+        SCUT_ASSERT_IE(s.count, n / 2);
+
+        /* Empty the tree and start over */
+        for (uint64_t k = 1; k <= n; k += 2)
+        {
+                SCUT_ASSERT_IE(bptree_remove(t, &k), 0);
+        }
+        SCUT_ASSERT_IE(bptree_size(t), 0);
+        s.count = 0;
+        SCUT_ASSERT_IE(bptree_range(t, NULL, NULL, &visit_check, &s), 0);
+        SCUT_ASSERT_IE(s.count, 0);
+        for (uint64_t k = 1; k <= 1000; k++)
+        {
+                uint64_t v = k * 3;
+
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &v), 0);
+        }
+        s.next = 1;
+        s.step = 1;
+        SCUT_ASSERT_IE(bptree_range(t, NULL, NULL, &visit_check, &s), 0);
+        SCUT_ASSERT_IE(s.count, 1000);
+
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+        unlink(path);
+
+        return 0;
+}
+
+static int visit_stop(const void* k, const void* v, void* arg)
+{
+        (void)k;
+        (void)v;
+
+        return --(*(int*)arg) == 0 ? 3 : 0;
+}
+
+static int test_bpt_range(void)
+{
+        char path[64];
+        struct bptree* t;
+        struct scan s = {100, 10, 0};
+        uint64_t lo = 95;
+        uint64_t hi = 5000;
+        int stop = 5;
+
+        tmp_path(path);
+        t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_CREATE);
+
+        for (uint64_t k = 10; k <= 100000; k += 10)
+        {
+                uint64_t v = k * 3;
+
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &v), 0);
+        }
+
+        /* [95, 5000) */
+        SCUT_ASSERT_IE(bptree_range(t, &lo, &hi, &visit_check, &s), 0);
+        SCUT_ASSERT_IE(s.count, 490);
+        SCUT_ASSERT_IE(s.next, 5000);
+
+        /* [5000, end) */
+        s.count = 0;
+        SCUT_ASSERT_IE(bptree_range(t, &hi, NULL, &visit_check, &s), 0);
+        SCUT_ASSERT_IE(s.count, 9501);
+
+        SCUT_ASSERT_IE(bptree_range(t, NULL, NULL, &visit_stop, &stop), 3);
+
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+        unlink(path);
+
+        return 0;
+}
+
+static int test_bpt_reopen(void)
+{
+        char path[64];
+        struct bptree* t;
+        struct scan s = {1, 1, 0};
+
+        tmp_path(path);
+        t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_CREATE);
+        for (uint64_t k = 1; k <= 5000; k++)
+        {
+                uint64_t v = k * 3;
+
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &v), 0);
+        }
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+
+        /* Different key size */
+        SCUT_ASSERT_FALSE(bptree_open(path, &cmp_u64, 16, 8, 0));
+
+        t = bptree_open(path, &cmp_u64, 8, 8, 0);
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_IE(bptree_size(t), 5000);
+        SCUT_ASSERT_IE(bptree_range(t, NULL, NULL, &visit_check, &s), 0);
+        SCUT_ASSERT_IE(s.count, 5000);
+
+        /* Released pages are reused after reopen */
+        for (uint64_t k = 5001; k <= 10000; k++)
+        {
+                uint64_t v = k * 3;
+
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &v), 0);
+                SCUT_ASSERT_IE(bptree_sync(t), 0);
+        }
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+
+        t = bptree_open(path, &cmp_u64, 8, 8, 0);
+        s.next = 1;
+        s.count = 0;
+        SCUT_ASSERT_IE(bptree_range(t, NULL, NULL, &visit_check, &s), 0);
+        SCUT_ASSERT_IE(s.count, 10000);
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+
+        unlink(path);
+        SCUT_ASSERT_FALSE(bptree_open(path, &cmp_u64, 8, 8, 0));
+
+        return 0;
+}
+
+static int test_bpt_crash(void)
+{
+        char path[64];
+        struct bptree* t;
+        pid_t pid;
+        int status;
+
+        tmp_path(path);
+        t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_CREATE);
+        for (uint64_t k = 1; k <= 1000; k++)
+        {
+                uint64_t v = k * 3;
+
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &v), 0);
+        }
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+
+        /* Child updates without committing and dies */
+        pid = fork();
+        if (pid == 0)
+        {
+                t = bptree_open(path, &cmp_u64, 8, 8, 0);
+                for (uint64_t k = 1; k <= 1000; k++)
+                {
+                        bptree_remove(t, &k);
+                }
+                for (uint64_t k = 2000; k <= 3000; k++)
+                {
+                        bptree_insert(t, &k, &k);
+                }
+                _exit(0);
+        }
+        waitpid(pid, &status, 0);
+
+        t = bptree_open(path, &cmp_u64, 8, 8, 0);
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_IE(bptree_size(t), 1000);
+        for (uint64_t k = 1; k <= 1000; k++)
+        {
+                SCUT_ASSERT_TRUE(bptree_find(t, &k));
+        }
+        bptree_close(t);
+
+        /* Child commits every update and dies */
+        pid = fork();
+        if (pid == 0)
+        {
+                t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_SYNC);
+                for (uint64_t k = 1; k <= 500; k++)
+                {
+                        bptree_remove(t, &k);
+                }
+                _exit(0);
+        }
+        waitpid(pid, &status, 0);
+
+        t = bptree_open(path, &cmp_u64, 8, 8, 0);
+        SCUT_ASSERT_IE(bptree_size(t), 500);
+        for (uint64_t k = 1; k <= 1000; k++)
+        {
+                if (k <= 500)
+                {
+                        SCUT_ASSERT_FALSE(bptree_find(t, &k));
+                }
+                else
+                {
+                        SCUT_ASSERT_TRUE(bptree_find(t, &k));
+                }
+        }
+        bptree_close(t);
+        unlink(path);
+
+        return 0;
+}
+
+static int test_bpt_corrupt(void)
+{
+        unsigned char garbage[] = {0x00, 0xff};
+        unsigned char buf[BPTREE_PAGE_SIZE];
+        char path[64];
+        struct bptree* t;
+        uint64_t key;
+        uint64_t other;
+        int left = 1000000;
+        int fd;
+
+        for (int g = 0; g < 2; g++)
+        {
+                off_t len;
+
+                tmp_path(path);
+                t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_CREATE);
+                for (uint64_t k = 1; k <= 5000; k++)
+                {
+                        SCUT_ASSERT_IE(bptree_insert(t, &k, &k), 0);
+                }
+                SCUT_ASSERT_IE(bptree_close(t), 0);
+
+                /* Keep the meta pages, overwrite all other pages */
+                memset(buf, garbage[g], sizeof(buf));
+                fd = open(path, O_RDWR);
+                len = lseek(fd, 0, SEEK_END);
+                for (off_t off = 2 * BPTREE_PAGE_SIZE;
+                     off < len;
+                     off += BPTREE_PAGE_SIZE)
+                {
+                        SCUT_ASSERT_IE(pwrite(fd, buf, sizeof(buf), off),
+                                       sizeof(buf));
+                }
+                close(fd);
+
+                SCUT_ASSERT_FALSE(bptree_open(path, &cmp_u64, 8, 8, 0));
+                unlink(path);
+        }
+
+        /* Leaves are checked on access, a damaged leaf does not stop
+           the rest of the tree from being read */
+        tmp_path(path);
+        t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_CREATE);
+        for (uint64_t k = 1; k <= 5000; k++)
+        {
+                SCUT_ASSERT_IE(bptree_insert(t, &k, &k), 0);
+        }
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+
+        fd = open(path, O_RDWR);
+        for (off_t off = 2 * BPTREE_PAGE_SIZE; ; off += BPTREE_PAGE_SIZE)
+        {
+                uint16_t flags;
+                uint16_t n;
+
+                SCUT_ASSERT_IE(pread(fd, buf, sizeof(buf), off), sizeof(buf));
+                memcpy(&flags, buf + 8, sizeof(flags));
+                memcpy(&n, buf + 10, sizeof(n));
+                if ((flags & 0x1) && n > 0)
+                {
+                        memcpy(&key, buf + 16, sizeof(key));
+                        memset(buf, 0xff, sizeof(buf));
+                        SCUT_ASSERT_IE(pwrite(fd, buf, sizeof(buf), off),
+                                       sizeof(buf));
+                        break;
+                }
+        }
+        close(fd);
+
+        t = bptree_open(path, &cmp_u64, 8, 8, 0);
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_FALSE(bptree_find(t, &key));
+        other = key == 1 ? 5000 : 1;
+        SCUT_ASSERT_TRUE(bptree_find(t, &other));
+        SCUT_ASSERT_IE(bptree_range(t, NULL, NULL, &visit_stop, &left), -1);
+        SCUT_ASSERT_IE(bptree_close(t), 0);
+        unlink(path);
+
+        return 0;
+}
+
+static int test_bpt_grow_fail(void)
+{
+        char path[64];
+        pid_t pid;
+        int status;
+
+        tmp_path(path);
+        pid = fork();
+        if (pid == 0)
+        {
+                struct bptree* t;
+                struct rlimit lim;
+                unsigned long vm;
+                uint64_t n;
+                FILE* f = fopen("/proc/self/statm", "r");
+
+                if (f == NULL || fscanf(f, "%lu", &vm) != 1)
+                {
+                        /* Can not limit the mapping, nothing to test */
+                        _exit(0);
+                }
+                fclose(f);
+                t = bptree_open(path, &cmp_u64, 8, 8, BPTREE_CREATE);
+                if (t == NULL)
+                {
+                        _exit(1);
+                }
+
+                /* Leave room for a few remaps, then growing must fail */
+                lim.rlim_cur = vm * (rlim_t)sysconf(_SC_PAGESIZE) +
+                        (rlim_t)(24 << 20);
+                lim.rlim_max = lim.rlim_cur;
+                if (setrlimit(RLIMIT_AS, &lim))
+                {
+                        _exit(0);
+                }
+                for (n = 1; n < 100000000; n++)
+                {
+                        if (bptree_insert(t, &n, &n))
+                        {
+                                break;
+                        }
+                }
+                if (n == 100000000)
+                {
+                        _exit(2);
+                }
+                for (uint64_t k = 1; k < n; k++)
+                {
+                        const void* v = bptree_find(t, &k);
+
+                        if (v == NULL || memcmp(v, &k, sizeof(k)))
+                        {
+                                _exit(3);
+                        }
+                }
+                _exit(bptree_size(t) == n - 1 ? 0 : 4);
+        }
+        waitpid(pid, &status, 0);
+        unlink(path);
+        SCUT_ASSERT_TRUE(WIFEXITED(status));
+        SCUT_ASSERT_IE(WEXITSTATUS(status), 0);
+
+        return 0;
+}
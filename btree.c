@@ -12,25 +12,243 @@
 */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <assert.h>
+#include <pthread.h>
 #include "btree.h"
 
+/* Number of nodes in the first slab, each new slab doubles in size
+   until BTREE_SLAB_MAX is reached. */
+#define BTREE_SLAB_MIN 16
+#define BTREE_SLAB_MAX 4096
+/* Alignment of the frozen array, size of a cache line */
+#define FROZEN_ALIGN 64
+/* Number of pointers that fit in a cache line, i.e the descendants three
+   levels down in a frozen tree */
+#define FROZEN_BLOCK 8
+
+/* Tasks per thread in parallel operations, more tasks than threads
+   evens out the load when subtrees differ in size */
+#define PAR_TASKS 8
+/* Number of searches in flight in btree_find_batch */
+#define BATCH_LANES 16
+
+#ifdef __GNUC__
+# define PREFETCH(p) __builtin_prefetch(p)
+#else
+# define PREFETCH(p)
+#endif
+
+struct node
+{
+        void* data;
+        struct node* left;
+        struct node* right;
+        struct node* parent;
+        /* Number of nodes in the subtree, only present with
+           BTREE_ORDER_STAT, the other trees allocate nodes without it */
+        size_t size;
+};
+
+/* Bytes per node in a slab */
+#define NODE_STRIDE(flags) ((flags) & BTREE_ORDER_STAT ?               \
+                            sizeof(struct node) :                       \
+                            offsetof(struct node, size))
+/* Node i of an array of nodes with the given stride */
+#define NODE_AT(base, i, stride)                                        \
+        ((struct node*)((char*)(base) + (i) * (stride)))
+
+/**
+ * A slab is a contiguous block of nodes. Nodes are handed out in order
+ * from the most recent slab, so nodes inserted close in time end up
+ * close in memory.
+ */
+struct slab
+{
+        struct slab* next;
+        size_t cap;
+        size_t used;
+        /* Indexed with NODE_AT, the stride is set by the pool */
+        struct node nodes[];
+};
+
+/**
+ * Node allocator. Removed nodes are kept on a free list (linked through
+ * the right pointer) for reuse, and all nodes are released at once by
+ * freeing the slabs.
+ * A pool is owned by a single tree. When a tree adopts the nodes of
+ * another tree the slabs are moved, and btree_split copies the nodes
+ * of the smaller part into a pool of its own.
+ */
+struct node_pool
+{
+        /* The first slab is the one nodes are handed out from */
+        struct slab* slabs;
+        struct slab* last;
+        /* Tails are kept to splice the lists when adopting a pool */
+        struct node* free;
+        struct node* free_last;
+        size_t stride;
+};
+
+/**
+ * Items stored in Eytzinger (breadth first) order, 1-indexed. The
+ * children of item k are found at 2k and 2k + 1.
+ */
+struct btree_frozen
+{
+        void** items;
+        void* mem;
+        btree_cmp cmp;
+        size_t len;
+};
+
 struct btree
 {
         struct node* root;
         btree_cmp cmp;
         size_t len;
+        struct node_pool* pool;
+        unsigned int flags;
 };
 
-struct node
+/**
+ * Arguments for building a subtree from a sorted array.
+ */
+struct build_arg
 {
-        void* data;
-        struct node* left;
-        struct node* right;
+        /* Either node i is at nodes + i * stride and gets item i, or
+           node i is ptrs[i] and keeps its item */
+        struct node* nodes;
+        size_t stride;
+        struct node** ptrs;
+        void** items;
+        size_t beg;
+        size_t end;
+        struct node* parent;
+        /* Number of threads that may be used for the subtree */
+        unsigned int threads;
+        /* Flags of the tree, sizes are set with BTREE_ORDER_STAT */
+        unsigned int flags;
+        /* Output, root of the subtree */
+        struct node* root;
+};
+
+/**
+ * A range of items for a parallel operation, either a single node or a
+ * whole subtree.
+ */
+struct par_task
+{
+        const struct node* root;
+        int single;
+        /* Result of btree_par_fold */
+        void* acc;
+        /* Number of nodes and position in the node array during
+           btree_balance_mt */
+        size_t count;
+        size_t offset;
+};
+
+/**
+ * Shared state for the threads of a parallel operation.
+ */
+struct par_ctx
+{
+        struct par_task* tasks;
+        size_t ntasks;
+        /* Next task to take */
+        size_t next;
+        /* Task method */
+        void (*run)(struct par_ctx*, struct par_task*);
+        btree_fold fold;
+        void* arg;
+        struct node** ptrs;
+};
+
+/* State of a level in btree_walk_bf */
+struct bf_level
+{
+        btree_visit fn;
+        void* arg;
+        /* Number of nodes visited at the level */
+        size_t count;
 };
 
-static struct node* alloc_node(void*);
-static void free_node(struct node*);
+static struct node* alloc_node(struct btree*, void*, struct node*);
+static void free_node(struct btree*, struct node*);
+/**
+ * Put a node on the free list of a pool.
+ * @param the pool.
+ * @param the node.
+ * @return void.
+ */
+static void pool_free(struct node_pool*, struct node*);
+/**
+ * Allocate a slab with room for exactly cap nodes, and mark all nodes
+ * in it as used.
+ * @param the pool to allocate from.
+ * @param number of nodes.
+ * @return the first node in the slab, or NULL on failure.
+ */
+static struct node* pool_alloc_nodes(struct node_pool*, size_t);
+/**
+ * Create a tree from a sorted array of items, either single or
+ * multi threaded.
+ * @param the compare method.
+ * @param the items.
+ * @param number of items.
+ * @param number of threads to use.
+ * @return the tree, or NULL on failure.
+ */
+static struct btree* build_sorted(btree_cmp, void**, size_t, unsigned int);
+/**
+ * Build a balanced subtree of the items in [beg, end), node i holds
+ * item i so disjoint ranges can be built concurrently.
+ * @param build arguments, the root is returned in arg->root.
+ * @return NULL.
+ */
+static void* build_subtree(void*);
+/**
+ * Fill the frozen array at index k and its subtrees with the nodes in
+ * order, starting from node n.
+ * @param the frozen tree.
+ * @param current index.
+ * @param next node in order, updated.
+ * @return void.
+ */
+static void freeze_fill(struct btree_frozen*, size_t, struct node**);
+/**
+ * Return the index of the first item in the frozen tree with the same or
+ * higher order than the provided item.
+ * @param the frozen tree.
+ * @param the item to compare with.
+ * @return the index, or 0 if no such item exists.
+ */
+static size_t frozen_search(const struct btree_frozen*, const void*);
+/**
+ * Release all slabs owned by the pool.
+ * @param the pool to release.
+ * @return void.
+ */
+static void pool_release(struct node_pool*);
+/**
+ * Copy all nodes of a tree into a single new slab in the tree's pool,
+ * and rebuild it balanced. The old nodes are put on the free list of
+ * the pool they were allocated from.
+ * @param the tree, with the pool to copy the nodes into.
+ * @param the pool the nodes currently lives in.
+ * @return 0 on success, -1 if no memory could be allocated, the tree
+ *         is then left untouched.
+ */
+static int relocate(struct btree*, struct node_pool*);
+/**
+ * Move all nodes of tree src into the pool of tree dst.
+ * @param the receiving tree.
+ * @param the tree whose nodes are moved.
+ * @return void.
+ */
+static void adopt(struct btree*, struct btree*);
 /**
  * Find the min (left most) element in the subtree referenced by
  * node. 
@@ -39,76 +257,421 @@ static void free_node(struct node*);
  */
 static struct node* find_min(const struct node*);
 /**
- * Wrapper method to be able to use qsort(3c),
- * qsort(3c) uses the address of the pointer as value,
- * whereas the provided cmp method accepts the pointer as value.
- * De-reference the pointer and call the t->cmp.
- * To allow access to the method, it's stored in a module scoped variable,
- * hence all methods using this are NOT thread safe.
+ * Find the max (right most) element in the subtree referenced by
+ * node.
+ * @param the subtree to scan.
+ * @return the maximum tree node.
  */
-static int cmp_wrap(const void*, const void*);
-
+static struct node* find_max(const struct node*);
+/**
+ * Find the in order successor of a node.
+ * @param the node.
+ * @return the successor, or NULL if node is the last node.
+ */
+static struct node* successor(const struct node*);
+/**
+ * Find the in order predecessor of a node.
+ * @param the node.
+ * @return the predecessor, or NULL if node is the first node.
+ */
+static struct node* predecessor(const struct node*);
+/**
+ * Add a value to the subtree size of a node and all its ancestors.
+ * @param the first node to update.
+ * @param the value to add.
+ * @return void.
+ */
+static void add_size(struct node*, size_t);
+/**
+ * Recalculate the subtree size for all nodes in a subtree, in post
+ * order without using any extra memory.
+ * @param the subtree to update.
+ * @return void.
+ */
+static void update_sizes(struct node*);
+/**
+ * Return the subtree size of a node.
+ * @param the node, may be NULL.
+ * @return the number of nodes in the subtree.
+ */
+static size_t node_size(const struct node*);
+/**
+ * Rotate the tree rooted at root into a vine, i.e a linked list
+ * through the right pointers in increasing order.
+ * @param pseudo root, the tree is the right child of root.
+ * @return void.
+ */
+static void tree_to_vine(struct node*);
 /**
- * To be able to call qsort on the tree we need to store the current
- * compare function in this module for use by the cmp_wrap method.
+ * Rotate a vine of size nodes into a balanced tree.
+ * @param pseudo root, the vine is the right child of root.
+ * @param number of nodes in the vine.
+ * @return void.
  */
-static btree_cmp cmp;
+static void vine_to_tree(struct node*, size_t);
+/**
+ * Perform count left rotations along the vine, every other node
+ * becomes the left child of its successor.
+ * @param pseudo root, the vine is the right child of root.
+ * @param number of rotations to perform.
+ * @return void.
+ */
+static void compress(struct node*, size_t);
+/**
+ * Flatten a tree into a vine, i.e a list linked through the right
+ * pointer, in order.
+ * @param the root of the tree, may be NULL.
+ * @return the first node of the vine.
+ */
+static struct node* flatten(struct node*);
+/**
+ * Rebuild a tree as a balanced tree from a vine.
+ * @param the tree.
+ * @param the first node of the vine.
+ * @param number of nodes in the vine.
+ * @return void.
+ */
+static void rebuild(struct btree*, struct node*, size_t);
+/**
+ * Stackless depth first traversal, parent pointers are used to move up.
+ * @param the root of the traversal.
+ * @param the order.
+ * @param the depth to visit, deeper nodes are not descended into.
+ *        (size_t)-1 visits all depths.
+ * @param the visitor.
+ * @param argument passed to the visitor.
+ * @return 0 or the visitor's non zero return value.
+ */
+static int walk(const struct node*, int, size_t, btree_visit, void*);
+/**
+ * Cut the top levels of a tree into tasks, in order.
+ * @param the subtree.
+ * @param number of levels to cut.
+ * @param task array, written.
+ * @return the number of tasks written.
+ */
+static size_t make_tasks(const struct node*, unsigned int, struct par_task*);
+/**
+ * Run all tasks with up to the provided number of threads.
+ * @param the context.
+ * @param max number of threads to use.
+ * @return void.
+ */
+static void par_run(struct par_ctx*, unsigned int);
+static void* par_worker(void*);
+/* Task methods */
+static void task_fold(struct par_ctx*, struct par_task*);
+static void task_count(struct par_ctx*, struct par_task*);
+static void task_collect(struct par_ctx*, struct par_task*);
+/* Visitors used for btree_bf, btree_df and btree_walk_bf */
+static int collect(void*, void*);
+static int count_level(void*, void*);
 
 struct btree* btree_create(btree_cmp cmp)
+{
+        return btree_create_flags(cmp, 0);
+}
+
+struct btree* btree_create_flags(btree_cmp cmp, unsigned int flags)
 {
         struct btree* bt = (struct btree*)malloc(sizeof(struct btree));
-        
+
+        if (bt == NULL)
+        {
+                return NULL;
+        }
+
+        bt->pool = malloc(sizeof(struct node_pool));
+        if (bt->pool == NULL)
+        {
+                free(bt);
+                return NULL;
+        }
+
         bt->cmp = cmp;
         bt->root = NULL;
         bt->len = 0;
+        bt->pool->slabs = NULL;
+        bt->pool->last = NULL;
+        bt->pool->free = NULL;
+        bt->pool->free_last = NULL;
+        bt->pool->stride = NODE_STRIDE(flags);
+        bt->flags = flags;
 
         return bt;
 }
 
+struct btree* btree_build_sorted(btree_cmp cmp, void** items, size_t n)
+{
+        return build_sorted(cmp, items, n, 1);
+}
+
+struct btree* btree_build_sorted_mt(btree_cmp cmp, 
+                                    void** items, 
+                                    size_t n, 
+                                    unsigned int threads)
+{
+        return build_sorted(cmp, items, n, threads ? threads : 1);
+}
+
 void btree_clear(struct btree* bt)
 {
-        struct node** stack = malloc(btree_size(bt) * sizeof(struct node*));
-        int sp = 0;
-        
-        if (bt->root)
+        /* All nodes lives in the pool, no need to visit them */
+        pool_release(bt->pool);
+        bt->len = 0;
+        bt->root = NULL;
+
+        return;
+}
+
+void btree_destroy(struct btree* bt)
+{
+        btree_clear(bt);
+        free(bt->pool);
+        free(bt);
+}
+
+struct btree* btree_split(struct btree* bt, const void* d)
+{
+        struct btree* r = btree_create_flags(bt->cmp, bt->flags);
+        struct node_pool* p;
+        struct node* lroot = NULL;
+        struct node* rroot = NULL;
+        struct node** lhook = &lroot;
+        struct node** rhook = &rroot;
+        struct node* lpar = NULL;
+        struct node* rpar = NULL;
+        struct node* n = bt->root;
+
+        if (r == NULL)
+        {
+                return NULL;
+        }
+        /* Walk the search path, every node on it goes to the left tree
+           with its left subtree, or to the right tree with its right
+           subtree. The other subtree is cut off and handled further
+           down the path. */
+        while (n)
         {
-                stack[sp++] = bt->root;
+                if (bt->cmp(n->data, d) < 0)
+                {
+                        *lhook = n;
+                        n->parent = lpar;
+                        lpar = n;
+                        lhook = &n->right;
+                        n = n->right;
+                }
+                else
+                {
+                        *rhook = n;
+                        n->parent = rpar;
+                        rpar = n;
+                        rhook = &n->left;
+                        n = n->left;
+                }
         }
+        *lhook = NULL;
+        *rhook = NULL;
 
-        while (sp-- > 0)
+        bt->root = lroot;
+        r->root = rroot;
+        if (bt->flags & BTREE_ORDER_STAT)
         {
-                struct node* n = stack[sp];
-                
-                if (n->left)
+                /* Only the nodes on the path changed */
+                for (n = lpar; n; n = n->parent)
                 {
-                        stack[sp++] = n->left;
+                        n->size = 1 + node_size(n->left) + node_size(n->right);
                 }
-                if (n->right)
+                for (n = rpar; n; n = n->parent)
                 {
-                        stack[sp++] = n->right;
+                        n->size = 1 + node_size(n->left) + node_size(n->right);
                 }
-                
-                free(n);
+                r->len = node_size(rroot);
         }
+        else
+        {
+                /* Count the smaller side, both sides are stepped in
+                   lockstep until one of them ends */
+                const struct node* x = lroot ? find_min(lroot) : NULL;
+                const struct node* y = rroot ? find_min(rroot) : NULL;
+                size_t c = 0;
 
-        bt->len = 0;
-        bt->root = NULL;
-        free(stack);
+                while (x && y)
+                {
+                        x = successor(x);
+                        y = successor(y);
+                        c++;
+                }
+                r->len = y ? bt->len - c : c;
+        }
+        bt->len -= r->len;
 
-        return;
+        /* Each tree owns its pool, copy the smaller part to the new
+           pool and let the other part keep the nodes where they are */
+        p = bt->pool;
+        if (r->len > bt->len)
+        {
+                bt->pool = r->pool;
+                r->pool = p;
+                if (relocate(bt, p))
+                {
+                        r->pool = bt->pool;
+                        bt->pool = p;
+                        goto fail;
+                }
+        }
+        else if (relocate(r, p))
+        {
+                goto fail;
+        }
+
+        return r;
+fail:
+        /* Put the tree back together, joining allocates no memory */
+        btree_join(bt, r);
+        btree_destroy(r);
+
+        return NULL;
 }
 
-void btree_destroy(struct btree* bt)
+int btree_join(struct btree* a, struct btree* b)
 {
-        btree_clear(bt);
-        free(bt);
+        struct node* m;
+
+        if (a->cmp != b->cmp || a->flags != b->flags)
+        {
+                return -1;
+        }
+        if (b->root == NULL)
+        {
+                return 0;
+        }
+#ifndef NDEBUG
+        if (a->root)
+        {
+                /* All items in a must have lower order than in b */
+                assert(a->cmp(find_max(a->root)->data,
+                              find_min(b->root)->data) < 0);
+        }
+#endif
+        adopt(a, b);
+
+        if (a->root == NULL)
+        {
+                a->root = b->root;
+        }
+        else
+        {
+                /* Unlink the max node of a, and make it the root with a
+                   to the left and b to the right */
+                m = find_max(a->root);
+                if (m->parent)
+                {
+                        m->parent->right = m->left;
+                        if (a->flags & BTREE_ORDER_STAT)
+                        {
+                                add_size(m->parent, (size_t)-1);
+                        }
+                }
+                else
+                {
+                        a->root = m->left;
+                }
+                if (m->left)
+                {
+                        m->left->parent = m->parent;
+                }
+
+                m->left = a->root;
+                m->right = b->root;
+                m->parent = NULL;
+                if (m->left)
+                {
+                        m->left->parent = m;
+                }
+                m->right->parent = m;
+                if (a->flags & BTREE_ORDER_STAT)
+                {
+                        m->size = 1 + node_size(m->left) +
+                                node_size(m->right);
+                }
+                a->root = m;
+        }
+
+        a->len += b->len;
+        b->root = NULL;
+        b->len = 0;
+
+        return 0;
+}
+
+int btree_merge(struct btree* a, struct btree* b)
+{
+        struct node head;
+        struct node* tail = &head;
+        struct node* x;
+        struct node* y;
+        size_t len = 0;
+
+        if (a->cmp != b->cmp || a->flags != b->flags)
+        {
+                return -1;
+        }
+        adopt(a, b);
+        x = flatten(a->root);
+        y = flatten(b->root);
+
+        /* Merge the two sorted vines, on equal order the item in b
+           replaces the one in a */
+        while (x && y)
+        {
+                int c = a->cmp(x->data, y->data);
+                struct node* n;
+
+                if (c == 0)
+                {
+                        n = x->right;
+                        free_node(a, x);
+                        x = n;
+                        continue;
+                }
+                if (c < 0)
+                {
+                        n = x;
+                        x = x->right;
+                }
+                else
+                {
+                        n = y;
+                        y = y->right;
+                }
+                tail->right = n;
+                tail = n;
+                len++;
+        }
+        tail->right = x ? x : y;
+        for (; tail->right; tail = tail->right)
+        {
+                len++;
+        }
+
+        rebuild(a, head.right, len);
+        a->len = len;
+        b->root = NULL;
+        b->len = 0;
+
+        return 0;
 }
 
 int btree_insert(struct btree* bt, void* d)
 {
         if (bt->root == NULL)
         {
-                bt->root = alloc_node(d);
+                bt->root = alloc_node(bt, d, NULL);
+                if (bt->root == NULL)
+                {
+                        return -1;
+                }
                 bt->len++;
                 return 0;
         }
@@ -130,7 +693,15 @@ int btree_insert(struct btree* bt, void* d)
                         /* n->data > d */
                         if (n->left == NULL)
                         {
-                                n->left = alloc_node(d);
+                                n->left = alloc_node(bt, d, n);
+                                if (n->left == NULL)
+                                {
+                                        return -1;
+                                }
+                                if (bt->flags & BTREE_ORDER_STAT)
+                                {
+                                        add_size(n, 1);
+                                }
                                 bt->len++;
                                 break;
                         }
@@ -141,7 +712,15 @@ int btree_insert(struct btree* bt, void* d)
                         /* n->data < d */
                         if (n->right == NULL)
                         {
-                                n->right = alloc_node(d);
+                                n->right = alloc_node(bt, d, n);
+                                if (n->right == NULL)
+                                {
+                                        return -1;
+                                }
+                                if (bt->flags & BTREE_ORDER_STAT)
+                                {
+                                        add_size(n, 1);
+                                }
                                 bt->len++;
                                 break;
                         }
@@ -185,6 +764,67 @@ void* btree_find(const struct btree* bt, const void* d)
         return ret;
 }
 
+size_t btree_find_batch(const struct btree* bt,
+                        void** keys,
+                        size_t n,
+                        void** out)
+{
+        struct node* node[BATCH_LANES];
+        size_t key[BATCH_LANES];
+        size_t next = 0;
+        size_t found = 0;
+        int active = 0;
+
+        /* Each lane runs one search, when it completes the lane picks
+           up the next key. Lanes are kept packed in [0, active). */
+        while (active < BATCH_LANES && next < n)
+        {
+                node[active] = bt->root;
+                key[active] = next++;
+                active++;
+        }
+
+        while (active > 0)
+        {
+                for (int i = 0; i < active;)
+                {
+                        struct node* c = node[i];
+                        int r = 0;
+
+                        if (c != NULL)
+                        {
+                                r = bt->cmp(c->data, keys[key[i]]);
+                        }
+                        if (c == NULL || r == 0)
+                        {
+                                out[key[i]] = c ? c->data : NULL;
+                                found += c != NULL;
+                                if (next < n)
+                                {
+                                        node[i] = bt->root;
+                                        key[i] = next++;
+                                }
+                                else
+                                {
+                                        active--;
+                                        node[i] = node[active];
+                                        key[i] = key[active];
+                                        continue;
+                                }
+                        }
+                        else
+                        {
+                                node[i] = r > 0 ? c->left : c->right;
+                                /* Loaded while the other lanes advance */
+                                PREFETCH(node[i]);
+                        }
+                        i++;
+                }
+        }
+
+        return found;
+}
+
 void* btree_remove(struct btree* bt, const void* d)
 {
         struct node* n = bt->root;
@@ -216,11 +856,16 @@ void* btree_remove(struct btree* bt, const void* d)
                                 nc++;
                         }
                         
+                        if (nc < 2 && (bt->flags & BTREE_ORDER_STAT))
+                        {
+                                add_size(n->parent, (size_t)-1);
+                        }
+
                         if (nc == 0)
                         {
                                 /* No children */
                                 *p = NULL;
-                                free_node(n);
+                                free_node(bt, n);
                                 bt->len--;
                         }
 
@@ -236,8 +881,9 @@ void* btree_remove(struct btree* bt, const void* d)
                                 {
                                         *p = n->right;
                                 }
+                                (*p)->parent = n->parent;
                                 bt->len--;
-                                free_node(n);
+                                free_node(bt, n);
                         }
                         
                         if (nc == 2)
@@ -272,25 +918,212 @@ void* btree_remove(struct btree* bt, const void* d)
         return (void*)ret;
 }
 
-void** btree_bf(const struct btree* bt)
+void* btree_first(const struct btree* bt, struct btree_cursor* cur)
 {
-        struct node** list = malloc(btree_size(bt) * sizeof(struct node*));
-        void** ret = malloc((btree_size(bt) + 1) * sizeof(void*));
-        struct node* n;
-        int in = 0;
-        int out = 0;
-        int p = 0;
+        struct node* n = NULL;
 
         if (bt->root)
         {
-                list[in++] = bt->root;
+                n = find_min(bt->root);
         }
-
-        while (out < in)
+        if (cur)
         {
-                n = list[out++];
-                ret[p++] = (void*)n->data;
-                
+                cur->pos = n;
+        }
+
+        return n ? n->data : NULL;
+}
+
+void* btree_last(const struct btree* bt, struct btree_cursor* cur)
+{
+        struct node* n = NULL;
+
+        if (bt->root)
+        {
+                n = find_max(bt->root);
+        }
+        if (cur)
+        {
+                cur->pos = n;
+        }
+
+        return n ? n->data : NULL;
+}
+
+void* btree_lower_bound(const struct btree* bt, 
+                        const void* d, 
+                        struct btree_cursor* cur)
+{
+        struct node* n = bt->root;
+        struct node* ret = NULL;
+
+        while (n)
+        {
+                if (bt->cmp(n->data, d) >= 0)
+                {
+                        /* n->data >= d, candidate */
+                        ret = n;
+                        n = n->left;
+                }
+                else
+                {
+                        n = n->right;
+                }
+        }
+        if (cur)
+        {
+                cur->pos = ret;
+        }
+
+        return ret ? ret->data : NULL;
+}
+
+void* btree_upper_bound(const struct btree* bt, 
+                        const void* d, 
+                        struct btree_cursor* cur)
+{
+        struct node* n = bt->root;
+        struct node* ret = NULL;
+
+        while (n)
+        {
+                if (bt->cmp(n->data, d) > 0)
+                {
+                        /* n->data > d, candidate */
+                        ret = n;
+                        n = n->left;
+                }
+                else
+                {
+                        n = n->right;
+                }
+        }
+        if (cur)
+        {
+                cur->pos = ret;
+        }
+
+        return ret ? ret->data : NULL;
+}
+
+void* btree_next(struct btree_cursor* cur)
+{
+        struct node* n = (struct node*)cur->pos;
+
+        if (n == NULL)
+        {
+                return NULL;
+        }
+
+        n = successor(n);
+        cur->pos = n;
+
+        return n ? n->data : NULL;
+}
+
+void* btree_prev(struct btree_cursor* cur)
+{
+        struct node* n = (struct node*)cur->pos;
+
+        if (n == NULL)
+        {
+                return NULL;
+        }
+
+        n = predecessor(n);
+        cur->pos = n;
+
+        return n ? n->data : NULL;
+}
+
+struct btree_frozen* btree_freeze(const struct btree* bt)
+{
+        struct btree_frozen* fz = malloc(sizeof(struct btree_frozen));
+        struct node* n = NULL;
+        size_t align;
+
+        if (fz == NULL)
+        {
+                return NULL;
+        }
+
+        /* Align the array so the descendants of an item share a cache
+           line */
+        fz->mem = malloc((btree_size(bt) + 1) * sizeof(void*) + FROZEN_ALIGN);
+        if (fz->mem == NULL)
+        {
+                free(fz);
+                return NULL;
+        }
+        align = (size_t)fz->mem % FROZEN_ALIGN;
+        fz->items = (void**)((char*)fz->mem + (FROZEN_ALIGN - align));
+        fz->items[0] = NULL;
+        fz->cmp = bt->cmp;
+        fz->len = btree_size(bt);
+
+        if (bt->root)
+        {
+                n = find_min(bt->root);
+        }
+        freeze_fill(fz, 1, &n);
+
+        return fz;
+}
+
+void* btree_frozen_find(const struct btree_frozen* fz, const void* d)
+{
+        size_t k = frozen_search(fz, d);
+
+        if (k && fz->cmp(fz->items[k], d) == 0)
+        {
+                return fz->items[k];
+        }
+
+        return NULL;
+}
+
+void* btree_frozen_lower_bound(const struct btree_frozen* fz, const void* d)
+{
+        return fz->items[frozen_search(fz, d)];
+}
+
+size_t btree_frozen_size(const struct btree_frozen* fz)
+{
+        return fz->len;
+}
+
+void btree_frozen_destroy(struct btree_frozen* fz)
+{
+        free(fz->mem);
+        free(fz);
+}
+
+void** btree_bf(const struct btree* bt)
+{
+        struct node** list = malloc((btree_size(bt) + 1) * sizeof(struct node*));
+        void** ret = malloc((btree_size(bt) + 1) * sizeof(void*));
+        struct node* n;
+        size_t in = 0;
+        size_t out = 0;
+        size_t p = 0;
+
+        if (list == NULL || ret == NULL)
+        {
+                free(list);
+                free(ret);
+                return NULL;
+        }
+
+        if (bt->root)
+        {
+                list[in++] = bt->root;
+        }
+
+        while (out < in)
+        {
+                n = list[out++];
+                ret[p++] = (void*)n->data;
+
                 if (n->left)
                 {
                         list[in++] = n->left;
@@ -301,86 +1134,100 @@ void** btree_bf(const struct btree* bt)
                         list[in++] = n->right;
                 }
         }
-        
+
         free(list);
         ret[p] = NULL;
+
         return ret;
 }
 
 void** btree_df(const struct btree* bt)
 {
-        struct node** stack = malloc(btree_size(bt) * sizeof(struct node*));
         void** ret = malloc((btree_size(bt) + 1) * sizeof(void*));
-        struct node* n;
-        int sp = 0;
-        int p = 0;
-        
-        if (bt->root)
+        void** p = ret;
+
+        if (ret == NULL)
         {
-                stack[sp++] = bt->root;
+                return NULL;
         }
+        btree_walk(bt, BTREE_PRE_ORDER, &collect, &p);
+        *p = NULL;
+
+        return ret;
+}
+
+int btree_walk(const struct btree* bt, int order, btree_visit fn, void* arg)
+{
+        return walk(bt->root, order, (size_t)-1, fn, arg);
+}
+
+int btree_walk_bf(const struct btree* bt, btree_visit fn, void* arg)
+{
+        struct bf_level l;
+        int r;
 
-        while (sp-- > 0)
+        l.fn = fn;
+        l.arg = arg;
+        /* A level without any nodes means all deeper levels are empty */
+        for (size_t depth = 0; bt->root; depth++)
         {
-                n = stack[sp];
-                ret[p++] = (void*)n->data;
-                
-                if (n->right)
+                l.count = 0;
+                r = walk(bt->root, BTREE_PRE_ORDER, depth, &count_level, &l);
+                if (r)
                 {
-                        stack[sp++] = n->right;
+                        return r;
                 }
-                if (n->left)
+                if (l.count == 0)
                 {
-                        stack[sp++] = n->left;
+                        break;
                 }
         }
 
-        free(stack);
-        ret[p] = NULL;
-
-        return ret;
+        return 0;
 }
 
 unsigned int btree_height(const struct btree* bt)
 {
-        struct node** stack_n = malloc(btree_size(bt) * sizeof(struct node*));
-        unsigned int* stack_h = malloc(btree_size(bt) * sizeof(int));
+        const struct node* n = bt->root;
+        const struct node* prev = NULL;
+        unsigned int depth = 1;
         unsigned int h = 0;
-        int sp = 0;
-        
-        if (bt->root)
-        {
-                stack_h[sp] = 1;
-                stack_n[sp++] = bt->root;
-        }
-        
-        while (sp-- > 0)
+
+        while (n)
         {
-                struct node* n;
-                unsigned int curr = stack_h[sp];
+                const struct node* next;
 
-                if (curr > h)
+                if (prev == n->parent)
+                {
+                        /* Arrived from above */
+                        if (depth > h)
+                        {
+                                h = depth;
+                        }
+                        next = n->left ? n->left :
+                                n->right ? n->right : n->parent;
+                }
+                else if (prev == n->left)
                 {
-                        h = curr;
+                        next = n->right ? n->right : n->parent;
+                }
+                else
+                {
+                        next = n->parent;
                 }
 
-                n = stack_n[sp];
-
-                if (n->left)
+                if (next == n->parent)
                 {
-                        stack_h[sp] = curr + 1;
-                        stack_n[sp++] = n->left;
+                        depth--;
                 }
-                if (n->right)
+                else
                 {
-                        stack_h[sp] = curr + 1;
-                        stack_n[sp++] = n->right;
+                        depth++;
                 }
+                prev = n;
+                n = next;
         }
 
-        free(stack_n);
-        free(stack_h);
-
         return h;
 }
 
@@ -389,84 +1236,1029 @@ size_t btree_size(const struct btree* bt)
         return bt->len;
 }
 
-int btree_balance(struct btree* bt)
+void* btree_par_fold(const struct btree* bt,
+                     unsigned int threads,
+                     void* init,
+                     btree_fold fold,
+                     btree_combine combine,
+                     void* arg)
 {
-        void** bf = btree_bf(bt);
-        size_t* stack_b = malloc(btree_size(bt) * sizeof(size_t));
-        size_t* stack_e = malloc(btree_size(bt) * sizeof(size_t));
-        int sp = 0;
-        size_t beg = 0;
-        size_t end = btree_size(bt);
-        size_t pivot;
+        struct par_ctx ctx;
+        unsigned int depth = 0;
+        void* acc;
 
-        /* Store current compare func */
-        cmp = bt->cmp;
-        qsort(bf, btree_size(bt), sizeof(void*), cmp_wrap);
+        if (bt->root == NULL)
+        {
+                return init;
+        }
 
-        btree_clear(bt);
+        while ((1u << depth) < threads * PAR_TASKS && depth < 16)
+        {
+                depth++;
+        }
+        /* A cut of depth d gives at most 2^(d+1) - 1 tasks */
+        ctx.tasks = malloc(((size_t)2 << depth) * sizeof(struct par_task));
+        if (ctx.tasks == NULL)
+        {
+                /* Fall back to a single task */
+                struct par_task t;
+
+                ctx.fold = fold;
+                ctx.arg = arg;
+                t.root = bt->root;
+                t.single = 0;
+                t.acc = init;
+                task_fold(&ctx, &t);
+                return t.acc;
+        }
+        ctx.ntasks = make_tasks(bt->root, depth, ctx.tasks);
+        ctx.next = 0;
+        ctx.run = &task_fold;
+        ctx.fold = fold;
+        ctx.arg = arg;
+        for (size_t i = 0; i < ctx.ntasks; i++)
+        {
+                ctx.tasks[i].acc = init;
+        }
 
-        /* Insert the pivot element into the three and recursivly
-           continue with the left and right subtree */
-        stack_b[sp] = beg;
-        stack_e[sp++] = end;
+        par_run(&ctx, threads);
 
-        while (sp-- > 0)
+        acc = ctx.tasks[0].acc;
+        for (size_t i = 1; i < ctx.ntasks; i++)
         {
-                beg = stack_b[sp];
-                end = stack_e[sp];
-                pivot = (beg + end) / 2;
+                acc = combine(acc, ctx.tasks[i].acc, arg);
+        }
+        free(ctx.tasks);
 
-                btree_insert(bt, bf[pivot]);
-                if (end > pivot + 1)
-                {
-                        stack_b[sp] = pivot + 1;
-                        stack_e[sp] = end;
-                        sp++;
-                }
-                if (beg < pivot)
-                {
-                        stack_b[sp] = beg;
-                        stack_e[sp] = pivot;
-                        sp++;
-                }
+        return acc;
+}
+
+int btree_balance_mt(struct btree* bt, unsigned int threads)
+{
+        struct par_ctx ctx;
+        struct build_arg build;
+        unsigned int depth = 0;
+        size_t offset = 0;
+
+        if (threads < 2 || bt->len < 2)
+        {
+                return btree_balance(bt);
+        }
+
+        while ((1u << depth) < threads * PAR_TASKS && depth < 16)
+        {
+                depth++;
+        }
+        ctx.tasks = malloc(((size_t)2 << depth) * sizeof(struct par_task));
+        ctx.ptrs = malloc(bt->len * sizeof(struct node*));
+        if (ctx.tasks == NULL || ctx.ptrs == NULL)
+        {
+                free(ctx.tasks);
+                free(ctx.ptrs);
+                return -1;
+        }
+
+        /* Collect the nodes in order, first count the nodes of each
+           task to know where in the array its nodes go */
+        ctx.ntasks = make_tasks(bt->root, depth, ctx.tasks);
+        ctx.next = 0;
+        ctx.run = &task_count;
+        par_run(&ctx, threads);
+        for (size_t i = 0; i < ctx.ntasks; i++)
+        {
+                ctx.tasks[i].offset = offset;
+                offset += ctx.tasks[i].count;
         }
+        ctx.next = 0;
+        ctx.run = &task_collect;
+        par_run(&ctx, threads);
+
+        /* Relink the nodes as a balanced tree */
+        build.nodes = NULL;
+        build.stride = 0;
+        build.ptrs = ctx.ptrs;
+        build.items = NULL;
+        build.beg = 0;
+        build.end = bt->len;
+        build.parent = NULL;
+        build.threads = threads;
+        build.flags = bt->flags;
+        build_subtree(&build);
+        bt->root = build.root;
+
+        free(ctx.tasks);
+        free(ctx.ptrs);
 
-        free(bf);
-        free(stack_b);
-        free(stack_e);
         return 0;
 }
 
-struct node* alloc_node(void* d)
+int btree_balance(struct btree* bt)
 {
-        struct node* new = malloc(sizeof(struct node));
-        
-        new->data = d;
-        new->left = NULL;
-        new->right = NULL;
+        /* Day-Stout-Warren, rotate the tree into a vine and then back
+           into a balanced tree, all done in place. */
+        struct node root;
 
-        return new;
+        root.data = NULL;
+        root.left = NULL;
+        root.right = bt->root;
+
+        tree_to_vine(&root);
+        vine_to_tree(&root, btree_size(bt));
+        bt->root = root.right;
+        if (bt->root)
+        {
+                bt->root->parent = NULL;
+        }
+        if (bt->flags & BTREE_ORDER_STAT)
+        {
+                update_sizes(bt->root);
+        }
+
+        return 0;
 }
 
-void free_node(struct node* n)
+size_t btree_rank(const struct btree* bt, const void* d)
 {
-        free(n);
+        size_t r = 0;
+
+        if (bt->flags & BTREE_ORDER_STAT)
+        {
+                struct node* n = bt->root;
+
+                while (n)
+                {
+                        if (bt->cmp(n->data, d) < 0)
+                        {
+                                /* n->data < d, n and its left subtree
+                                   are of lower order */
+                                r += node_size(n->left) + 1;
+                                n = n->right;
+                        }
+                        else
+                        {
+                                n = n->left;
+                        }
+                }
+        }
+        else
+        {
+                struct btree_cursor cur;
+
+                for (void* e = btree_first(bt, &cur); 
+                     e && bt->cmp(e, d) < 0; 
+                     e = btree_next(&cur))
+                {
+                        r++;
+                }
+        }
+
+        return r;
 }
 
-static struct node* find_min(const struct node* n)
+void* btree_select(const struct btree* bt, size_t k)
 {
-        while (n->left)
+        if (k >= btree_size(bt))
         {
-                n = n->left;
+                return NULL;
         }
 
-        return (struct node*)n;
+        if (bt->flags & BTREE_ORDER_STAT)
+        {
+                struct node* n = bt->root;
+
+                for (;;)
+                {
+                        size_t l = node_size(n->left);
+
+                        if (k < l)
+                        {
+                                n = n->left;
+                        }
+                        else if (k == l)
+                        {
+                                return n->data;
+                        }
+                        else
+                        {
+                                k -= l + 1;
+                                n = n->right;
+                        }
+                }
+        }
+        else
+        {
+                struct btree_cursor cur;
+                void* e = btree_first(bt, &cur);
+
+                while (k-- > 0)
+                {
+                        e = btree_next(&cur);
+                }
+
+                return e;
+        }
 }
 
-static int cmp_wrap(const void* v1, const void* v2) 
+static struct node* alloc_node(struct btree* bt, void* d, struct node* parent)
 {
-        const void** a = (const void**)v1;
-        const void** b = (const void**)v2;
+        struct node_pool* p = bt->pool;
+        struct node* new;
+
+        if (p->free)
+        {
+                new = p->free;
+                p->free = new->right;
+                if (p->free == NULL)
+                {
+                        p->free_last = NULL;
+                }
+        }
+        else
+        {
+                if (p->slabs == NULL || p->slabs->used == p->slabs->cap)
+                {
+                        size_t cap = BTREE_SLAB_MIN;
+                        struct slab* s;
+
+                        if (p->slabs && p->slabs->cap < BTREE_SLAB_MAX)
+                        {
+                                cap = p->slabs->cap * 2;
+                        }
+                        else if (p->slabs)
+                        {
+                                cap = BTREE_SLAB_MAX;
+                        }
 
-        return cmp(*a, *b);
+                        s = malloc(sizeof(struct slab) +
+                                   cap * p->stride);
+                        if (s == NULL)
+                        {
+                                return NULL;
+                        }
+                        s->cap = cap;
+                        s->used = 0;
+                        s->next = p->slabs;
+                        p->slabs = s;
+                        if (p->last == NULL)
+                        {
+                                p->last = s;
+                        }
+                }
+                new = NODE_AT(p->slabs->nodes, p->slabs->used++,
+                              p->stride);
+        }
+
+        new->data = d;
+        new->left = NULL;
+        new->right = NULL;
+        new->parent = parent;
+        if (bt->flags & BTREE_ORDER_STAT)
+        {
+                new->size = 1;
+        }
+
+        return new;
+}
+
+static struct node* pool_alloc_nodes(struct node_pool* p, size_t cap)
+{
+        struct slab* s = malloc(sizeof(struct slab) + 
+                                cap * p->stride);
+
+        if (s == NULL)
+        {
+                return NULL;
+        }
+        s->cap = cap;
+        s->used = cap;
+        s->next = p->slabs;
+        p->slabs = s;
+        if (p->last == NULL)
+        {
+                p->last = s;
+        }
+
+        return s->nodes;
+}
+
+static struct btree* build_sorted(btree_cmp cmp, 
+                                  void** items, 
+                                  size_t n, 
+                                  unsigned int threads)
+{
+        struct btree* bt = btree_create(cmp);
+        struct build_arg arg;
+
+        if (bt == NULL || n == 0)
+        {
+                return bt;
+        }
+
+#ifndef NDEBUG
+        for (size_t i = 1; i < n; i++)
+        {
+                /* Items must be unique and in increasing order */
+                assert(cmp(items[i - 1], items[i]) < 0);
+        }
+#endif
+
+        arg.nodes = pool_alloc_nodes(bt->pool, n);
+        arg.stride = bt->pool->stride;
+        if (arg.nodes == NULL)
+        {
+                btree_destroy(bt);
+                return NULL;
+        }
+        arg.ptrs = NULL;
+        arg.items = items;
+        arg.beg = 0;
+        arg.end = n;
+        arg.parent = NULL;
+        arg.threads = threads;
+        arg.flags = bt->flags;
+        build_subtree(&arg);
+
+        bt->root = arg.root;
+        bt->len = n;
+
+        return bt;
+}
+
+static void* build_subtree(void* a)
+{
+        struct build_arg* arg = a;
+        struct build_arg left;
+        struct build_arg right;
+        size_t pivot = (arg->beg + arg->end) / 2;
+        struct node* n = arg->ptrs ? arg->ptrs[pivot] :
+                NODE_AT(arg->nodes, pivot, arg->stride);
+        pthread_t thr;
+        int spawned = 0;
+
+        if (arg->items)
+        {
+                n->data = arg->items[pivot];
+        }
+        n->parent = arg->parent;
+        if (arg->flags & BTREE_ORDER_STAT)
+        {
+                n->size = arg->end - arg->beg;
+        }
+        n->left = NULL;
+        n->right = NULL;
+
+        left.nodes = arg->nodes;
+        left.stride = arg->stride;
+        left.ptrs = arg->ptrs;
+        left.items = arg->items;
+        left.beg = arg->beg;
+        left.end = pivot;
+        left.parent = n;
+        left.threads = arg->threads / 2;
+        left.flags = arg->flags;
+        left.root = NULL;
+
+        right = left;
+        right.beg = pivot + 1;
+        right.end = arg->end;
+        right.threads = arg->threads - left.threads;
+        right.root = NULL;
+
+        if (left.beg < left.end)
+        {
+                /* Hand the left subtree to a new thread if there are
+                   threads left to use, the right subtree is built
+                   by the current thread. */
+                if (left.threads > 0 &&
+                    pthread_create(&thr, NULL, &build_subtree, &left) == 0)
+                {
+                        spawned = 1;
+                }
+                else
+                {
+                        left.threads = 0;
+                        build_subtree(&left);
+                }
+        }
+        if (right.beg < right.end)
+        {
+                build_subtree(&right);
+        }
+        if (spawned)
+        {
+                pthread_join(thr, NULL);
+        }
+
+        n->left = left.root;
+        n->right = right.root;
+        arg->root = n;
+
+        return NULL;
+}
+
+static void free_node(struct btree* bt, struct node* n)
+{
+        pool_free(bt->pool, n);
+}
+
+static void pool_free(struct node_pool* p, struct node* n)
+{
+        n->right = p->free;
+        p->free = n;
+        if (p->free_last == NULL)
+        {
+                p->free_last = n;
+        }
+}
+
+static int relocate(struct btree* bt, struct node_pool* old)
+{
+        struct build_arg arg;
+        struct node* nodes;
+        struct node* n;
+        size_t i = 0;
+
+        if (bt->len == 0)
+        {
+                return 0;
+        }
+        nodes = pool_alloc_nodes(bt->pool, bt->len);
+        if (nodes == NULL)
+        {
+                return -1;
+        }
+
+        for (n = flatten(bt->root); n; i++)
+        {
+                struct node* next = n->right;
+
+                NODE_AT(nodes, i, bt->pool->stride)->data = n->data;
+                pool_free(old, n);
+                n = next;
+        }
+
+        /* The copies are in order, keep their items */
+        arg.nodes = nodes;
+        arg.stride = bt->pool->stride;
+        arg.ptrs = NULL;
+        arg.items = NULL;
+        arg.beg = 0;
+        arg.end = bt->len;
+        arg.parent = NULL;
+        arg.threads = 0;
+        arg.flags = bt->flags;
+        build_subtree(&arg);
+        bt->root = arg.root;
+
+        return 0;
+}
+
+static void adopt(struct btree* dst, struct btree* src)
+{
+        struct node_pool* d = dst->pool;
+        struct node_pool* s = src->pool;
+
+        /* Append, so the slab nodes are handed out from stays first */
+        if (s->slabs)
+        {
+                if (d->last)
+                {
+                        d->last->next = s->slabs;
+                }
+                else
+                {
+                        d->slabs = s->slabs;
+                }
+                d->last = s->last;
+        }
+        if (s->free)
+        {
+                if (d->free_last)
+                {
+                        d->free_last->right = s->free;
+                }
+                else
+                {
+                        d->free = s->free;
+                }
+                d->free_last = s->free_last;
+        }
+
+        s->slabs = NULL;
+        s->last = NULL;
+        s->free = NULL;
+        s->free_last = NULL;
+}
+
+static void pool_release(struct node_pool* p)
+{
+        struct slab* s = p->slabs;
+
+        while (s)
+        {
+                struct slab* next = s->next;
+
+                free(s);
+                s = next;
+        }
+
+        p->slabs = NULL;
+        p->last = NULL;
+        p->free = NULL;
+        p->free_last = NULL;
+}
+
+static struct node* find_min(const struct node* n)
+{
+        while (n->left)
+        {
+                n = n->left;
+        }
+
+        return (struct node*)n;
+}
+
+static void freeze_fill(struct btree_frozen* fz, size_t k, struct node** n)
+{
+        if (k <= fz->len)
+        {
+                freeze_fill(fz, 2 * k, n);
+                fz->items[k] = (*n)->data;
+                *n = successor(*n);
+                freeze_fill(fz, 2 * k + 1, n);
+        }
+}
+
+static size_t frozen_search(const struct btree_frozen* fz, const void* d)
+{
+        void** items = fz->items;
+        size_t len = fz->len;
+        size_t k = 1;
+
+        while (k <= len)
+        {
+                /* Fetch the descendants a few levels down while the
+                   current level is compared */
+                PREFETCH(items + k * FROZEN_BLOCK);
+                /* Left if items[k] >= d, right otherwise, the choice is
+                   computed rather than branched on */
+                k = 2 * k + (fz->cmp(items[k], d) < 0);
+        }
+
+        /* The last left turn is the lower bound, undo all right turns
+           and then the left turn */
+        while (k & 1)
+        {
+                k >>= 1;
+        }
+        k >>= 1;
+
+        return k;
+}
+
+static struct node* find_max(const struct node* n)
+{
+        while (n->right)
+        {
+                n = n->right;
+        }
+
+        return (struct node*)n;
+}
+
+static struct node* successor(const struct node* n)
+{
+        const struct node* p;
+
+        if (n->right)
+        {
+                return find_min(n->right);
+        }
+
+        /* Climb until we arrive from a left subtree */
+        p = n->parent;
+        while (p && n == p->right)
+        {
+                n = p;
+                p = p->parent;
+        }
+
+        return (struct node*)p;
+}
+
+static struct node* predecessor(const struct node* n)
+{
+        const struct node* p;
+
+        if (n->left)
+        {
+                return find_max(n->left);
+        }
+
+        /* Climb until we arrive from a right subtree */
+        p = n->parent;
+        while (p && n == p->left)
+        {
+                n = p;
+                p = p->parent;
+        }
+
+        return (struct node*)p;
+}
+
+static void add_size(struct node* n, size_t v)
+{
+        /* Unsigned wrap around is used to subtract */
+        while (n)
+        {
+                n->size += v;
+                n = n->parent;
+        }
+}
+
+static void update_sizes(struct node* root)
+{
+        struct node* n = root;
+
+        if (n == NULL)
+        {
+                return;
+        }
+
+        /* Descend to the first node in post order */
+        while (n->left || n->right)
+        {
+                n = n->left ? n->left : n->right;
+        }
+
+        for (;;)
+        {
+                struct node* p;
+
+                n->size = node_size(n->left) + node_size(n->right) + 1;
+                if (n == root)
+                {
+                        break;
+                }
+
+                p = n->parent;
+                if (n == p->left && p->right)
+                {
+                        /* Continue with the right sibling's subtree */
+                        n = p->right;
+                        while (n->left || n->right)
+                        {
+                                n = n->left ? n->left : n->right;
+                        }
+                }
+                else
+                {
+                        n = p;
+                }
+        }
+}
+
+static size_t node_size(const struct node* n)
+{
+        return n ? n->size : 0;
+}
+
+static void tree_to_vine(struct node* root)
+{
+        struct node* tail = root;
+        struct node* rest = tail->right;
+
+        while (rest)
+        {
+                if (rest->left == NULL)
+                {
+                        tail = rest;
+                        rest = rest->right;
+                }
+                else
+                {
+                        /* Rotate right */
+                        struct node* tmp = rest->left;
+
+                        rest->left = tmp->right;
+                        if (rest->left)
+                        {
+                                rest->left->parent = rest;
+                        }
+                        tmp->right = rest;
+                        rest->parent = tmp;
+                        rest = tmp;
+                        tail->right = tmp;
+                        tmp->parent = tail;
+                }
+        }
+}
+
+static void vine_to_tree(struct node* root, size_t size)
+{
+        size_t full = 1;
+        size_t leaves;
+
+        /* Largest complete tree that fits in size nodes */
+        while (full <= size + 1)
+        {
+                full *= 2;
+        }
+        full /= 2;
+
+        /* Put the overflowing nodes in the bottom level */
+        leaves = size + 1 - full;
+        compress(root, leaves);
+
+        size -= leaves;
+        while (size > 1)
+        {
+                size /= 2;
+                compress(root, size);
+        }
+}
+
+static void compress(struct node* root, size_t count)
+{
+        struct node* scanner = root;
+
+        for (size_t i = 0; i < count; i++)
+        {
+                /* Rotate left */
+                struct node* child = scanner->right;
+
+                scanner->right = child->right;
+                scanner->right->parent = scanner;
+                scanner = scanner->right;
+                child->right = scanner->left;
+                if (child->right)
+                {
+                        child->right->parent = child;
+                }
+                scanner->left = child;
+                child->parent = scanner;
+        }
+}
+
+static int walk(const struct node* root,
+                int order,
+                size_t level,
+                btree_visit fn,
+                void* arg)
+{
+        const struct node* n = root;
+        const struct node* prev = root ? root->parent : NULL;
+        size_t depth = 0;
+        int r;
+
+        while (n)
+        {
+                const struct node* next;
+                const struct node* left = depth < level ? n->left : NULL;
+                const struct node* right = depth < level ? n->right : NULL;
+                int visit = level == (size_t)-1 || depth == level;
+                /* 0: arrived from above, 1: from left, 2: from right */
+                int from;
+
+                if (prev == n->parent)
+                {
+                        from = 0;
+                }
+                else if (prev == n->left)
+                {
+                        from = 1;
+                }
+                else
+                {
+                        from = 2;
+                }
+
+                /* Visit when the traversal passes the node's position in
+                   the chosen order, missing children are skipped over */
+                next = n->parent;
+                if (from == 0 && order == BTREE_PRE_ORDER && visit)
+                {
+                        if ((r = fn(n->data, arg)) != 0)
+                        {
+                                return r;
+                        }
+                }
+                if (from == 0 && left)
+                {
+                        next = left;
+                }
+                else
+                {
+                        if (from < 2 && order == BTREE_IN_ORDER && visit)
+                        {
+                                if ((r = fn(n->data, arg)) != 0)
+                                {
+                                        return r;
+                                }
+                        }
+                        if (from < 2 && right)
+                        {
+                                next = right;
+                        }
+                        else if (order == BTREE_POST_ORDER && visit)
+                        {
+                                if ((r = fn(n->data, arg)) != 0)
+                                {
+                                        return r;
+                                }
+                        }
+                }
+
+                if (n == root && next == n->parent)
+                {
+                        break;
+                }
+                if (next == n->parent)
+                {
+                        depth--;
+                }
+                else
+                {
+                        depth++;
+                }
+                prev = n;
+                n = next;
+        }
+
+        return 0;
+}
+
+static int collect(void* d, void* arg)
+{
+        void*** p = arg;
+
+        *(*p)++ = d;
+
+        return 0;
+}
+
+static int count_level(void* d, void* arg)
+{
+        struct bf_level* l = arg;
+
+        l->count++;
+
+        return l->fn(d, l->arg);
+}
+
+static struct node* flatten(struct node* n)
+{
+        struct node root;
+
+        root.right = n;
+        tree_to_vine(&root);
+
+        return root.right;
+}
+
+static void rebuild(struct btree* bt, struct node* vine, size_t len)
+{
+        struct node root;
+        struct node* prev = &root;
+
+        /* Restore the parent pointers along the vine */
+        root.left = NULL;
+        root.right = vine;
+        for (struct node* n = vine; n; n = n->right)
+        {
+                n->left = NULL;
+                n->parent = prev;
+                prev = n;
+        }
+
+        vine_to_tree(&root, len);
+        bt->root = root.right;
+        if (bt->root)
+        {
+                bt->root->parent = NULL;
+        }
+        if (bt->flags & BTREE_ORDER_STAT)
+        {
+                update_sizes(bt->root);
+        }
+}
+
+static size_t make_tasks(const struct node* n,
+                         unsigned int depth,
+                         struct par_task* out)
+{
+        size_t k = 0;
+
+        if (n == NULL)
+        {
+                return 0;
+        }
+        if (depth == 0)
+        {
+                out[0].root = n;
+                out[0].single = 0;
+                return 1;
+        }
+
+        /* Recursion depth is bounded by depth */
+        k += make_tasks(n->left, depth - 1, out);
+        out[k].root = n;
+        out[k].single = 1;
+        k++;
+        k += make_tasks(n->right, depth - 1, out + k);
+
+        return k;
+}
+
+static void par_run(struct par_ctx* ctx, unsigned int threads)
+{
+        pthread_t* thr;
+        unsigned int started = 0;
+
+        if (threads > ctx->ntasks)
+        {
+                threads = (unsigned int)ctx->ntasks;
+        }
+        /* The calling thread is one of the workers */
+        thr = threads > 1 ? malloc((threads - 1) * sizeof(pthread_t)) : NULL;
+        if (thr)
+        {
+                while (started < threads - 1 &&
+                       pthread_create(&thr[started], NULL, &par_worker, ctx) == 0)
+                {
+                        started++;
+                }
+        }
+        par_worker(ctx);
+        for (unsigned int i = 0; i < started; i++)
+        {
+                pthread_join(thr[i], NULL);
+        }
+        free(thr);
+}
+
+static void* par_worker(void* a)
+{
+        struct par_ctx* ctx = a;
+        size_t i;
+
+        /* Threads that finish early take more tasks */
+        while ((i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED)) <
+               ctx->ntasks)
+        {
+                ctx->run(ctx, &ctx->tasks[i]);
+        }
+
+        return NULL;
+}
+
+static void task_fold(struct par_ctx* ctx, struct par_task* t)
+{
+        const struct node* n;
+        const struct node* end;
+
+        if (t->single)
+        {
+                t->acc = ctx->fold(t->acc, t->root->data, ctx->arg);
+                return;
+        }
+
+        /* In order from the min node, until the successor leaves the
+           subtree */
+        end = successor(find_max(t->root));
+        for (n = find_min(t->root); n != end; n = successor(n))
+        {
+                t->acc = ctx->fold(t->acc, n->data, ctx->arg);
+        }
+}
+
+static void task_count(struct par_ctx* ctx, struct par_task* t)
+{
+        const struct node* end;
+        size_t count = 0;
+
+        (void)ctx;
+        if (t->single)
+        {
+                t->count = 1;
+                return;
+        }
+        end = successor(find_max(t->root));
+        for (const struct node* n = find_min(t->root); n != end; n = successor(n))
+        {
+                count++;
+        }
+        t->count = count;
+}
+
+static void task_collect(struct par_ctx* ctx, struct par_task* t)
+{
+        const struct node* n = t->single ? t->root : find_min(t->root);
+        struct node** out = ctx->ptrs + t->offset;
+
+        for (size_t i = 0; i < t->count; i++)
+        {
+                out[i] = (struct node*)n;
+                n = successor(n);
+        }
 }
@@ -17,6 +17,21 @@
 #include <stddef.h>
 
 struct btree;
+struct btree_frozen;
+
+/* Maintain subtree sizes, btree_rank and btree_select run in O(log n) */
+#define BTREE_ORDER_STAT 0x1
+
+/**
+ * Cursor for ordered traversal of a tree. A cursor is positioned by
+ * btree_first, btree_last, btree_lower_bound or btree_upper_bound, and
+ * moved with btree_next and btree_prev. No memory is allocated.
+ * A cursor is invalidated by any modification of the tree.
+ */
+struct btree_cursor
+{
+        const void* pos;
+};
 
 /*
  * No methods are thread safe, external locking is required.
@@ -34,6 +49,37 @@ struct btree;
  */
 typedef int (*btree_cmp)(const void* a, const void* b);
 
+/* Orders for btree_walk */
+#define BTREE_PRE_ORDER  0
+#define BTREE_IN_ORDER   1
+#define BTREE_POST_ORDER 2
+
+/**
+ * Visitor method for traversals.
+ * @param the item.
+ * @param the user provided argument.
+ * @return 0 to continue the traversal, non zero to stop.
+ */
+typedef int (*btree_visit)(void*, void*);
+
+/**
+ * Fold an item into an accumulated value.
+ * @param the accumulated value.
+ * @param the item.
+ * @param the user provided argument.
+ * @return the new accumulated value.
+ */
+typedef void* (*btree_fold)(void*, void*, void*);
+
+/**
+ * Combine the accumulated values of two adjacent ranges of items.
+ * @param the value of the range with lower order.
+ * @param the value of the range with higher order.
+ * @param the user provided argument.
+ * @return the combined value.
+ */
+typedef void* (*btree_combine)(void*, void*, void*);
+
 /**
  * Create a binary tree with inital provided capacity.
  * @param the compare method to use.
@@ -41,8 +87,45 @@ typedef int (*btree_cmp)(const void* a, const void* b);
  */
 extern struct btree* btree_create(btree_cmp);
 
+/**
+ * Create a binary tree with the provided flags.
+ * The subtree size is only stored in the nodes of trees created with
+ * BTREE_ORDER_STAT, other trees don't pay for it in memory.
+ * @param the compare method to use.
+ * @param flags, BTREE_ORDER_STAT or 0.
+ * @return a binary tree, or NULL on failure.
+ */
+extern struct btree* btree_create_flags(btree_cmp, unsigned int);
+
+/**
+ * Create a perfectly balanced tree from an array of items in O(n).
+ * The items must be unique and sorted in increasing order according to
+ * the compare method. All nodes are allocated in one contiguous block.
+ * @param the compare method to use.
+ * @param the sorted items.
+ * @param the number of items.
+ * @return a binary tree, or NULL on failure.
+ */
+extern struct btree* btree_build_sorted(btree_cmp, void**, size_t);
+
+/**
+ * Same as btree_build_sorted, but subtrees are built in parallel using
+ * up to the provided number of threads.
+ * @param the compare method to use.
+ * @param the sorted items.
+ * @param the number of items.
+ * @param max number of threads to use.
+ * @return a binary tree, or NULL on failure.
+ */
+extern struct btree* btree_build_sorted_mt(btree_cmp, 
+                                           void**, 
+                                           size_t, 
+                                           unsigned int);
+
 /**
  * Removed all items in the tree.
+ * Nodes are allocated from a per tree pool, so clearing the tree releases
+ * the pool in bulk rather than visiting each node.
  * @param the tree to clear.
  * @return void.
  */
@@ -61,7 +144,7 @@ extern void btree_destroy(struct btree*);
  * new value.
  * @param the tree to insert the item too.
  * @param the item to insert.
- * @return 0 on success.
+ * @return 0 on success, -1 if no memory could be allocated.
  */
 extern int btree_insert(struct btree*, void*);
 
@@ -73,6 +156,19 @@ extern int btree_insert(struct btree*, void*);
  */
 extern void* btree_find(const struct btree*, const void*);
 
+/**
+ * Search for many items in the tree.
+ * The searches are interleaved, so the memory loads of one search
+ * overlap with the compares of the others. This is faster than repeated
+ * calls to btree_find when the tree does not fit in the cache.
+ * @param the tree to search in.
+ * @param the items to look for.
+ * @param the number of items.
+ * @param array of the same size, set to the found item or NULL.
+ * @return the number of items found.
+ */
+extern size_t btree_find_batch(const struct btree*, void**, size_t, void**);
+
 /**
  * Remove an item from the tree
  * @param the tree to update.
@@ -81,6 +177,63 @@ extern void* btree_find(const struct btree*, const void*);
  */
 extern void* btree_remove(struct btree*, const void*);
 
+/**
+ * Position a cursor at the item with the lowest order.
+ * @param the tree.
+ * @param the cursor to position, may be NULL.
+ * @return the item, or NULL if the tree is empty.
+ */
+extern void* btree_first(const struct btree*, struct btree_cursor*);
+
+/**
+ * Position a cursor at the item with the highest order.
+ * @param the tree.
+ * @param the cursor to position, may be NULL.
+ * @return the item, or NULL if the tree is empty.
+ */
+extern void* btree_last(const struct btree*, struct btree_cursor*);
+
+/**
+ * Find the first item in the tree with the same or higher order than
+ * the provided item, and position a cursor at it.
+ * The items in the range [a, b) are visited by starting with
+ * btree_lower_bound(bt, a, &cur) and calling btree_next(&cur) until an
+ * item with the same or higher order than b is returned.
+ * @param the tree to search in.
+ * @param the item to compare with.
+ * @param the cursor to position, may be NULL.
+ * @return the item, or NULL if no such item exists.
+ */
+extern void* btree_lower_bound(const struct btree*, 
+                               const void*, 
+                               struct btree_cursor*);
+
+/**
+ * Find the first item in the tree with higher order than the provided
+ * item, and position a cursor at it.
+ * @param the tree to search in.
+ * @param the item to compare with.
+ * @param the cursor to position, may be NULL.
+ * @return the item, or NULL if no such item exists.
+ */
+extern void* btree_upper_bound(const struct btree*, 
+                               const void*, 
+                               struct btree_cursor*);
+
+/**
+ * Move the cursor to the next item in order.
+ * @param the cursor.
+ * @return the next item, or NULL if the end of the tree is reached.
+ */
+extern void* btree_next(struct btree_cursor*);
+
+/**
+ * Move the cursor to the previous item in order.
+ * @param the cursor.
+ * @return the previous item, or NULL if the start of the tree is reached.
+ */
+extern void* btree_prev(struct btree_cursor*);
+
 /**
  * Perform a breadth first traversal of the tree.
  * The returned list will be allocated on the heap. It is up to the caller
@@ -100,7 +253,34 @@ extern void** btree_bf(const struct btree*);
 extern void** btree_df(const struct btree*);
 
 /**
- * Return the height of the tree.
+ * Visit all items depth first, in pre, in or post order.
+ * No memory is allocated. The tree must not be modified by the visitor.
+ * @param the tree to traverse.
+ * @param BTREE_PRE_ORDER, BTREE_IN_ORDER or BTREE_POST_ORDER.
+ * @param the visitor.
+ * @param argument passed to the visitor.
+ * @return 0 if all items were visited, the visitor's return value if
+ *         the traversal was stopped.
+ */
+extern int btree_walk(const struct btree*, int, btree_visit, void*);
+
+/**
+ * Visit all items breadth first, i.e level by level.
+ * No memory is allocated, each level is reached by a new depth first
+ * descent, so the running time is O(n * log n) for a balanced tree but
+ * O(n * h) in the worst case, i.e O(n^2) for a degenerate tree. Use
+ * btree_bf when the tree may be unbalanced.
+ * The tree must not be modified by the visitor.
+ * @param the tree to traverse.
+ * @param the visitor.
+ * @param argument passed to the visitor.
+ * @return 0 if all items were visited, the visitor's return value if
+ *         the traversal was stopped.
+ */
+extern int btree_walk_bf(const struct btree*, btree_visit, void*);
+
+/**
+ * Return the height of the tree. No memory is allocated.
  * @param the tree to calculate the heigth for.
  * @return the height of the tree, -1 if an error occured.
  */
@@ -113,11 +293,142 @@ extern unsigned int btree_height(const struct btree*);
  */
 extern size_t btree_size(const struct btree*);
 
+/**
+ * Split a tree in two. The nodes on the search path for the item are
+ * relinked, then the smaller of the two trees is copied to a node pool
+ * of its own and rebuilt balanced, so the cost is O(height + min(n, m)).
+ * The two trees are independent and may be used from different threads.
+ * @param the tree to split, keeps the items with lower order than the
+ *        provided item.
+ * @param the item to split at.
+ * @return a new tree with all items with the same or higher order than
+ *         the provided item, or NULL if no memory could be allocated.
+ */
+extern struct btree* btree_split(struct btree*, const void*);
+
+/**
+ * Move all items of b into a, where all items in a have lower order
+ * than the items in b. The max item of a becomes the new root, so the
+ * cost is O(height) and the height grows by at most one.
+ * Both trees must be created with the same compare method and flags.
+ * @param the tree to join into.
+ * @param the tree to empty, it must still be destroyed by the caller.
+ * @return 0 on success, -1 if the compare methods or flags differ.
+ */
+extern int btree_join(struct btree*, struct btree*);
+
+/**
+ * Move all items of b into a, the items may interleave in any order.
+ * The nodes of both trees are flattened into sorted lists, merged and
+ * rebuilt into a balanced tree in O(n + m) without allocating memory.
+ * If the same item is present in both trees, the item from b is kept.
+ * Both trees must be created with the same compare method and flags.
+ * @param the tree to merge into.
+ * @param the tree to empty, it must still be destroyed by the caller.
+ * @return 0 on success, -1 if the compare methods or flags differ.
+ */
+extern int btree_merge(struct btree*, struct btree*);
+
+/**
+ * Fold all items in order, using multiple threads.
+ * The tree is cut into many subtrees that threads take from a shared
+ * queue, and each subtree is folded starting from the initial value.
+ * The results are then combined in order, so combine must be
+ * associative and the initial value must be its identity. Speedup
+ * requires a reasonably balanced tree.
+ * Fold and combine may be called concurrently from different threads.
+ * @param the tree.
+ * @param max number of threads to use.
+ * @param the initial value.
+ * @param the fold method.
+ * @param the combine method.
+ * @param argument passed to fold and combine.
+ * @return the result, the initial value for an empty tree.
+ */
+extern void* btree_par_fold(const struct btree*, unsigned int, void*,
+                            btree_fold, btree_combine, void*);
+
+/**
+ * Same as btree_balance, but the nodes are collected in order and the
+ * balanced tree is built by multiple threads.
+ * Unlike btree_balance, an array of n pointers is allocated.
+ * @param the tree to balance.
+ * @param max number of threads to use.
+ * @return 0 if successful, -1 if no memory could be allocated.
+ */
+extern int btree_balance_mt(struct btree*, unsigned int);
+
 /**
  * Balance the tree.
+ * The tree is rebalanced in place by rotations, with constant extra
+ * memory and without allocating or freeing any nodes.
  * @param the tree to balance.
  * @return 0 if successful
  */
 extern int btree_balance(struct btree*);
 
+/**
+ * Return the number of items in the tree with lower order than the
+ * provided item.
+ * Runs in O(log n) for balanced trees created with BTREE_ORDER_STAT,
+ * and in O(n) otherwise.
+ * @param the tree.
+ * @param the item to compare with.
+ * @return the rank of the item.
+ */
+extern size_t btree_rank(const struct btree*, const void*);
+
+/**
+ * Return the k-th item in order, starting from 0.
+ * Runs in O(log n) for balanced trees created with BTREE_ORDER_STAT,
+ * and in O(n) otherwise.
+ * @param the tree.
+ * @param k.
+ * @return the item, or NULL if k is not less than the size of the tree.
+ */
+extern void* btree_select(const struct btree*, size_t);
+
+/**
+ * Create an immutable copy of the tree, optimized for lookups.
+ * The items are stored in one array in Eytzinger (breadth first) order
+ * of a complete tree, searches use no branches on the comparison and
+ * prefetch descendants ahead of the current level.
+ * The items are not copied, only the pointers to them.
+ * @param the tree to freeze.
+ * @return the frozen tree, or NULL on failure.
+ */
+extern struct btree_frozen* btree_freeze(const struct btree*);
+
+/**
+ * Search for an item in a frozen tree.
+ * @param the frozen tree to search in.
+ * @param the item to look for.
+ * @return the item, or NULL if not found.
+ */
+extern void* btree_frozen_find(const struct btree_frozen*, const void*);
+
+/**
+ * Find the first item in a frozen tree with the same or higher order
+ * than the provided item.
+ * @param the frozen tree to search in.
+ * @param the item to compare with.
+ * @return the item, or NULL if no such item exists.
+ */
+extern void* btree_frozen_lower_bound(const struct btree_frozen*, 
+                                      const void*);
+
+/**
+ * Return the number of items in a frozen tree.
+ * @param the frozen tree.
+ * @return the number of items.
+ */
+extern size_t btree_frozen_size(const struct btree_frozen*);
+
+/**
+ * Destroy a frozen tree. The tree it was created from is not affected.
+ * @param the frozen tree to destroy.
+ * @return void.
+ */
+extern void btree_frozen_destroy(struct btree_frozen*);
+
 #endif /* __BTREE_H__ */
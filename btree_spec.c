@@ -0,0 +1,18 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include "btree_spec.h"
+
+BTREE_SPEC_DEFINE(btree_i64, int64_t, BTREE_SPEC_LESS);
+BTREE_SPEC_DEFINE(btree_f64, double, BTREE_SPEC_LESS);
+BTREE_SPEC_DEFINE(btree_id16, struct btree_id, BTREE_ID_LESS);
@@ -0,0 +1,350 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#ifndef __BTREE_SPEC_H__
+#define __BTREE_SPEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Binary trees specialized for a fixed size key type.
+ * The key is stored inline in the node and compared with a macro, so a
+ * search neither calls through a function pointer nor loads the item to
+ * compare it. Each key maps to a data pointer.
+ *
+ * A specialization is declared with BTREE_SPEC_DECLARE(name, key_t) and
+ * defined, in one translation unit, with
+ * BTREE_SPEC_DEFINE(name, key_t, less) where less(a, b) is an expression
+ * that is true if key a has lower order than key b. This creates:
+ *
+ * struct name* name_create(void);
+ * void name_destroy(struct name*);
+ * int name_insert(struct name*, key_t, void*);
+ * void* name_find(const struct name*, key_t);
+ * void* name_remove(struct name*, key_t);
+ * size_t name_size(const struct name*);
+ * int name_balance(struct name*);
+ *
+ * with the same semantics as the corresponding btree methods. Nodes are
+ * allocated from a per tree slab pool.
+ * As for btree, the tree is not self balancing, name_balance rebuilds it
+ * in place with the Day-Stout-Warren algorithm.
+ *
+ * No methods are thread safe, external locking is required.
+ */
+
+#define BTREE_SPEC_LESS(a, b) ((a) < (b))
+
+/* Number of nodes in a slab of a specialized tree */
+#define BTREE_SPEC_SLAB 256
+
+#define BTREE_SPEC_DECLARE(name, key_t)                                 \
+        struct name;                                                    \
+        extern struct name* name##_create(void);                        \
+        extern void name##_destroy(struct name*);                       \
+        extern int name##_insert(struct name*, key_t, void*);           \
+        extern void* name##_find(const struct name*, key_t);            \
+        extern void* name##_remove(struct name*, key_t);                \
+        extern size_t name##_size(const struct name*);                  \
+        extern int name##_balance(struct name*)
+
+#define BTREE_SPEC_DEFINE(name, key_t, less)                            \
+        struct name##_node                                              \
+        {                                                               \
+                key_t key;                                              \
+                void* data;                                             \
+                struct name##_node* left;                               \
+                struct name##_node* right;                              \
+        };                                                              \
+                                                                        \
+        struct name##_slab                                              \
+        {                                                               \
+                struct name##_slab* next;                               \
+                size_t used;                                            \
+                struct name##_node nodes[BTREE_SPEC_SLAB];              \
+        };                                                              \
+                                                                        \
+        struct name                                                     \
+        {                                                               \
+                struct name##_node* root;                               \
+                size_t len;                                             \
+                struct name##_slab* slabs;                              \
+                /* Linked through the right pointer */                  \
+                struct name##_node* free;                               \
+        };                                                              \
+                                                                        \
+        struct name* name##_create(void)                                \
+        {                                                               \
+                struct name* t = malloc(sizeof(struct name));           \
+                                                                        \
+                if (t == NULL)                                          \
+                {                                                       \
+                        return NULL;                                    \
+                }                                                       \
+                t->root = NULL;                                         \
+                t->len = 0;                                             \
+                t->slabs = NULL;                                        \
+                t->free = NULL;                                         \
+                                                                        \
+                return t;                                               \
+        }                                                               \
+                                                                        \
+        void name##_destroy(struct name* t)                             \
+        {                                                               \
+                struct name##_slab* s = t->slabs;                       \
+                                                                        \
+                while (s)                                               \
+                {                                                       \
+                        struct name##_slab* next = s->next;             \
+                                                                        \
+                        free(s);                                        \
+                        s = next;                                       \
+                }                                                       \
+                free(t);                                                \
+        }                                                               \
+                                                                        \
+        int name##_insert(struct name* t, key_t k, void* d)             \
+        {                                                               \
+                struct name##_node** p = &t->root;                      \
+                struct name##_node* n;                                  \
+                                                                        \
+                while (*p)                                              \
+                {                                                       \
+                        n = *p;                                         \
+                        if (less(k, n->key))                            \
+                        {                                               \
+                                p = &n->left;                           \
+                        }                                               \
+                        else if (less(n->key, k))                       \
+                        {                                               \
+                                p = &n->right;                          \
+                        }                                               \
+                        else                                            \
+                        {                                               \
+                                /* Replace */                           \
+                                n->data = d;                            \
+                                return 0;                               \
+                        }                                               \
+                }                                                       \
+                                                                        \
+                if (t->free)                                            \
+                {                                                       \
+                        n = t->free;                                    \
+                        t->free = n->right;                             \
+                }                                                       \
+                else                                                    \
+                {                                                       \
+                        if (t->slabs == NULL ||                         \
+                            t->slabs->used == BTREE_SPEC_SLAB)          \
+                        {                                               \
+                                struct name##_slab* s;                  \
+                                                                        \
+                                s = malloc(sizeof(struct name##_slab)); \
+                                if (s == NULL)                          \
+                                {                                       \
+                                        return -1;                      \
+                                }                                       \
+                                s->used = 0;                            \
+                                s->next = t->slabs;                     \
+                                t->slabs = s;                           \
+                        }                                               \
+                        n = &t->slabs->nodes[t->slabs->used++];         \
+                }                                                       \
+                                                                        \
+                n->key = k;                                             \
+                n->data = d;                                            \
+                n->left = NULL;                                         \
+                n->right = NULL;                                        \
+                *p = n;                                                 \
+                t->len++;                                               \
+                                                                        \
+                return 0;                                               \
+        }                                                               \
+                                                                        \
+        void* name##_find(const struct name* t, key_t k)                \
+        {                                                               \
+                const struct name##_node* n = t->root;                  \
+                                                                        \
+                while (n)                                               \
+                {                                                       \
+                        if (less(k, n->key))                            \
+                        {                                               \
+                                n = n->left;                            \
+                        }                                               \
+                        else if (less(n->key, k))                       \
+                        {                                               \
+                                n = n->right;                           \
+                        }                                               \
+                        else                                            \
+                        {                                               \
+                                return n->data;                         \
+                        }                                               \
+                }                                                       \
+                                                                        \
+                return NULL;                                            \
+        }                                                               \
+                                                                        \
+        void* name##_remove(struct name* t, key_t k)                    \
+        {                                                               \
+                struct name##_node** p = &t->root;                      \
+                struct name##_node* n;                                  \
+                void* ret;                                              \
+                                                                        \
+                for (;;)                                                \
+                {                                                       \
+                        n = *p;                                         \
+                        if (n == NULL)                                  \
+                        {                                               \
+                                return NULL;                            \
+                        }                                               \
+                        if (less(k, n->key))                            \
+                        {                                               \
+                                p = &n->left;                           \
+                        }                                               \
+                        else if (less(n->key, k))                       \
+                        {                                               \
+                                p = &n->right;                          \
+                        }                                               \
+                        else                                            \
+                        {                                               \
+                                break;                                  \
+                        }                                               \
+                }                                                       \
+                                                                        \
+                ret = n->data;                                          \
+                if (n->left == NULL)                                    \
+                {                                                       \
+                        *p = n->right;                                  \
+                }                                                       \
+                else if (n->right == NULL)                              \
+                {                                                       \
+                        *p = n->left;                                   \
+                }                                                       \
+                else                                                    \
+                {                                                       \
+                        /* Move the successor's key into n */           \
+                        struct name##_node** s = &n->right;             \
+                                                                        \
+                        while ((*s)->left)                              \
+                        {                                               \
+                                s = &(*s)->left;                        \
+                        }                                               \
+                        n->key = (*s)->key;                             \
+                        n->data = (*s)->data;                           \
+                        p = s;                                          \
+                        n = *s;                                         \
+                        *p = n->right;                                  \
+                }                                                       \
+                n->right = t->free;                                     \
+                t->free = n;                                            \
+                t->len--;                                               \
+                                                                        \
+                return ret;                                             \
+        }                                                               \
+                                                                        \
+        size_t name##_size(const struct name* t)                        \
+        {                                                               \
+                return t->len;                                          \
+        }                                                               \
+                                                                        \
+        static void name##_compress(struct name##_node* root,           \
+                                    size_t count)                       \
+        {                                                               \
+                struct name##_node* scanner = root;                     \
+                                                                        \
+                for (size_t i = 0; i < count; i++)                      \
+                {                                                       \
+                        /* Rotate left */                               \
+                        struct name##_node* child = scanner->right;     \
+                                                                        \
+                        scanner->right = child->right;                  \
+                        scanner = scanner->right;                       \
+                        child->right = scanner->left;                   \
+                        scanner->left = child;                          \
+                }                                                       \
+        }                                                               \
+                                                                        \
+        int name##_balance(struct name* t)                              \
+        {                                                               \
+                struct name##_node root;                                \
+                struct name##_node* tail = &root;                       \
+                struct name##_node* rest = t->root;                     \
+                size_t size = t->len;                                   \
+                size_t full = 1;                                        \
+                size_t leaves;                                          \
+                                                                        \
+                /* Tree to vine, rotate right until no left child */    \
+                root.right = t->root;                                   \
+                while (rest)                                            \
+                {                                                       \
+                        if (rest->left == NULL)                         \
+                        {                                               \
+                                tail = rest;                            \
+                                rest = rest->right;                     \
+                        }                                               \
+                        else                                            \
+                        {                                               \
+                                struct name##_node* tmp = rest->left;   \
+                                                                        \
+                                rest->left = tmp->right;                \
+                                tmp->right = rest;                      \
+                                rest = tmp;                             \
+                                tail->right = tmp;                      \
+                        }                                               \
+                }                                                       \
+                                                                        \
+                /* Largest complete tree that fits in size nodes */     \
+                while (full <= size + 1)                                \
+                {                                                       \
+                        full *= 2;                                      \
+                }                                                       \
+                full /= 2;                                              \
+                                                                        \
+                /* Put the overflowing nodes in the bottom level */     \
+                leaves = size + 1 - full;                               \
+                name##_compress(&root, leaves);                         \
+                size -= leaves;                                         \
+                while (size > 1)                                        \
+                {                                                       \
+                        size /= 2;                                      \
+                        name##_compress(&root, size);                   \
+                }                                                       \
+                t->root = root.right;                                   \
+                                                                        \
+                return 0;                                               \
+        }                                                               \
+                                                                        \
+        struct name##_unused
+
+/**
+ * 16 byte identifier, e.g a UUID, ordered by hi and then lo.
+ */
+struct btree_id
+{
+        uint64_t hi;
+        uint64_t lo;
+};
+
+#define BTREE_ID_LESS(a, b) ((a).hi < (b).hi ||                        \
+                             ((a).hi == (b).hi && (a).lo < (b).lo))
+
+/* Specializations provided by the library */
+BTREE_SPEC_DECLARE(btree_i64, int64_t);
+/* Keys must not be NaN, a NaN is neither less nor greater than any key
+   and so would match whatever key it is compared with first */
+BTREE_SPEC_DECLARE(btree_f64, double);
+BTREE_SPEC_DECLARE(btree_id16, struct btree_id);
+
+#endif /* __BTREE_SPEC_H__ */
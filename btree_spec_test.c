@@ -0,0 +1,241 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <scut.h>
+#include "btree_spec.h"
+
+static int test_bts_i64(void);
+static int test_bts_f64(void);
+static int test_bts_id(void);
+static int test_bts_user(void);
+static int test_bts_balance(void);
+
+/* A specialization local to this file, ordered by decreasing key */
+#define DESC(a, b) ((a) > (b))
+BTREE_SPEC_DECLARE(desc_tree, unsigned int);
+BTREE_SPEC_DEFINE(desc_tree, unsigned int, DESC);
+
+static unsigned int desc_height(const struct desc_tree_node*);
+
+int test_btree_spec(void)
+{
+        int ret;
+
+        scut_create("Test specialized binary tree");
+
+        SCUT_ADD(test_bts_i64);
+        SCUT_ADD(test_bts_f64);
+        SCUT_ADD(test_bts_id);
+        SCUT_ADD(test_bts_user);
+        SCUT_ADD(test_bts_balance);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+static int test_bts_i64(void)
+{
+        struct btree_i64* t = btree_i64_create();
+        long size = 1000;
+
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_FALSE(btree_i64_find(t, 1));
+        SCUT_ASSERT_FALSE(btree_i64_remove(t, 1));
+
+        for (long i = 0; i < size; i++)
+        {
+                int64_t k = ((i * 7919) % size) - size / 2;
+
+                SCUT_ASSERT_IE(btree_i64_insert(t, k, (void*)(i + 1)), 0);
+        }
+        SCUT_ASSERT_IE(btree_i64_size(t), size);
+        for (long i = 0; i < size; i++)
+        {
+                int64_t k = ((i * 7919) % size) - size / 2;
+
+                SCUT_ASSERT_IE(btree_i64_find(t, k), i + 1);
+        }
+        SCUT_ASSERT_FALSE(btree_i64_find(t, size));
+
+        /* Replace */
+        SCUT_ASSERT_IE(btree_i64_insert(t, 0, (void*)4711l), 0);
+        SCUT_ASSERT_IE(btree_i64_size(t), size);
+        SCUT_ASSERT_IE(btree_i64_find(t, 0), 4711);
+
+        for (int64_t k = -size / 2; k < size / 2; k += 2)
+        {
+                SCUT_ASSERT_TRUE(btree_i64_remove(t, k));
+        }
+        SCUT_ASSERT_IE(btree_i64_size(t), size / 2);
+        for (int64_t k = -size / 2; k < size / 2; k++)
+        {
+                if (k & 1)
+                {
+                        SCUT_ASSERT_TRUE(btree_i64_find(t, k));
+                }
+                else
+                {
+                        SCUT_ASSERT_FALSE(btree_i64_find(t, k));
+                }
+        }
+
+        /* Removed nodes are reused */
+        for (int64_t k = -size / 2; k < size / 2; k += 2)
+        {
+                SCUT_ASSERT_IE(btree_i64_insert(t, k, (void*)1l), 0);
+        }
+        SCUT_ASSERT_IE(btree_i64_size(t), size);
+
+        btree_i64_destroy(t);
+
+        return 0;
+}
+
+static int test_bts_f64(void)
+{
+        struct btree_f64* t = btree_f64_create();
+
+        for (long i = 1; i <= 100; i++)
+        {
+                SCUT_ASSERT_IE(btree_f64_insert(t, 1.0 / (double)i, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(btree_f64_size(t), 100);
+        SCUT_ASSERT_IE(btree_f64_find(t, 0.25), 4);
+        SCUT_ASSERT_FALSE(btree_f64_find(t, 0.3));
+        SCUT_ASSERT_IE(btree_f64_remove(t, 0.5), 2);
+        SCUT_ASSERT_FALSE(btree_f64_find(t, 0.5));
+        SCUT_ASSERT_IE(btree_f64_find(t, 1.0), 1);
+
+        btree_f64_destroy(t);
+
+        return 0;
+}
+
+static int test_bts_id(void)
+{
+        struct btree_id16* t = btree_id16_create();
+        struct btree_id id;
+
+        /* Keys differing in either half */
+        for (long i = 0; i < 100; i++)
+        {
+                id.hi = (uint64_t)(i % 10);
+                id.lo = (uint64_t)(i / 10);
+                SCUT_ASSERT_IE(btree_id16_insert(t, id, (void*)(i + 1)), 0);
+        }
+        SCUT_ASSERT_IE(btree_id16_size(t), 100);
+        for (long i = 0; i < 100; i++)
+        {
+                id.hi = (uint64_t)(i % 10);
+                id.lo = (uint64_t)(i / 10);
+                SCUT_ASSERT_IE(btree_id16_find(t, id), i + 1);
+        }
+        id.hi = 3;
+        id.lo = 10;
+        SCUT_ASSERT_FALSE(btree_id16_find(t, id));
+        id.lo = 5;
+        SCUT_ASSERT_IE(btree_id16_remove(t, id), 54);
+        SCUT_ASSERT_FALSE(btree_id16_find(t, id));
+        SCUT_ASSERT_IE(btree_id16_size(t), 99);
+
+        btree_id16_destroy(t);
+
+        return 0;
+}
+
+static int test_bts_user(void)
+{
+        struct desc_tree* t = desc_tree_create();
+
+        /* Enough nodes for several slabs */
+        for (unsigned int i = 1; i <= 2000; i++)
+        {
+                SCUT_ASSERT_IE(desc_tree_insert(t, (i * 7919) % 2000, (void*)1l), 0);
+        }
+        SCUT_ASSERT_IE(desc_tree_size(t), 2000);
+        for (unsigned int i = 0; i < 2000; i++)
+        {
+                SCUT_ASSERT_TRUE(desc_tree_remove(t, i));
+        }
+        SCUT_ASSERT_IE(desc_tree_size(t), 0);
+
+        desc_tree_destroy(t);
+
+        return 0;
+}
+
+static int test_bts_balance(void)
+{
+        struct desc_tree* t = desc_tree_create();
+        struct btree_f64* f = btree_f64_create();
+
+        SCUT_ASSERT_IE(desc_tree_balance(t), 0);
+        SCUT_ASSERT_IE(desc_height(t->root), 0);
+
+        /* Worst case, tree is a list */
+        for (unsigned int i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(desc_tree_insert(t, i, (void*)(long)i), 0);
+        }
+        SCUT_ASSERT_IE(desc_height(t->root), 1000);
+
+        SCUT_ASSERT_IE(desc_tree_balance(t), 0);
+        SCUT_ASSERT_IE(desc_tree_size(t), 1000);
+        SCUT_ASSERT_IE(desc_height(t->root), 10);
+        for (unsigned int i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(desc_tree_find(t, i), i);
+        }
+
+        /* Root of a full tree shall be the median */
+        for (unsigned int i = 8; i <= 1000; i++)
+        {
+                SCUT_ASSERT_TRUE(desc_tree_remove(t, i));
+        }
+        SCUT_ASSERT_IE(desc_tree_balance(t), 0);
+        SCUT_ASSERT_IE(desc_height(t->root), 3);
+        SCUT_ASSERT_IE(t->root->key, 4);
+
+        desc_tree_destroy(t);
+
+        /* Library specializations are balanced the same way */
+        for (long i = 1; i <= 100; i++)
+        {
+                SCUT_ASSERT_IE(btree_f64_insert(f, (double)i, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(btree_f64_balance(f), 0);
+        for (long i = 1; i <= 100; i++)
+        {
+                SCUT_ASSERT_IE(btree_f64_find(f, (double)i), i);
+        }
+        btree_f64_destroy(f);
+
+        return 0;
+}
+
+static unsigned int desc_height(const struct desc_tree_node* n)
+{
+        unsigned int l;
+        unsigned int r;
+
+        if (n == NULL)
+        {
+                return 0;
+        }
+        l = desc_height(n->left);
+        r = desc_height(n->right);
+
+        return 1 + (l > r ? l : r);
+}
@@ -24,6 +24,19 @@ static int test_bt_remove(void);
 static int test_bt_bf(void);
 static int test_bt_df(void);
 static int test_bt_balance(void);
+static int test_bt_pool(void);
+static int test_bt_balance_sorted(void);
+static int test_bt_bounds(void);
+static int test_bt_cursor(void);
+static int test_bt_rank_select(void);
+static int test_bt_build_sorted(void);
+static int test_bt_freeze(void);
+static int test_bt_find_batch(void);
+static int test_bt_walk(void);
+static int test_bt_split_join(void);
+static int test_bt_merge(void);
+static int test_bt_par_fold(void);
+static int test_bt_balance_mt(void);
 static int cmp_fun(const void*, const void*);
 
 int test_btree(void)
@@ -38,6 +51,19 @@ int test_btree(void)
         SCUT_ADD(test_bt_bf);
         SCUT_ADD(test_bt_df);
         SCUT_ADD(test_bt_balance);
+        SCUT_ADD(test_bt_pool);
+        SCUT_ADD(test_bt_balance_sorted);
+        SCUT_ADD(test_bt_bounds);
+        SCUT_ADD(test_bt_cursor);
+        SCUT_ADD(test_bt_rank_select);
+        SCUT_ADD(test_bt_build_sorted);
+        SCUT_ADD(test_bt_freeze);
+        SCUT_ADD(test_bt_find_batch);
+        SCUT_ADD(test_bt_walk);
+        SCUT_ADD(test_bt_split_join);
+        SCUT_ADD(test_bt_merge);
+        SCUT_ADD(test_bt_par_fold);
+        SCUT_ADD(test_bt_balance_mt);
         ret = scut_run(0);
 
         scut_destroy();
@@ -352,3 +378,806 @@ static int test_bt_balance(void)
 
         return 0;
 }
+
+static int test_bt_pool(void)
+{
+        struct btree* bt = btree_create(&cmp_lng);
+        long size = 10000;
+
+        /* Span multiple slabs */
+        for (long i = 1; i <= size; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)((i * 7919) % size + 1)), 0);
+        }
+        SCUT_ASSERT_IE(btree_size(bt), size);
+
+        /* Removed nodes shall be reused */
+        for (long i = 2; i <= size; i += 2)
+        {
+                SCUT_ASSERT_TRUE(btree_remove(bt, (void*)i) == (void*)i);
+        }
+        SCUT_ASSERT_IE(btree_size(bt), size / 2);
+        for (long i = 2; i <= size; i += 2)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(btree_size(bt), size);
+        for (long i = 1; i <= size; i++)
+        {
+                SCUT_ASSERT_TRUE(btree_find(bt, (void*)i) == (void*)i);
+        }
+
+        /* Tree shall be usable after the pool is released */
+        btree_clear(bt);
+        SCUT_ASSERT_IE(btree_size(bt), 0);
+        SCUT_ASSERT_FALSE(btree_find(bt, (void*)1l));
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)1l), 0);
+        SCUT_ASSERT_TRUE(btree_find(bt, (void*)1l));
+
+        btree_destroy(bt);
+
+        return 0;
+}
+
+static int test_bt_balance_sorted(void)
+{
+        struct btree* bt = btree_create(&cmp_lng);
+        void** traversal;
+
+        /* Empty tree */
+        SCUT_ASSERT_IE(btree_balance(bt), 0);
+        SCUT_ASSERT_IE(btree_height(bt), 0);
+
+        /* Worst case, tree is a list */
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(btree_height(bt), 1000);
+        traversal = btree_bf(bt);
+        for (long i = 0; i < 1000; i++)
+        {
+                SCUT_ASSERT_IE(traversal[i], i + 1);
+        }
+        SCUT_ASSERT_TRUE(traversal[1000] == NULL);
+        free(traversal);
+
+        SCUT_ASSERT_IE(btree_balance(bt), 0);
+        SCUT_ASSERT_IE(btree_size(bt), 1000);
+        SCUT_ASSERT_IE(btree_height(bt), 10);
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_TRUE(btree_find(bt, (void*)i) == (void*)i);
+        }
+
+        /* Root of a full tree shall be the median */
+        btree_clear(bt);
+        for (long i = 1; i <= 7; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(btree_balance(bt), 0);
+        SCUT_ASSERT_IE(btree_height(bt), 3);
+        traversal = btree_bf(bt);
+        SCUT_ASSERT_IE(traversal[0], 4l);
+        SCUT_ASSERT_IE(traversal[1], 2l);
+        SCUT_ASSERT_IE(traversal[2], 6l);
+        free(traversal);
+
+        btree_destroy(bt);
+
+        return 0;
+}
+
+static int test_bt_bounds(void)
+{
+        struct btree* bt = btree_create(&cmp_lng);
+        struct btree_cursor cur;
+
+        SCUT_ASSERT_FALSE(btree_lower_bound(bt, (void*)10l, &cur));
+        SCUT_ASSERT_FALSE(btree_first(bt, &cur));
+        SCUT_ASSERT_FALSE(btree_next(&cur));
+
+        /* 10, 20, ..., 100 */
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)50l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)20l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)80l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)10l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)30l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)70l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)90l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)40l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)60l), 0);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)100l), 0);
+
+        SCUT_ASSERT_IE(btree_lower_bound(bt, (void*)1l, NULL), 10l);
+        SCUT_ASSERT_IE(btree_lower_bound(bt, (void*)40l, NULL), 40l);
+        SCUT_ASSERT_IE(btree_lower_bound(bt, (void*)41l, NULL), 50l);
+        SCUT_ASSERT_IE(btree_lower_bound(bt, (void*)100l, NULL), 100l);
+        SCUT_ASSERT_FALSE(btree_lower_bound(bt, (void*)101l, NULL));
+
+        SCUT_ASSERT_IE(btree_upper_bound(bt, (void*)1l, NULL), 10l);
+        SCUT_ASSERT_IE(btree_upper_bound(bt, (void*)40l, NULL), 50l);
+        SCUT_ASSERT_IE(btree_upper_bound(bt, (void*)41l, NULL), 50l);
+        SCUT_ASSERT_FALSE(btree_upper_bound(bt, (void*)100l, NULL));
+
+        /* Scan [35, 75) */
+        long expect = 40;
+        for (void* e = btree_lower_bound(bt, (void*)35l, &cur);
+             e && cmp_lng(e, (void*)75l) < 0;
+             e = btree_next(&cur))
+        {
+                SCUT_ASSERT_IE(e, expect);
+                expect += 10;
+        }
+        SCUT_ASSERT_IE(expect, 80);
+
+        btree_destroy(bt);
+
+        return 0;
+}
+
+static int test_bt_cursor(void)
+{
+        struct btree* bt = btree_create(&cmp_lng);
+        struct btree_cursor cur;
+        long size = 1000;
+        long i;
+        void* e;
+
+        for (i = 1; i <= size; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)((i * 7919) % size + 1)), 0);
+        }
+
+        /* Forward */
+        i = 1;
+        for (e = btree_first(bt, &cur); e; e = btree_next(&cur))
+        {
+                SCUT_ASSERT_IE(e, i);
+                i++;
+        }
+        SCUT_ASSERT_IE(i, size + 1);
+        SCUT_ASSERT_FALSE(btree_next(&cur));
+
+        /* Backward, after the tree is rotated */
+        SCUT_ASSERT_IE(btree_balance(bt), 0);
+        i = size;
+        for (e = btree_last(bt, &cur); e; e = btree_prev(&cur))
+        {
+                SCUT_ASSERT_IE(e, i);
+                i--;
+        }
+        SCUT_ASSERT_IE(i, 0);
+
+        /* Both directions, after nodes are removed */
+        for (i = 1; i <= size; i += 3)
+        {
+                SCUT_ASSERT_TRUE(btree_remove(bt, (void*)i) == (void*)i);
+        }
+        e = btree_lower_bound(bt, (void*)500l, &cur);
+        SCUT_ASSERT_IE(e, 500l);
+        SCUT_ASSERT_IE(btree_next(&cur), 501l);
+        SCUT_ASSERT_IE(btree_next(&cur), 503l);
+        SCUT_ASSERT_IE(btree_prev(&cur), 501l);
+        SCUT_ASSERT_IE(btree_prev(&cur), 500l);
+        SCUT_ASSERT_IE(btree_prev(&cur), 498l);
+        i = 0;
+        for (e = btree_first(bt, &cur); e; e = btree_next(&cur))
+        {
+                i++;
+        }
+        SCUT_ASSERT_IE(i, btree_size(bt));
+
+        btree_destroy(bt);
+
+        return 0;
+}
+
+static int test_bt_rank_select(void)
+{
+        struct btree* bt;
+        long size = 1000;
+
+        for (int f = 0; f < 2; f++)
+        {
+                bt = btree_create_flags(&cmp_lng, f ? BTREE_ORDER_STAT : 0);
+
+                SCUT_ASSERT_IE(btree_rank(bt, (void*)1l), 0);
+                SCUT_ASSERT_FALSE(btree_select(bt, 0));
+
+                /* Even numbers 2..2000 */
+                for (long i = 1; i <= size; i++)
+                {
+                        long v = ((i * 7919) % size + 1) * 2;
+
+                        SCUT_ASSERT_IE(btree_insert(bt, (void*)v), 0);
+                }
+                /* Replace shall not change any size */
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)2l), 0);
+
+                for (long i = 0; i < size; i++)
+                {
+                        SCUT_ASSERT_IE(btree_select(bt, (size_t)i), (i + 1) * 2);
+                        SCUT_ASSERT_IE(btree_rank(bt, (void*)((i + 1) * 2)), i);
+                        SCUT_ASSERT_IE(btree_rank(bt, (void*)((i + 1) * 2 + 1)), i + 1);
+                }
+                SCUT_ASSERT_FALSE(btree_select(bt, (size_t)size));
+
+                /* Remove every item divisible by 4 */
+                for (long i = 4; i <= size * 2; i += 4)
+                {
+                        SCUT_ASSERT_TRUE(btree_remove(bt, (void*)i) == (void*)i);
+                }
+                SCUT_ASSERT_FALSE(btree_remove(bt, (void*)4l));
+                SCUT_ASSERT_IE(btree_size(bt), size / 2);
+                SCUT_ASSERT_IE(btree_balance(bt), 0);
+                for (long i = 0; i < size / 2; i++)
+                {
+                        SCUT_ASSERT_IE(btree_select(bt, (size_t)i), i * 4 + 2);
+                        SCUT_ASSERT_IE(btree_rank(bt, (void*)(i * 4 + 2)), i);
+                }
+
+                btree_destroy(bt);
+        }
+
+        return 0;
+}
+
+static int test_bt_build_sorted(void)
+{
+        long size = 100000;
+        void** items = malloc(size * sizeof(void*));
+        struct btree* bt;
+        struct btree_cursor cur;
+        long i;
+
+        for (i = 0; i < size; i++)
+        {
+                items[i] = (void*)(i + 1);
+        }
+
+        bt = btree_build_sorted(&cmp_lng, items, 0);
+        SCUT_ASSERT_TRUE(bt);
+        SCUT_ASSERT_IE(btree_size(bt), 0);
+        SCUT_ASSERT_IE(btree_height(bt), 0);
+        btree_destroy(bt);
+
+        bt = btree_build_sorted(&cmp_lng, items, 7);
+        SCUT_ASSERT_IE(btree_size(bt), 7);
+        SCUT_ASSERT_IE(btree_height(bt), 3);
+        SCUT_ASSERT_IE(btree_first(bt, NULL), 1l);
+        SCUT_ASSERT_IE(btree_last(bt, NULL), 7l);
+        btree_destroy(bt);
+
+        for (unsigned int t = 1; t <= 4; t *= 4)
+        {
+                bt = btree_build_sorted_mt(&cmp_lng, items, (size_t)size, t);
+                SCUT_ASSERT_IE(btree_size(bt), size);
+                SCUT_ASSERT_IE(btree_height(bt), 17);
+
+                i = 1;
+                for (void* e = btree_first(bt, &cur); e; e = btree_next(&cur))
+                {
+                        SCUT_ASSERT_IE(e, i);
+                        i++;
+                }
+                SCUT_ASSERT_IE(i, size + 1);
+
+                /* Tree shall behave as any other tree */
+                SCUT_ASSERT_TRUE(btree_remove(bt, (void*)500l) == (void*)500l);
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)(size + 1)), 0);
+                SCUT_ASSERT_IE(btree_size(bt), size);
+                SCUT_ASSERT_FALSE(btree_find(bt, (void*)500l));
+                SCUT_ASSERT_TRUE(btree_find(bt, (void*)(size + 1)));
+                SCUT_ASSERT_IE(btree_lower_bound(bt, (void*)500l, &cur), 501l);
+                SCUT_ASSERT_IE(btree_prev(&cur), 499l);
+
+                btree_destroy(bt);
+        }
+
+        free(items);
+
+        return 0;
+}
+
+static int test_bt_freeze(void)
+{
+        struct btree* bt = btree_create(&cmp_lng);
+        struct btree_frozen* fz;
+        long size = 1000;
+
+        fz = btree_freeze(bt);
+        SCUT_ASSERT_TRUE(fz);
+        SCUT_ASSERT_IE(btree_frozen_size(fz), 0);
+        SCUT_ASSERT_FALSE(btree_frozen_find(fz, (void*)1l));
+        SCUT_ASSERT_FALSE(btree_frozen_lower_bound(fz, (void*)1l));
+        btree_frozen_destroy(fz);
+
+        /* Odd numbers, 1..1999 */
+        for (long i = 1; i <= size; i++)
+        {
+                long v = ((i * 7919) % size) * 2 + 1;
+
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)v), 0);
+        }
+
+        fz = btree_freeze(bt);
+        /* Frozen tree is a copy */
+        btree_clear(bt);
+        SCUT_ASSERT_IE(btree_frozen_size(fz), size);
+
+        for (long i = 0; i < size; i++)
+        {
+                long v = i * 2 + 1;
+
+                SCUT_ASSERT_IE(btree_frozen_find(fz, (void*)v), v);
+                SCUT_ASSERT_FALSE(btree_frozen_find(fz, (void*)(v + 1)));
+                SCUT_ASSERT_IE(btree_frozen_lower_bound(fz, (void*)v), v);
+                SCUT_ASSERT_IE(btree_frozen_lower_bound(fz, (void*)(v - 1)), v);
+        }
+        SCUT_ASSERT_FALSE(btree_frozen_lower_bound(fz, (void*)(size * 2)));
+
+        btree_frozen_destroy(fz);
+        btree_destroy(bt);
+
+        return 0;
+}
+
+static int test_bt_find_batch(void)
+{
+        struct btree* bt = btree_create(&cmp_lng);
+        long size = 1000;
+        void* keys[2001];
+        void* out[2001];
+
+        /* Empty tree */
+        keys[0] = (void*)1l;
+        out[0] = (void*)1l;
+        SCUT_ASSERT_IE(btree_find_batch(bt, keys, 1, out), 0);
+        SCUT_ASSERT_FALSE(out[0]);
+
+        /* Odd numbers, 1..1999 */
+        for (long i = 1; i <= size; i++)
+        {
+                long v = ((i * 7919) % size) * 2 + 1;
+
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)v), 0);
+        }
+
+        /* Hits and misses in random order, more keys than lanes */
+        for (long i = 0; i <= 2 * size; i++)
+        {
+                keys[i] = (void*)((i * 7919) % (2 * size + 1));
+        }
+        SCUT_ASSERT_IE(btree_find_batch(bt, keys, 2 * size + 1, out), size);
+        for (long i = 0; i <= 2 * size; i++)
+        {
+                if ((long)keys[i] & 1)
+                {
+                        SCUT_ASSERT_IE(out[i], keys[i]);
+                }
+                else
+                {
+                        SCUT_ASSERT_FALSE(out[i]);
+                }
+        }
+
+        /* Fewer keys than lanes */
+        SCUT_ASSERT_IE(btree_find_batch(bt, keys, 3, out), 1);
+        SCUT_ASSERT_IE(btree_find_batch(bt, keys, 0, out), 0);
+
+        btree_destroy(bt);
+
+        return 0;
+}
+
+struct walk_check
+{
+        void** expect;
+        int count;
+        int stop;
+};
+
+static int visit_check(void* d, void* arg)
+{
+        struct walk_check* w = arg;
+
+        if (d != w->expect[w->count])
+        {
+                return -1;
+        }
+        if (++w->count == w->stop)
+        {
+                return 2;
+        }
+
+        return 0;
+}
+
+static int test_bt_walk(void)
+{
+        struct btree* bt = btree_create(&cmp_lng);
+        long items[] = {50, 25, 60, 17, 55, 70, 10, 20, 54, 58, 75, 72, 80};
+        void* pre[] = {
+                (void*)50l, (void*)25l, (void*)17l, (void*)10l, (void*)20l,
+                (void*)60l, (void*)55l, (void*)54l, (void*)58l, (void*)70l,
+                (void*)75l, (void*)72l, (void*)80l
+        };
+        void* in[] = {
+                (void*)10l, (void*)17l, (void*)20l, (void*)25l, (void*)50l,
+                (void*)54l, (void*)55l, (void*)58l, (void*)60l, (void*)70l,
+                (void*)72l, (void*)75l, (void*)80l
+        };
+        void* post[] = {
+                (void*)10l, (void*)20l, (void*)17l, (void*)25l, (void*)54l,
+                (void*)58l, (void*)55l, (void*)72l, (void*)80l, (void*)75l,
+                (void*)70l, (void*)60l, (void*)50l
+        };
+        void* bf[] = {
+                (void*)50l, (void*)25l, (void*)60l, (void*)17l, (void*)55l,
+                (void*)70l, (void*)10l, (void*)20l, (void*)54l, (void*)58l,
+                (void*)75l, (void*)72l, (void*)80l
+        };
+        struct walk_check w = {pre, 0, -1};
+
+        /* Empty tree */
+        SCUT_ASSERT_IE(btree_height(bt), 0);
+        SCUT_ASSERT_IE(btree_walk(bt, BTREE_IN_ORDER, &visit_check, &w), 0);
+        SCUT_ASSERT_IE(btree_walk_bf(bt, &visit_check, &w), 0);
+        SCUT_ASSERT_IE(w.count, 0);
+
+        for (int i = 0; i < 13; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)items[i]), 0);
+        }
+        SCUT_ASSERT_IE(btree_height(bt), 5);
+
+        SCUT_ASSERT_IE(btree_walk(bt, BTREE_PRE_ORDER, &visit_check, &w), 0);
+        SCUT_ASSERT_IE(w.count, 13);
+        w.expect = in;
+        w.count = 0;
+        SCUT_ASSERT_IE(btree_walk(bt, BTREE_IN_ORDER, &visit_check, &w), 0);
+        SCUT_ASSERT_IE(w.count, 13);
+        w.expect = post;
+        w.count = 0;
+        SCUT_ASSERT_IE(btree_walk(bt, BTREE_POST_ORDER, &visit_check, &w), 0);
+        SCUT_ASSERT_IE(w.count, 13);
+        w.expect = bf;
+        w.count = 0;
+        SCUT_ASSERT_IE(btree_walk_bf(bt, &visit_check, &w), 0);
+        SCUT_ASSERT_IE(w.count, 13);
+
+        /* Early termination */
+        w.expect = post;
+        w.count = 0;
+        w.stop = 7;
+        SCUT_ASSERT_IE(btree_walk(bt, BTREE_POST_ORDER, &visit_check, &w), 2);
+        SCUT_ASSERT_IE(w.count, 7);
+        w.expect = bf;
+        w.count = 0;
+        w.stop = 4;
+        SCUT_ASSERT_IE(btree_walk_bf(bt, &visit_check, &w), 2);
+        SCUT_ASSERT_IE(w.count, 4);
+
+        /* Degenerated tree */
+        btree_clear(bt);
+        for (long i = 1; i <= 100; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(btree_height(bt), 100);
+        btree_balance(bt);
+        SCUT_ASSERT_IE(btree_height(bt), 7);
+
+        btree_destroy(bt);
+
+        return 0;
+}
+
+/* Verify items are visited in order next, next + step, ... */
+struct seq_check
+{
+        long next;
+        long step;
+        long count;
+};
+
+static int visit_seq(void* d, void* arg)
+{
+        struct seq_check* c = arg;
+
+        if ((long)d != c->next)
+        {
+                return 1;
+        }
+        c->next += c->step;
+        c->count++;
+
+        return 0;
+}
+
+static int test_bt_split_join(void)
+{
+        unsigned int flags[] = {0, BTREE_ORDER_STAT};
+
+        for (int f = 0; f < 2; f++)
+        {
+                struct btree* bt = btree_create_flags(&cmp_lng, flags[f]);
+                struct btree* r;
+                struct btree* e;
+                struct seq_check c = {1, 1, 0};
+
+                for (long i = 1; i <= 1000; i++)
+                {
+                        long v = (i * 7919) % 1000 + 1;
+
+                        SCUT_ASSERT_IE(btree_insert(bt, (void*)v), 0);
+                }
+
+                r = btree_split(bt, (void*)300l);
+                SCUT_ASSERT_TRUE(r);
+                SCUT_ASSERT_IE(btree_size(bt), 299);
+                SCUT_ASSERT_IE(btree_size(r), 701);
+                SCUT_ASSERT_IE(btree_walk(bt, BTREE_IN_ORDER, &visit_seq, &c), 0);
+                SCUT_ASSERT_IE(c.count, 299);
+                SCUT_ASSERT_IE(btree_walk(r, BTREE_IN_ORDER, &visit_seq, &c), 0);
+                SCUT_ASSERT_IE(c.count, 1000);
+                SCUT_ASSERT_FALSE(btree_find(bt, (void*)300l));
+                SCUT_ASSERT_IE(btree_find(r, (void*)300l), 300);
+                SCUT_ASSERT_IE(btree_rank(r, (void*)500l), 200);
+                SCUT_ASSERT_IE(btree_select(bt, 298), 299);
+
+                /* Split outside the range */
+                e = btree_split(bt, (void*)1000l);
+                SCUT_ASSERT_IE(btree_size(e), 0);
+                SCUT_ASSERT_IE(btree_size(bt), 299);
+                SCUT_ASSERT_IE(btree_join(bt, e), 0);
+                btree_destroy(e);
+                e = btree_split(bt, (void*)0l);
+                SCUT_ASSERT_IE(btree_size(e), 299);
+                SCUT_ASSERT_IE(btree_size(bt), 0);
+                /* Join into an empty tree */
+                SCUT_ASSERT_IE(btree_join(bt, e), 0);
+                SCUT_ASSERT_IE(btree_size(bt), 299);
+                SCUT_ASSERT_IE(btree_size(e), 0);
+                btree_destroy(e);
+
+                /* The trees have separate pools */
+                for (long i = 300; i < 600; i++)
+                {
+                        SCUT_ASSERT_IE(btree_remove(r, (void*)i), i);
+                }
+                for (long i = 300; i < 600; i++)
+                {
+                        SCUT_ASSERT_IE(btree_insert(r, (void*)i), 0);
+                }
+
+                SCUT_ASSERT_IE(btree_join(bt, r), 0);
+                SCUT_ASSERT_IE(btree_size(bt), 1000);
+                SCUT_ASSERT_IE(btree_size(r), 0);
+                c.next = 1;
+                c.count = 0;
+                SCUT_ASSERT_IE(btree_walk(bt, BTREE_IN_ORDER, &visit_seq, &c), 0);
+                SCUT_ASSERT_IE(c.count, 1000);
+                SCUT_ASSERT_IE(btree_rank(bt, (void*)700l), 699);
+                SCUT_ASSERT_IE(btree_select(bt, 999), 1000);
+
+                /* Trees with different flags can't be joined */
+                e = btree_create_flags(&cmp_lng, flags[1 - f]);
+                SCUT_ASSERT_IE(btree_insert(e, (void*)2000l), 0);
+                SCUT_ASSERT_IE(btree_join(bt, e), -1);
+                SCUT_ASSERT_IE(btree_size(e), 1);
+                btree_destroy(e);
+
+                /* The split off tree doesn't depend on the original */
+                btree_destroy(r);
+                r = btree_split(bt, (void*)101l);
+                SCUT_ASSERT_IE(btree_size(r), 900);
+                btree_destroy(bt);
+                for (long i = 1; i <= 100; i++)
+                {
+                        SCUT_ASSERT_IE(btree_insert(r, (void*)i), 0);
+                }
+                btree_clear(r);
+                SCUT_ASSERT_IE(btree_size(r), 0);
+                btree_destroy(r);
+        }
+
+        return 0;
+}
+
+static int test_bt_merge(void)
+{
+        struct btree* a = btree_create_flags(&cmp_lng, BTREE_ORDER_STAT);
+        struct btree* b = btree_create_flags(&cmp_lng, BTREE_ORDER_STAT);
+        struct btree* r;
+        struct seq_check c = {1, 1, 0};
+
+        /* a holds the odd numbers, b the even and some odd */
+        for (long i = 1; i <= 1000; i += 2)
+        {
+                SCUT_ASSERT_IE(btree_insert(a, (void*)i), 0);
+        }
+        for (long i = 2; i <= 1000; i += 2)
+        {
+                SCUT_ASSERT_IE(btree_insert(b, (void*)i), 0);
+                SCUT_ASSERT_IE(btree_insert(b, (void*)(i - 1)), 0);
+        }
+        SCUT_ASSERT_IE(btree_height(a), 500);
+
+        SCUT_ASSERT_IE(btree_merge(a, b), 0);
+        SCUT_ASSERT_IE(btree_size(a), 1000);
+        SCUT_ASSERT_IE(btree_size(b), 0);
+        SCUT_ASSERT_IE(btree_height(a), 10);
+        SCUT_ASSERT_IE(btree_walk(a, BTREE_IN_ORDER, &visit_seq, &c), 0);
+        SCUT_ASSERT_IE(c.count, 1000);
+        SCUT_ASSERT_IE(btree_rank(a, (void*)501l), 500);
+        SCUT_ASSERT_IE(btree_select(a, 0), 1);
+
+        /* b's nodes now belong to a */
+        btree_destroy(b);
+        for (long i = 1; i <= 1000; i += 3)
+        {
+                SCUT_ASSERT_IE(btree_remove(a, (void*)i), i);
+        }
+        for (long i = 1; i <= 1000; i += 3)
+        {
+                SCUT_ASSERT_IE(btree_insert(a, (void*)i), 0);
+        }
+
+        /* Merge into a tree split from another tree */
+        r = btree_split(a, (void*)700l);
+        b = btree_create_flags(&cmp_lng, BTREE_ORDER_STAT);
+        for (long i = 1001; i <= 1100; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(b, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(btree_merge(r, b), 0);
+        btree_destroy(b);
+        SCUT_ASSERT_IE(btree_merge(a, r), 0);
+        btree_destroy(r);
+
+        /* Trees with different compare methods can't be merged */
+        b = btree_create_flags(&cmp_fun, BTREE_ORDER_STAT);
+        SCUT_ASSERT_IE(btree_merge(a, b), -1);
+        btree_destroy(b);
+        c.next = 1;
+        c.count = 0;
+        SCUT_ASSERT_IE(btree_walk(a, BTREE_IN_ORDER, &visit_seq, &c), 0);
+        SCUT_ASSERT_IE(c.count, 1100);
+
+        btree_destroy(a);
+
+        return 0;
+}
+
+/* A run of consecutive numbers, used to verify fold order */
+struct run
+{
+        long lo;
+        long hi;
+        int ok;
+};
+
+static void* fold_sum(void* acc, void* d, void* arg)
+{
+        (void)arg;
+        return (void*)((long)acc + (long)d);
+}
+
+static void* combine_sum(void* l, void* r, void* arg)
+{
+        (void)arg;
+        return (void*)((long)l + (long)r);
+}
+
+static void* fold_run(void* acc, void* d, void* arg)
+{
+        struct run* r = acc;
+
+        (void)arg;
+        if (r == NULL)
+        {
+                r = malloc(sizeof(struct run));
+                r->lo = (long)d;
+                r->hi = (long)d;
+                r->ok = 1;
+                return r;
+        }
+        r->ok = r->ok && (long)d == r->hi + 1;
+        r->hi = (long)d;
+
+        return r;
+}
+
+static void* combine_run(void* left, void* right, void* arg)
+{
+        struct run* l = left;
+        struct run* r = right;
+
+        (void)arg;
+        l->ok = l->ok && r->ok && r->lo == l->hi + 1;
+        l->hi = r->hi;
+        free(r);
+
+        return l;
+}
+
+static int test_bt_par_fold(void)
+{
+        struct btree* bt = btree_create(&cmp_lng);
+        long size = 10000;
+        struct run* r;
+
+        SCUT_ASSERT_IE(btree_par_fold(bt, 4, (void*)42l, &fold_sum,
+                                      &combine_sum, NULL), 42);
+
+        for (long i = 1; i <= size; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)((i * 7919) % size + 1)), 0);
+        }
+        SCUT_ASSERT_IE(btree_par_fold(bt, 4, (void*)0l, &fold_sum,
+                                      &combine_sum, NULL), size * (size + 1) / 2);
+        SCUT_ASSERT_IE(btree_par_fold(bt, 1, (void*)0l, &fold_sum,
+                                      &combine_sum, NULL), size * (size + 1) / 2);
+
+        /* Items are folded and combined in order */
+        for (unsigned int t = 1; t <= 8; t++)
+        {
+                r = btree_par_fold(bt, t, NULL, &fold_run, &combine_run, NULL);
+                SCUT_ASSERT_TRUE(r);
+                SCUT_ASSERT_TRUE(r->ok);
+                SCUT_ASSERT_IE(r->lo, 1);
+                SCUT_ASSERT_IE(r->hi, size);
+                free(r);
+        }
+
+        /* A degenerate tree gives few tasks, but the same result */
+        btree_clear(bt);
+        for (long i = 1; i <= 100; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)i), 0);
+        }
+        r = btree_par_fold(bt, 4, NULL, &fold_run, &combine_run, NULL);
+        SCUT_ASSERT_TRUE(r->ok);
+        SCUT_ASSERT_IE(r->hi, 100);
+        free(r);
+
+        btree_destroy(bt);
+
+        return 0;
+}
+
+static int test_bt_balance_mt(void)
+{
+        struct btree* bt = btree_create_flags(&cmp_lng, BTREE_ORDER_STAT);
+        struct seq_check c = {1, 1, 0};
+        long size = 5000;
+
+        for (long i = 1; i <= size; i++)
+        {
+                SCUT_ASSERT_IE(btree_insert(bt, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(btree_height(bt), size);
+
+        SCUT_ASSERT_IE(btree_balance_mt(bt, 4), 0);
+        SCUT_ASSERT_IE(btree_size(bt), size);
+        SCUT_ASSERT_IE(btree_height(bt), 13);
+        SCUT_ASSERT_IE(btree_walk(bt, BTREE_IN_ORDER, &visit_seq, &c), 0);
+        SCUT_ASSERT_IE(c.count, size);
+        SCUT_ASSERT_IE(btree_rank(bt, (void*)2500l), 2499);
+        SCUT_ASSERT_IE(btree_select(bt, 4999), 5000);
+
+        /* The tree stays usable, and balancing twice is stable */
+        SCUT_ASSERT_IE(btree_remove(bt, (void*)1l), 1);
+        SCUT_ASSERT_IE(btree_insert(bt, (void*)(size + 1)), 0);
+        SCUT_ASSERT_IE(btree_balance_mt(bt, 3), 0);
+        SCUT_ASSERT_IE(btree_height(bt), 13);
+        SCUT_ASSERT_IE(btree_find(bt, (void*)(size + 1)), size + 1);
+        SCUT_ASSERT_IE(btree_select(bt, 0), 2);
+
+        btree_destroy(bt);
+
+        return 0;
+}
@@ -0,0 +1,759 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "cmap.h"
+
+/*
+ * Optimistic lazy skip list, Herlihy, Lev, Luchangco and Shavit,
+ * "A Simple Optimistic Skiplist Algorithm", 2007.
+ * Readers traverse without locks. A writer searches without locks, then
+ * locks the predecessors and validates that they are unchanged before
+ * linking or unlinking. A node is logically removed by setting marked,
+ * and logically present once fully_linked is set.
+ *
+ * Removed nodes are freed with epoch based reclamation. Each thread has
+ * a slot of its own per map, in a cache line of its own, where it
+ * announces the epoch it entered an operation in. A lookup thus only
+ * writes to its own slot. A removed node is retired to the list of the
+ * current epoch, and retire scans all slots: once every operation in
+ * progress has entered in the current epoch, no one can reach the nodes
+ * retired in the previous epoch, they are freed and the epoch advances.
+ * Memory is bounded as long as operations finish, even under continuous
+ * updates.
+ */
+
+#define MAX_LEVEL 24
+#define CACHE_LINE 64
+/* Number of maps a thread can use without searching for its slot */
+#define SLOT_CACHE 8
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define FETCH_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+/* The epoch and the slots must be totally ordered with the loads of
+   the traversal */
+#define LOAD_SC(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define STORE_SC(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define EXCHANGE_SC(p, v) __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+#define FENCE_SC() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+struct cnode
+{
+        void* data;
+        pthread_mutex_t lock;
+        int marked;
+        int fully_linked;
+        /* Highest level the node is linked at */
+        int top;
+        /* Link in the list of removed nodes */
+        struct cnode* retired;
+        struct cnode* next[];
+};
+
+/* Epoch announcement of one thread, alone in its cache line */
+struct slot
+{
+        /* The epoch shifted up by one with the low bit set while the
+           thread is in an operation, 0 otherwise */
+        unsigned long state;
+        pthread_t owner;
+        struct slot* next;
+        /* The allocation the slot is aligned in */
+        void* mem;
+};
+
+/* A slot of the thread, by the id of the map it belongs to */
+struct slot_ref
+{
+        uint64_t id;
+        struct slot* slot;
+};
+
+struct cmap
+{
+        struct cnode* head;
+        btree_cmp cmp;
+        size_t len;
+        /* Seeds per thread random state */
+        uint64_t seed;
+        /* Never reused, so a cached slot can't belong to a destroyed
+           map */
+        uint64_t id;
+        /* Protects advancing the epoch, the retired lists and adding
+           slots */
+        pthread_mutex_t retire_lock;
+        unsigned long epoch;
+        /* Slots of all threads that have used the map */
+        struct slot* slots;
+        /* Nodes removed in an even or odd epoch */
+        struct cnode* retired[2];
+};
+
+/* Random state of the thread, 0 until seeded */
+static __thread uint64_t rnd_state;
+/* Slots of the thread, by map id, 0 for an empty entry */
+static __thread struct slot_ref slot_cache[SLOT_CACHE];
+/* Source of map ids */
+static uint64_t next_id = 1;
+
+static struct cnode* alloc_node(void*, int);
+static void free_node(struct cnode*);
+/**
+ * Free a list of retired nodes.
+ * @param the first node.
+ * @return void.
+ */
+static void free_retired(struct cnode*);
+/**
+ * Enter an operation in the current epoch. Until the operation leaves
+ * no node it may reach is freed.
+ * If the thread has no slot and none can be allocated, the retire lock
+ * is held for the operation instead, which keeps any node from being
+ * freed.
+ * @param the map.
+ * @return the slot of the thread, NULL if the retire lock is held.
+ */
+static struct slot* enter(const struct cmap*);
+/**
+ * Leave an operation.
+ * @param the map.
+ * @param the slot returned by enter.
+ * @return void.
+ */
+static void leave(const struct cmap*, struct slot*);
+/**
+ * Return the slot of the calling thread, creating it on first use.
+ * @param the map.
+ * @return the slot, NULL if no memory could be allocated.
+ */
+static struct slot* own_slot(struct cmap*);
+/**
+ * Retire a removed node, and advance the epoch if possible.
+ * Must be called after leaving the operation that removed the node.
+ * @param the map.
+ * @param the unlinked node.
+ * @return void.
+ */
+static void retire(struct cmap*, struct cnode*);
+static int insert(struct cmap*, void*);
+static void* find(const struct cmap*, const void*);
+/**
+ * Remove an item from the skip list.
+ * @param the map.
+ * @param the item.
+ * @param the removed item, written.
+ * @return the unlinked node, or NULL if not found.
+ */
+static struct cnode* detach(struct cmap*, const void*, void**);
+/**
+ * Locate the predecessors and successors of an item at all levels.
+ * @param the map.
+ * @param the item.
+ * @param array of MAX_LEVEL predecessors, written.
+ * @param array of MAX_LEVEL successors, written.
+ * @return the highest level where a node with the same order was found,
+ *         -1 if not found.
+ */
+static int locate(const struct cmap*, const void*,
+                  struct cnode**, struct cnode**);
+/**
+ * Unlock the predecessors locked from level 0 to top.
+ * @param the predecessors.
+ * @param highest locked level.
+ * @return void.
+ */
+static void unlock_preds(struct cnode**, int);
+/**
+ * Draw a random level with geometric distribution, from the random
+ * state of the calling thread.
+ * @param the map.
+ * @return level in [0, MAX_LEVEL).
+ */
+static int random_level(struct cmap*);
+/**
+ * Return the first present node with higher order than the item, or
+ * with the same or higher order if inclusive is set.
+ * @param the map.
+ * @param the item.
+ * @param non zero for same or higher order.
+ * @return the node, or NULL.
+ */
+static struct cnode* bound(const struct cmap*, const void*, int);
+
+struct cmap* cmap_create(btree_cmp cmp)
+{
+        struct cmap* m = malloc(sizeof(struct cmap));
+
+        if (m == NULL)
+        {
+                return NULL;
+        }
+
+        m->head = alloc_node(NULL, MAX_LEVEL - 1);
+        if (m->head == NULL)
+        {
+                free(m);
+                return NULL;
+        }
+        m->head->fully_linked = 1;
+        m->cmp = cmp;
+        m->len = 0;
+        m->seed = 0;
+        m->id = FETCH_ADD(&next_id, 1);
+        m->epoch = 0;
+        m->slots = NULL;
+        m->retired[0] = NULL;
+        m->retired[1] = NULL;
+        pthread_mutex_init(&m->retire_lock, NULL);
+
+        return m;
+}
+
+void cmap_destroy(struct cmap* m)
+{
+        struct cnode* n = m->head;
+
+        while (n)
+        {
+                struct cnode* next = n->next[0];
+
+                free_node(n);
+                n = next;
+        }
+
+        cmap_reclaim(m);
+        while (m->slots)
+        {
+                struct slot* next = m->slots->next;
+
+                free(m->slots->mem);
+                m->slots = next;
+        }
+        pthread_mutex_destroy(&m->retire_lock);
+        free(m);
+}
+
+int cmap_insert(struct cmap* m, void* d)
+{
+        struct slot* s = enter(m);
+        int ret = insert(m, d);
+
+        leave(m, s);
+
+        return ret;
+}
+
+void* cmap_find(const struct cmap* m, const void* d)
+{
+        struct slot* s = enter(m);
+        void* ret = find(m, d);
+
+        leave(m, s);
+
+        return ret;
+}
+
+void* cmap_lower_bound(const struct cmap* m, const void* d)
+{
+        struct slot* s = enter(m);
+        struct cnode* n = bound(m, d, 1);
+        void* ret = n ? LOAD(&n->data) : NULL;
+
+        leave(m, s);
+
+        return ret;
+}
+
+void* cmap_upper_bound(const struct cmap* m, const void* d)
+{
+        struct slot* s = enter(m);
+        struct cnode* n = bound(m, d, 0);
+        void* ret = n ? LOAD(&n->data) : NULL;
+
+        leave(m, s);
+
+        return ret;
+}
+
+void* cmap_remove(struct cmap* m, const void* d)
+{
+        struct slot* s = enter(m);
+        void* ret = NULL;
+        struct cnode* victim = detach(m, d, &ret);
+
+        leave(m, s);
+        if (victim)
+        {
+                /* Readers may still visit the node */
+                retire(m, victim);
+        }
+
+        return ret;
+}
+
+size_t cmap_size(const struct cmap* m)
+{
+        return LOAD(&m->len);
+}
+
+void cmap_reclaim(struct cmap* m)
+{
+        free_retired(m->retired[0]);
+        free_retired(m->retired[1]);
+        m->retired[0] = NULL;
+        m->retired[1] = NULL;
+}
+
+static int insert(struct cmap* m, void* d)
+{
+        struct cnode* preds[MAX_LEVEL];
+        struct cnode* succs[MAX_LEVEL];
+        int top = random_level(m);
+
+        for (;;)
+        {
+                struct cnode* new;
+                struct cnode* prev = NULL;
+                int found = locate(m, d, preds, succs);
+                int locked = -1;
+                int valid = 1;
+
+                if (found >= 0)
+                {
+                        struct cnode* n = succs[found];
+
+                        if (!LOAD(&n->marked))
+                        {
+                                /* Wait until the node is linked at
+                                   all levels, then replace */
+                                while (!LOAD(&n->fully_linked))
+                                {
+                                        ;
+                                }
+                                STORE(&n->data, d);
+                                return 0;
+                        }
+                        /* Node is being removed, try again */
+                        continue;
+                }
+
+                for (int l = 0; valid && l <= top; l++)
+                {
+                        struct cnode* pred = preds[l];
+                        struct cnode* succ = succs[l];
+
+                        if (pred != prev)
+                        {
+                                pthread_mutex_lock(&pred->lock);
+                                prev = pred;
+                        }
+                        locked = l;
+                        valid = !LOAD(&pred->marked) &&
+                                (succ == NULL || !LOAD(&succ->marked)) &&
+                                LOAD(&pred->next[l]) == succ;
+                }
+                if (!valid)
+                {
+                        unlock_preds(preds, locked);
+                        continue;
+                }
+
+                new = alloc_node(d, top);
+                if (new == NULL)
+                {
+                        unlock_preds(preds, locked);
+                        return -1;
+                }
+                for (int l = 0; l <= top; l++)
+                {
+                        new->next[l] = succs[l];
+                }
+                for (int l = 0; l <= top; l++)
+                {
+                        STORE(&preds[l]->next[l], new);
+                }
+                STORE(&new->fully_linked, 1);
+                unlock_preds(preds, locked);
+                FETCH_ADD(&m->len, 1);
+
+                return 0;
+        }
+}
+
+static void* find(const struct cmap* m, const void* d)
+{
+        struct cnode* pred = m->head;
+
+        for (int l = MAX_LEVEL - 1; l >= 0; l--)
+        {
+                struct cnode* curr = LOAD(&pred->next[l]);
+
+                while (curr)
+                {
+                        int c = m->cmp(LOAD(&curr->data), d);
+
+                        if (c == 0)
+                        {
+                                if (LOAD(&curr->fully_linked) &&
+                                    !LOAD(&curr->marked))
+                                {
+                                        return LOAD(&curr->data);
+                                }
+                                return NULL;
+                        }
+                        if (c > 0)
+                        {
+                                break;
+                        }
+                        pred = curr;
+                        curr = LOAD(&pred->next[l]);
+                }
+        }
+
+        return NULL;
+}
+
+static struct cnode* detach(struct cmap* m, const void* d, void** ret)
+{
+        struct cnode* preds[MAX_LEVEL];
+        struct cnode* succs[MAX_LEVEL];
+        struct cnode* victim = NULL;
+        int is_marked = 0;
+        int top = -1;
+
+        for (;;)
+        {
+                struct cnode* prev = NULL;
+                int found = locate(m, d, preds, succs);
+                int locked = -1;
+                int valid = 1;
+
+                if (!is_marked)
+                {
+                        if (found < 0)
+                        {
+                                return NULL;
+                        }
+
+                        victim = succs[found];
+                        /* Only remove a fully linked node found at its
+                           top level, otherwise it's being inserted or
+                           removed by someone else */
+                        if (!LOAD(&victim->fully_linked) ||
+                            victim->top != found ||
+                            LOAD(&victim->marked))
+                        {
+                                return NULL;
+                        }
+
+                        top = victim->top;
+                        pthread_mutex_lock(&victim->lock);
+                        if (victim->marked)
+                        {
+                                pthread_mutex_unlock(&victim->lock);
+                                return NULL;
+                        }
+                        /* Logically removed */
+                        STORE(&victim->marked, 1);
+                        is_marked = 1;
+                }
+
+                for (int l = 0; valid && l <= top; l++)
+                {
+                        struct cnode* pred = preds[l];
+
+                        if (pred != prev)
+                        {
+                                pthread_mutex_lock(&pred->lock);
+                                prev = pred;
+                        }
+                        locked = l;
+                        valid = !LOAD(&pred->marked) &&
+                                LOAD(&pred->next[l]) == victim;
+                }
+                if (!valid)
+                {
+                        unlock_preds(preds, locked);
+                        continue;
+                }
+
+                /* Physically removed, top down */
+                for (int l = top; l >= 0; l--)
+                {
+                        STORE(&preds[l]->next[l], victim->next[l]);
+                }
+                *ret = LOAD(&victim->data);
+                pthread_mutex_unlock(&victim->lock);
+                unlock_preds(preds, locked);
+                FETCH_ADD(&m->len, (size_t)-1);
+
+                return victim;
+        }
+}
+
+static struct cnode* alloc_node(void* d, int top)
+{
+        struct cnode* n = malloc(sizeof(struct cnode) +
+                                 (top + 1) * sizeof(struct cnode*));
+
+        if (n == NULL)
+        {
+                return NULL;
+        }
+
+        n->data = d;
+        n->marked = 0;
+        n->fully_linked = 0;
+        n->top = top;
+        n->retired = NULL;
+        for (int l = 0; l <= top; l++)
+        {
+                n->next[l] = NULL;
+        }
+        pthread_mutex_init(&n->lock, NULL);
+
+        return n;
+}
+
+static void free_node(struct cnode* n)
+{
+        pthread_mutex_destroy(&n->lock);
+        free(n);
+}
+
+static void free_retired(struct cnode* n)
+{
+        while (n)
+        {
+                struct cnode* next = n->retired;
+
+                free_node(n);
+                n = next;
+        }
+}
+
+static struct slot* enter(const struct cmap* m)
+{
+        struct cmap* w = (struct cmap*)m;
+        struct slot* s = own_slot(w);
+
+        if (s == NULL)
+        {
+                pthread_mutex_lock(&w->retire_lock);
+                return NULL;
+        }
+
+        /* If the epoch advanced since the load, the operation holds
+           back the next advance, while the nodes freed by this advance
+           were unlinked before the operation started. */
+        EXCHANGE_SC(&s->state, (LOAD_SC(&w->epoch) << 1) | 1);
+
+        return s;
+}
+
+static void leave(const struct cmap* m, struct slot* s)
+{
+        if (s == NULL)
+        {
+                pthread_mutex_unlock(&((struct cmap*)m)->retire_lock);
+                return;
+        }
+        STORE(&s->state, 0UL);
+}
+
+static struct slot* own_slot(struct cmap* m)
+{
+        struct slot_ref* ref = &slot_cache[m->id % SLOT_CACHE];
+        pthread_t self;
+        struct slot* s;
+        void* mem;
+
+        if (ref->id == m->id)
+        {
+                return ref->slot;
+        }
+
+        /* The entry was evicted by another map, or this is the first
+           use of the map */
+        self = pthread_self();
+        pthread_mutex_lock(&m->retire_lock);
+        for (s = m->slots; s; s = s->next)
+        {
+                /* A thread may get the id of one that has exited,
+                   which is out of any operation */
+                if (pthread_equal(s->owner, self))
+                {
+                        break;
+                }
+        }
+        if (s == NULL && (mem = malloc(2 * CACHE_LINE)) != NULL)
+        {
+                uintptr_t line = ((uintptr_t)mem + CACHE_LINE - 1) &
+                        ~(uintptr_t)(CACHE_LINE - 1);
+
+                s = (struct slot*)line;
+                s->state = 0;
+                s->owner = self;
+                s->mem = mem;
+                s->next = m->slots;
+                m->slots = s;
+        }
+        pthread_mutex_unlock(&m->retire_lock);
+        if (s)
+        {
+                ref->id = m->id;
+                ref->slot = s;
+        }
+
+        return s;
+}
+
+static void retire(struct cmap* m, struct cnode* n)
+{
+        unsigned long e;
+        unsigned int p;
+        int quiet = 1;
+
+        pthread_mutex_lock(&m->retire_lock);
+        e = m->epoch;
+        p = (unsigned int)(e & 1);
+        n->retired = m->retired[p];
+        m->retired[p] = n;
+
+        /* Order the unlink of the node before reading the slots */
+        FENCE_SC();
+        for (struct slot* s = m->slots; quiet && s; s = s->next)
+        {
+                unsigned long state = LOAD(&s->state);
+
+                quiet = !(state & 1) || state == ((e << 1) | 1);
+        }
+
+        /* All operations in progress entered in this epoch, the nodes
+           retired in the previous one can't be reached by anyone */
+        if (quiet)
+        {
+                free_retired(m->retired[p ^ 1]);
+                m->retired[p ^ 1] = NULL;
+                STORE_SC(&m->epoch, e + 1);
+        }
+        pthread_mutex_unlock(&m->retire_lock);
+}
+
+static int locate(const struct cmap* m,
+                  const void* d,
+                  struct cnode** preds,
+                  struct cnode** succs)
+{
+        struct cnode* pred = m->head;
+        int found = -1;
+
+        for (int l = MAX_LEVEL - 1; l >= 0; l--)
+        {
+                struct cnode* curr = LOAD(&pred->next[l]);
+                int c = 1;
+
+                while (curr && (c = m->cmp(LOAD(&curr->data), d)) < 0)
+                {
+                        pred = curr;
+                        curr = LOAD(&pred->next[l]);
+                }
+                if (found < 0 && curr && c == 0)
+                {
+                        found = l;
+                }
+                preds[l] = pred;
+                succs[l] = curr;
+        }
+
+        return found;
+}
+
+static void unlock_preds(struct cnode** preds, int top)
+{
+        struct cnode* prev = NULL;
+
+        for (int l = 0; l <= top; l++)
+        {
+                if (preds[l] != prev)
+                {
+                        pthread_mutex_unlock(&preds[l]->lock);
+                        prev = preds[l];
+                }
+        }
+}
+
+static int random_level(struct cmap* m)
+{
+        uint64_t z = rnd_state;
+        int l = 0;
+
+        if (z == 0)
+        {
+                /* splitmix64 over a shared counter, once per thread */
+                z = FETCH_ADD(&m->seed, 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                z = (z ^ (z >> 31)) | 1;
+        }
+
+        /* xorshift64 */
+        z ^= z << 13;
+        z ^= z >> 7;
+        z ^= z << 17;
+        rnd_state = z;
+
+        /* p = 1/2 */
+        while ((z & 1) && l < MAX_LEVEL - 1)
+        {
+                l++;
+                z >>= 1;
+        }
+
+        return l;
+}
+
+static struct cnode* bound(const struct cmap* m, const void* d, int inclusive)
+{
+        struct cnode* pred = m->head;
+        struct cnode* curr = NULL;
+
+        for (int l = MAX_LEVEL - 1; l >= 0; l--)
+        {
+                curr = LOAD(&pred->next[l]);
+
+                while (curr)
+                {
+                        int c = m->cmp(LOAD(&curr->data), d);
+
+                        if (c > 0 || (inclusive && c == 0))
+                        {
+                                break;
+                        }
+                        pred = curr;
+                        curr = LOAD(&pred->next[l]);
+                }
+        }
+
+        /* Skip nodes that are not present */
+        while (curr &&
+               (!LOAD(&curr->fully_linked) || LOAD(&curr->marked)))
+        {
+                curr = LOAD(&curr->next[0]);
+        }
+
+        return curr;
+}
@@ -0,0 +1,111 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#ifndef __CMAP_H__
+#define __CMAP_H__
+
+#include <stddef.h>
+#include "btree.h"
+
+struct cmap;
+
+/*
+ * Concurrent ordered map with the same ordering contract as btree.
+ * Lookups take no locks and never block. Insert and remove lock only
+ * the nodes adjacent to the modified position, so writers operating on
+ * different parts of the map proceed in parallel.
+ * Removed nodes are freed by later removes once no operation that
+ * may still be visiting them is in progress (epoch based reclamation),
+ * so memory stays bounded under continuous concurrent updates. A thread
+ * stalled inside an operation holds back reclamation until it returns.
+ * Each thread announces its operations in a slot of its own, allocated
+ * on its first use of the map and kept until the map is destroyed, so
+ * lookups write no memory shared with other threads.
+ */
+
+/**
+ * Create an empty concurrent map.
+ * @param the compare method to use.
+ * @return the map, or NULL on failure.
+ */
+extern struct cmap* cmap_create(btree_cmp);
+
+/**
+ * Destroy the map and free any memory occupied.
+ * Must not be called concurrently with any other operation.
+ * @param the map to destroy.
+ * @return void.
+ */
+extern void cmap_destroy(struct cmap*);
+
+/**
+ * Insert an item into the map.
+ * If an item with the same order is present, it will be replaced with the
+ * new value.
+ * @param the map.
+ * @param the item to insert.
+ * @return 0 on success, -1 if no memory could be allocated.
+ */
+extern int cmap_insert(struct cmap*, void*);
+
+/**
+ * Search for an item in the map. Never blocks.
+ * @param the map.
+ * @param the item to look for.
+ * @return the item, or NULL if not found.
+ */
+extern void* cmap_find(const struct cmap*, const void*);
+
+/**
+ * Find the first item in the map with the same or higher order than the
+ * provided item. Never blocks.
+ * @param the map.
+ * @param the item to compare with.
+ * @return the item, or NULL if no such item exists.
+ */
+extern void* cmap_lower_bound(const struct cmap*, const void*);
+
+/**
+ * Find the first item in the map with higher order than the provided
+ * item. Never blocks.
+ * @param the map.
+ * @param the item to compare with.
+ * @return the item, or NULL if no such item exists.
+ */
+extern void* cmap_upper_bound(const struct cmap*, const void*);
+
+/**
+ * Remove an item from the map.
+ * @param the map.
+ * @param the item to remove.
+ * @return the item, or NULL if not found.
+ */
+extern void* cmap_remove(struct cmap*, const void*);
+
+/**
+ * Return the number of items in the map.
+ * @param the map.
+ * @return the number of items in the map.
+ */
+extern size_t cmap_size(const struct cmap*);
+
+/**
+ * Free the nodes of all removed items, including those not yet freed by
+ * the epoch based reclamation.
+ * Must not be called concurrently with any other operation.
+ * @param the map.
+ * @return void.
+ */
+extern void cmap_reclaim(struct cmap*);
+
+#endif /* __CMAP_H__ */
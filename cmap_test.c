@@ -0,0 +1,387 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <scut.h>
+#include <pthread.h>
+#include "cmap.h"
+
+#define THREADS 4
+#define PER_THREAD 20000
+
+static int test_cmap_insert(void);
+static int test_cmap_remove(void);
+static int test_cmap_bounds(void);
+static int test_cmap_concurrent(void);
+static int test_cmap_churn(void);
+static int test_cmap_many(void);
+static int cmp_lng(const void*, const void*);
+
+struct worker
+{
+        struct cmap* m;
+        long id;
+        long errors;
+};
+
+int test_cmap(void)
+{
+        int ret;
+
+        scut_create("Test concurrent map");
+
+        SCUT_ADD(test_cmap_insert);
+        SCUT_ADD(test_cmap_remove);
+        SCUT_ADD(test_cmap_bounds);
+        SCUT_ADD(test_cmap_concurrent);
+        SCUT_ADD(test_cmap_churn);
+        SCUT_ADD(test_cmap_many);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+static int cmp_lng(const void* a, const void* b)
+{
+        long s1 = (long)a;
+        long s2 = (long)b;
+        int ret = 0;
+
+        if (s1 > s2)
+        {
+                ret = 1;
+        }
+        if (s1 < s2)
+        {
+                ret = -1;
+        }
+
+        return ret;
+}
+
+static int test_cmap_insert(void)
+{
+        struct cmap* m = cmap_create(&cmp_lng);
+
+        SCUT_ASSERT_TRUE(m);
+        SCUT_ASSERT_IE(cmap_size(m), 0);
+        SCUT_ASSERT_FALSE(cmap_find(m, (void*)1l));
+
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(cmap_insert(m, (void*)((i * 7919) % 1000 + 1)), 0);
+        }
+        /* Replace */
+        SCUT_ASSERT_IE(cmap_insert(m, (void*)10l), 0);
+        SCUT_ASSERT_IE(cmap_size(m), 1000);
+
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(cmap_find(m, (void*)i), i);
+        }
+        SCUT_ASSERT_FALSE(cmap_find(m, (void*)1001l));
+
+        cmap_destroy(m);
+
+        return 0;
+}
+
+static int test_cmap_remove(void)
+{
+        struct cmap* m = cmap_create(&cmp_lng);
+
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(cmap_insert(m, (void*)i), 0);
+        }
+        for (long i = 2; i <= 1000; i += 2)
+        {
+                SCUT_ASSERT_IE(cmap_remove(m, (void*)i), i);
+        }
+        SCUT_ASSERT_FALSE(cmap_remove(m, (void*)2l));
+        SCUT_ASSERT_IE(cmap_size(m), 500);
+
+        for (long i = 1; i <= 1000; i++)
+        {
+                if (i % 2)
+                {
+                        SCUT_ASSERT_IE(cmap_find(m, (void*)i), i);
+                }
+                else
+                {
+                        SCUT_ASSERT_FALSE(cmap_find(m, (void*)i));
+                }
+        }
+
+        cmap_reclaim(m);
+        SCUT_ASSERT_IE(cmap_insert(m, (void*)2l), 0);
+        SCUT_ASSERT_IE(cmap_find(m, (void*)2l), 2l);
+
+        cmap_destroy(m);
+
+        return 0;
+}
+
+static int test_cmap_bounds(void)
+{
+        struct cmap* m = cmap_create(&cmp_lng);
+
+        SCUT_ASSERT_FALSE(cmap_lower_bound(m, (void*)1l));
+
+        for (long i = 10; i <= 100; i += 10)
+        {
+                SCUT_ASSERT_IE(cmap_insert(m, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(cmap_remove(m, (void*)50l), 50l);
+
+        SCUT_ASSERT_IE(cmap_lower_bound(m, (void*)1l), 10l);
+        SCUT_ASSERT_IE(cmap_lower_bound(m, (void*)40l), 40l);
+        SCUT_ASSERT_IE(cmap_lower_bound(m, (void*)41l), 60l);
+        SCUT_ASSERT_FALSE(cmap_lower_bound(m, (void*)101l));
+        SCUT_ASSERT_IE(cmap_upper_bound(m, (void*)40l), 60l);
+        SCUT_ASSERT_IE(cmap_upper_bound(m, (void*)99l), 100l);
+        SCUT_ASSERT_FALSE(cmap_upper_bound(m, (void*)100l));
+
+        cmap_destroy(m);
+
+        return 0;
+}
+
+static void* writer(void* a)
+{
+        struct worker* w = a;
+        long base = w->id * PER_THREAD;
+
+        for (long i = 1; i <= PER_THREAD; i++)
+        {
+                if (cmap_insert(w->m, (void*)(base + i)))
+                {
+                        w->errors++;
+                }
+        }
+        /* Remove every odd item */
+        for (long i = 1; i <= PER_THREAD; i += 2)
+        {
+                if (cmap_remove(w->m, (void*)(base + i)) != (void*)(base + i))
+                {
+                        w->errors++;
+                }
+        }
+
+        return NULL;
+}
+
+static void* reader(void* a)
+{
+        struct worker* w = a;
+
+        /* Items that are never removed must always be found once
+           present, the pre-filled range must always be found */
+        for (int r = 0; r < 4; r++)
+        {
+                for (long i = 1; i <= PER_THREAD; i++)
+                {
+                        long v = -i;
+
+                        if (cmap_find(w->m, (void*)v) != (void*)v)
+                        {
+                                w->errors++;
+                        }
+                }
+        }
+
+        return NULL;
+}
+
+static int test_cmap_concurrent(void)
+{
+        struct cmap* m = cmap_create(&cmp_lng);
+        struct worker w[2 * THREADS];
+        pthread_t thr[2 * THREADS];
+
+        for (long i = 1; i <= PER_THREAD; i++)
+        {
+                SCUT_ASSERT_IE(cmap_insert(m, (void*)(-i)), 0);
+        }
+
+        for (long i = 0; i < 2 * THREADS; i++)
+        {
+                w[i].m = m;
+                w[i].id = i;
+                w[i].errors = 0;
+                pthread_create(&thr[i],
+                               NULL,
+                               i < THREADS ? &writer : &reader,
+                               &w[i]);
+        }
+        for (int i = 0; i < 2 * THREADS; i++)
+        {
+                pthread_join(thr[i], NULL);
+                SCUT_ASSERT_IE(w[i].errors, 0);
+        }
+
+        SCUT_ASSERT_IE(cmap_size(m), PER_THREAD + THREADS * PER_THREAD / 2);
+        for (long t = 0; t < THREADS; t++)
+        {
+                for (long i = 1; i <= PER_THREAD; i++)
+                {
+                        void* e = cmap_find(m, (void*)(t * PER_THREAD + i));
+
+                        if (i % 2)
+                        {
+                                SCUT_ASSERT_FALSE(e);
+                        }
+                        else
+                        {
+                                SCUT_ASSERT_IE(e, t * PER_THREAD + i);
+                        }
+                }
+        }
+
+        cmap_destroy(m);
+
+        return 0;
+}
+
+static void* churner(void* a)
+{
+        struct worker* w = a;
+        long base = w->id * 64;
+
+        /* Insert and remove the same few items over and over, removed
+           nodes are freed while other threads run */
+        for (long i = 0; i < PER_THREAD; i++)
+        {
+                long v = base + i % 64 + 1;
+
+                if (cmap_insert(w->m, (void*)v) ||
+                    cmap_remove(w->m, (void*)v) != (void*)v)
+                {
+                        w->errors++;
+                }
+        }
+
+        return NULL;
+}
+
+static void* scanner(void* a)
+{
+        struct worker* w = a;
+
+        /* Walk over nodes that are concurrently removed and freed, the
+           pre-filled item is always found */
+        for (long i = 0; i < PER_THREAD; i++)
+        {
+                long v = i % (THREADS * 64) + 1;
+
+                cmap_lower_bound(w->m, (void*)v);
+                if (cmap_lower_bound(w->m, (void*)(THREADS * 64l + 1)) !=
+                    (void*)(THREADS * 64l + 1))
+                {
+                        w->errors++;
+                }
+        }
+
+        return NULL;
+}
+
+static int test_cmap_churn(void)
+{
+        struct cmap* m = cmap_create(&cmp_lng);
+        struct worker w[2 * THREADS];
+        pthread_t thr[2 * THREADS];
+
+        SCUT_ASSERT_IE(cmap_insert(m, (void*)(THREADS * 64l + 1)), 0);
+        for (long i = 0; i < 2 * THREADS; i++)
+        {
+                w[i].m = m;
+                w[i].id = i;
+                w[i].errors = 0;
+                pthread_create(&thr[i],
+                               NULL,
+                               i < THREADS ? &churner : &scanner,
+                               &w[i]);
+        }
+        for (int i = 0; i < 2 * THREADS; i++)
+        {
+                pthread_join(thr[i], NULL);
+                SCUT_ASSERT_IE(w[i].errors, 0);
+        }
+        SCUT_ASSERT_IE(cmap_size(m), 1);
+
+        cmap_destroy(m);
+
+        return 0;
+}
+
+static int test_cmap_many(void)
+{
+        /* More maps than a thread keeps slots cached for */
+        struct cmap* m[20];
+        int n = (int)(sizeof(m) / sizeof(m[0]));
+
+        for (int i = 0; i < n; i++)
+        {
+                m[i] = cmap_create(&cmp_lng);
+        }
+        for (int round = 0; round < 3; round++)
+        {
+                for (long k = 1; k <= 200; k++)
+                {
+                        for (int i = 0; i < n; i++)
+                        {
+                                SCUT_ASSERT_IE(cmap_insert(m[i], (void*)k), 0);
+                        }
+                }
+                for (long k = 1; k <= 200; k++)
+                {
+                        for (int i = 0; i < n; i++)
+                        {
+                                SCUT_ASSERT_IE((long)cmap_find(m[i], (void*)k),
+                                               k);
+                                if (k % 2)
+                                {
+                                        SCUT_ASSERT_IE(
+                                                (long)cmap_remove(m[i],
+                                                                  (void*)k),
+                                                k);
+                                }
+                        }
+                }
+                for (int i = 0; i < n; i++)
+                {
+                        SCUT_ASSERT_IE(cmap_size(m[i]), 100);
+                }
+
+                /* New maps must not pick up the slots of the old ones */
+                for (int i = 0; i < n; i += 2)
+                {
+                        cmap_destroy(m[i]);
+                        m[i] = cmap_create(&cmp_lng);
+                }
+                for (int i = 1; i < n; i += 2)
+                {
+                        for (long k = 2; k <= 200; k += 2)
+                        {
+                                cmap_remove(m[i], (void*)k);
+                        }
+                }
+        }
+        for (int i = 0; i < n; i++)
+        {
+                cmap_destroy(m[i]);
+        }
+
+        return 0;
+}
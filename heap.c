@@ -12,29 +12,208 @@
 */
 
 #include "heap.h"
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define LEFT(x) (2 * x + 1)
-#define RIGHT(x) (2 * x + 2)
-#define PARENT(x) ((x - 1) / 2)
+/* Children of x are CHILD(x) to CHILD(x) + arity - 1 */
+#define CHILD(h, x) (((x) << (h)->shift) + 1)
+#define PARENT(h, x) (((x) - 1) >> (h)->shift)
+#define CACHE_LINE 64
+#define MAX_ARITY 16
+/* Marks a free handle, the remaining bits link to the next free one */
+#define FREE_HANDLE ((size_t)1 << (sizeof(size_t) * 8 - 1))
+/* End of the free list, kept when marked as free */
+#define NO_HANDLE (~FREE_HANDLE)
 
 struct heap
 {
         void** items;
+        /* The allocation, items is offset into it */
+        void* mem;
         heap_cmp cmp;
         size_t size;
         size_t cap;
+        unsigned int arity;
+        unsigned int shift;
+        /* For an addressable heap, the handle of the item at each
+           position, and the position of each handle */
+        size_t* hnd;
+        size_t* pos;
+        size_t nhnd;
+        size_t free_hnd;
 };
 
+/**
+ * Reallocate the item array, placing the children of each node within
+ * as few cache lines as possible.
+ * @param the heap.
+ * @param the new capacity.
+ * @return 0 on success, -1 if no memory could be allocated.
+ */
+static int grow(struct heap*, size_t);
+
+/**
+ * Create an empty heap.
+ * @param the order method.
+ * @param the arity.
+ * @param the flags.
+ * @param the initial capacity.
+ * @return the heap, or NULL on failure.
+ */
+static struct heap* create(heap_cmp, unsigned int, unsigned int, size_t);
+
+/**
+ * Allocate a handle for a new item.
+ * @param the heap.
+ * @return the handle, or NO_HANDLE if the heap is not addressable.
+ */
+static size_t new_handle(struct heap*);
+
+/**
+ * Append items after the current items, and give them handles if the
+ * heap is addressable. The heap must have capacity for the items.
+ * @param the heap.
+ * @param the items.
+ * @param the number of items.
+ * @param array to write the handles to, or NULL.
+ * @return void.
+ */
+static void append(struct heap*, void**, size_t, size_t*);
+
+/**
+ * Restore the heap property for all items, bottom up in O(n).
+ * @param the heap.
+ * @return void.
+ */
+static void heapify(struct heap*);
+
+/**
+ * Store an item, and its handle if the heap is addressable.
+ * @param the heap.
+ * @param the position.
+ * @param the item.
+ * @param the handle.
+ * @return void.
+ */
+static void place(struct heap*, size_t, void*, size_t);
+
+/**
+ * Move an item down from a position until the heap is ordered.
+ * @param the heap.
+ * @param the position to start at.
+ * @param the item.
+ * @param the handle of the item.
+ * @return void.
+ */
+static void sift_down(struct heap*, size_t, void*, size_t);
+
+/**
+ * Move an item up from a position until the heap is ordered.
+ * @param the heap.
+ * @param the position to start at.
+ * @param the item.
+ * @param the handle of the item.
+ * @return void.
+ */
+static void sift_up(struct heap*, size_t, void*, size_t);
+
+/**
+ * Remove the item at a position, the handle is not released.
+ * @param the heap.
+ * @param the position.
+ * @return void.
+ */
+static void remove_at(struct heap*, size_t);
+
 struct heap* heap_create(heap_cmp cmp)
 {
-        struct heap* h = malloc(sizeof(struct heap));
-        size_t cap = 128; /* first guess of size */
-        
-        h->items = malloc(cap * sizeof(void*));
+        return heap_create_arity(cmp, 2);
+}
+
+struct heap* heap_create_arity(heap_cmp cmp, unsigned int arity)
+{
+        return heap_create_flags(cmp, arity, 0);
+}
+
+struct heap* heap_create_flags(heap_cmp cmp,
+                               unsigned int arity,
+                               unsigned int flags)
+{
+        /* first guess of size */
+        return create(cmp, arity, flags, 128);
+}
+
+struct heap* heap_create_cap(heap_cmp cmp, size_t cap)
+{
+        return create(cmp, 2, 0, cap);
+}
+
+struct heap* heap_create_from(heap_cmp cmp, void** items, size_t n)
+{
+        struct heap* h = create(cmp, 2, 0, n);
+
+        if (h == NULL)
+        {
+                return NULL;
+        }
+        append(h, items, n, NULL);
+        heapify(h);
+
+        return h;
+}
+
+static struct heap* create(heap_cmp cmp,
+                           unsigned int arity,
+                           unsigned int flags,
+                           size_t cap)
+{
+        struct heap* h;
+        unsigned int shift = 0;
+
+        /* Arity must be a power of two */
+        if (arity < 2 || arity > MAX_ARITY || (arity & (arity - 1)))
+        {
+                return NULL;
+        }
+        while ((1u << shift) < arity)
+        {
+                shift++;
+        }
+
+        if (cap == 0)
+        {
+                cap = 1;
+        }
+        h = malloc(sizeof(struct heap));
+        if (h == NULL)
+        {
+                return NULL;
+        }
+        h->items = NULL;
+        h->mem = NULL;
         h->cmp = cmp;
         h->size = 0L;
-        h->cap = cap;
+        h->cap = 0L;
+        h->arity = arity;
+        h->shift = shift;
+        h->hnd = NULL;
+        h->pos = NULL;
+        h->nhnd = 0;
+        h->free_hnd = NO_HANDLE;
+        if (flags & HEAP_ADDRESSABLE)
+        {
+                h->hnd = malloc(cap * sizeof(size_t));
+                h->pos = malloc(cap * sizeof(size_t));
+        }
+        if (((flags & HEAP_ADDRESSABLE) && (h->hnd == NULL || h->pos == NULL))
+            || grow(h, cap))
+        {
+                free(h->hnd);
+                free(h->pos);
+                free(h);
+                return NULL;
+        }
 
         return h;
 }
@@ -42,94 +221,190 @@ struct heap* heap_create(heap_cmp cmp)
 void heap_clear(struct heap* h)
 {
         h->size = 0L;
+        h->nhnd = 0;
+        h->free_hnd = NO_HANDLE;
 }
 
 void* heap_min(struct heap* h)
 {
+        void* ret;
+
         if (h->size == 0)
         {
                 return NULL;
         }
 
-        void* ret = h->items[0];
-        void* k = h->items[h->size - 1];
+        ret = h->items[0];
+        if (h->hnd)
+        {
+                size_t hd = h->hnd[0];
 
-        /* Restore partial ordering property */
-        size_t m = 0;
+                h->pos[hd] = FREE_HANDLE | h->free_hnd;
+                h->free_hnd = hd;
+        }
+        remove_at(h, 0);
+
+        return ret;
+}
 
-        /* Take the least ordered element and let it move down the
-           tree */
-        while ((LEFT(m) < h->size && 
-                h->cmp(h->items[LEFT(m)], k) > 0 ) ||
-               (RIGHT(m) < h->size && 
-                h->cmp(h->items[RIGHT(m)], k) > 0 ))
+void* heap_peek(const struct heap* h)
+{
+        if (h->size == 0)
         {
-                size_t p;
+                return NULL;
+        }
 
-                if (RIGHT(m) < h->size)
-                {
-                        /* Two children */
-                        if (h->cmp(h->items[LEFT(m)], h->items[RIGHT(m)]) > 0)
-                        {
-                                p = LEFT(m);
-                        }
-                        else
-                        {
-                                p = RIGHT(m);
-                        }
-                }
-                else 
+        return h->items[0];
+}
+
+void* heap_replace_top(struct heap* h, void* e)
+{
+        void* ret;
+
+        if (h->size == 0)
+        {
+                /* There is no handle to take over, and the caller
+                   has no way to learn a new one */
+                if (h->hnd)
                 {
-                        /* Only one children, last leaf in tree */
-                        p = h->size - 1;
+                        return e;
                 }
-                /* Move child up */
-                h->items[m] = h->items[p];
-                /* Continue down the tree */
-                m = p;
+                return heap_insert(h, e) ? e : NULL;
         }
-        h->items[m] = k;
-        h->size--;
+
+        /* The new item takes over the position and handle of the top,
+           one sift down instead of a sift down and a sift up */
+        ret = h->items[0];
+        sift_down(h, 0, e, h->hnd ? h->hnd[0] : NO_HANDLE);
 
         return ret;
 }
 
+void* heap_pushpop(struct heap* h, void* e)
+{
+        /* The new item would be extracted immediately */
+        if (h->size == 0 || h->cmp(h->items[0], e) <= 0)
+        {
+                return e;
+        }
+
+        return heap_replace_top(h, e);
+}
+
 int heap_insert(struct heap* h, void* e)
 {
-        size_t m = h->size;
-        size_t p;
+        size_t hd;
+
+        return heap_insert_handle(h, e, &hd);
+}
+
+int heap_insert_handle(struct heap* h, void* e, size_t* handle)
+{
+        size_t hd;
 
         /* Time to expand? */
-        if (h->size == h->cap)
+        if (h->size == h->cap && grow(h, h->cap * 2))
+        {
+                return -1;
+        }
+
+        hd = new_handle(h);
+        *handle = hd;
+
+        /* Restore partial ordering property */
+        sift_up(h, h->size, e, hd);
+        h->size++;
+        return 0;
+}
+
+int heap_insert_batch(struct heap* h, void** items, size_t n, size_t* handles)
+{
+        size_t old = h->size;
+
+        if (h->size + n > h->cap)
         {
-                size_t new_cap = h->cap * 2;
-                void* new = realloc(h->items, new_cap * sizeof(void*));
+                size_t cap = h->cap * 2;
 
-                if (new == NULL)
+                if (cap < h->size + n)
+                {
+                        cap = h->size + n;
+                }
+                if (grow(h, cap))
                 {
                         return -1;
                 }
+        }
 
-                h->cap = new_cap;
-                h->items = new;
+        append(h, items, n, handles);
+        if (n > old)
+        {
+                /* Cheaper to rebuild than to sift up each item */
+                heapify(h);
+        }
+        else
+        {
+                for (size_t i = old; i < h->size; i++)
+                {
+                        sift_up(h, i, h->items[i], h->hnd ? h->hnd[i] : NO_HANDLE);
+                }
         }
 
-        /* Restore partial ordering property */
-        p = PARENT(m);
-        while (m > 0 && h->cmp(h->items[p], e) < 0)
+        return 0;
+}
+
+int heap_reserve(struct heap* h, size_t cap)
+{
+        if (cap <= h->cap)
         {
-                /* Move all items down in the tree that are of lesser
-                   order than e */
-                h->items[m] = h->items[p];
-                m = p;
-                p = PARENT(m);
+                return 0;
+        }
+
+        return grow(h, cap);
+}
+
+int heap_update(struct heap* h, size_t handle)
+{
+        size_t m;
+
+        if (h->hnd == NULL || handle >= h->nhnd ||
+            (h->pos[handle] & FREE_HANDLE))
+        {
+                return -1;
+        }
+
+        m = h->pos[handle];
+        if (m > 0 && h->cmp(h->items[PARENT(h, m)], h->items[m]) < 0)
+        {
+                sift_up(h, m, h->items[m], handle);
+        }
+        else
+        {
+                sift_down(h, m, h->items[m], handle);
         }
 
-        h->items[m] = e;
-        h->size++;
         return 0;
 }
 
+void* heap_remove(struct heap* h, size_t handle)
+{
+        void* ret;
+        size_t m;
+
+        if (h->hnd == NULL || handle >= h->nhnd ||
+            (h->pos[handle] & FREE_HANDLE))
+        {
+                return NULL;
+        }
+
+        m = h->pos[handle];
+        ret = h->items[m];
+        h->pos[handle] = FREE_HANDLE | h->free_hnd;
+        h->free_hnd = handle;
+        remove_at(h, m);
+
+        return ret;
+}
+
 size_t heap_size(const struct heap* h)
 {
         return h->size;
@@ -137,7 +412,197 @@ size_t heap_size(const struct heap* h)
 
 void heap_destroy(struct heap* h)
 {
-        free(h->items);
+        free(h->hnd);
+        free(h->pos);
+        free(h->mem);
         free(h);
 }
 
+static int grow(struct heap* h, size_t cap)
+{
+        void* mem = malloc(cap * sizeof(void*) + CACHE_LINE);
+        uintptr_t first;
+        void** items;
+
+        if (mem == NULL)
+        {
+                return -1;
+        }
+        if (h->hnd)
+        {
+                size_t* hnd = realloc(h->hnd, cap * sizeof(size_t));
+                size_t* pos;
+
+                if (hnd == NULL)
+                {
+                        free(mem);
+                        return -1;
+                }
+                h->hnd = hnd;
+                pos = realloc(h->pos, cap * sizeof(size_t));
+                if (pos == NULL)
+                {
+                        free(mem);
+                        return -1;
+                }
+                h->pos = pos;
+        }
+
+        /* Align item 1, so the children of node x start at an offset
+           of x * arity items from a cache line boundary */
+        first = (uintptr_t)mem + sizeof(void*);
+        first = (first + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1);
+        items = (void**)(first - sizeof(void*));
+
+        if (h->size > 0)
+        {
+                memcpy(items, h->items, h->size * sizeof(void*));
+        }
+        free(h->mem);
+        h->mem = mem;
+        h->items = items;
+        h->cap = cap;
+
+        return 0;
+}
+
+static size_t new_handle(struct heap* h)
+{
+        size_t hd;
+
+        if (h->hnd == NULL)
+        {
+                return NO_HANDLE;
+        }
+        /* Reuse a released handle if possible, there are never more
+           handles than items */
+        if (h->free_hnd != NO_HANDLE)
+        {
+                hd = h->free_hnd;
+                h->free_hnd = h->pos[hd] & ~FREE_HANDLE;
+        }
+        else
+        {
+                hd = h->nhnd++;
+        }
+
+        return hd;
+}
+
+static void append(struct heap* h, void** items, size_t n, size_t* handles)
+{
+        for (size_t i = 0; i < n; i++)
+        {
+                size_t hd = new_handle(h);
+
+                if (handles)
+                {
+                        handles[i] = hd;
+                }
+                place(h, h->size++, items[i], hd);
+        }
+}
+
+static void heapify(struct heap* h)
+{
+        size_t m;
+
+        if (h->size < 2)
+        {
+                return;
+        }
+
+        /* Sift down every node with children, from the last one */
+        m = PARENT(h, h->size - 1) + 1;
+        while (m-- > 0)
+        {
+                sift_down(h, m, h->items[m], h->hnd ? h->hnd[m] : NO_HANDLE);
+        }
+}
+
+static void place(struct heap* h, size_t m, void* e, size_t hd)
+{
+        h->items[m] = e;
+        if (h->hnd)
+        {
+                h->hnd[m] = hd;
+                h->pos[hd] = m;
+        }
+}
+
+static void sift_down(struct heap* h, size_t m, void* k, size_t kh)
+{
+        void** items = h->items;
+        size_t c;
+
+        while ((c = CHILD(h, m)) < h->size)
+        {
+                size_t end = c + h->arity;
+                size_t p = c;
+
+                if (end > h->size)
+                {
+                        end = h->size;
+                }
+                /* Find the highest ordered child */
+                for (c++; c < end; c++)
+                {
+                        if (h->cmp(items[c], items[p]) > 0)
+                        {
+                                p = c;
+                        }
+                }
+                if (h->cmp(items[p], k) <= 0)
+                {
+                        break;
+                }
+                /* Move child up, and continue down the tree */
+                place(h, m, items[p], h->hnd ? h->hnd[p] : NO_HANDLE);
+                m = p;
+        }
+        place(h, m, k, kh);
+}
+
+static void sift_up(struct heap* h, size_t m, void* e, size_t eh)
+{
+        size_t p;
+
+        while (m > 0)
+        {
+                p = PARENT(h, m);
+                if (h->cmp(h->items[p], e) >= 0)
+                {
+                        break;
+                }
+                /* Move all items down in the tree that are of lesser
+                   order than e */
+                place(h, m, h->items[p], h->hnd ? h->hnd[p] : NO_HANDLE);
+                m = p;
+        }
+        place(h, m, e, eh);
+}
+
+static void remove_at(struct heap* h, size_t m)
+{
+        void* last;
+        size_t lh;
+
+        h->size--;
+        if (m == h->size)
+        {
+                return;
+        }
+
+        /* Take the last element and let it move into place, down the
+           tree, or up if it came from another branch */
+        last = h->items[h->size];
+        lh = h->hnd ? h->hnd[h->size] : NO_HANDLE;
+        if (m > 0 && h->cmp(h->items[PARENT(h, m)], last) < 0)
+        {
+                sift_up(h, m, last, lh);
+        }
+        else
+        {
+                sift_down(h, m, last, lh);
+        }
+}
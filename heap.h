@@ -17,6 +17,10 @@
 #include <stddef.h>
 
 struct heap;
+
+/* Track the position of each item, enables heap_update and heap_remove */
+#define HEAP_ADDRESSABLE 0x1
+
 /**
  * Compare the order two items.
  * When the heap_cmp method is called during execution, a will always be 
@@ -38,6 +42,60 @@ typedef int (*heap_cmp)(const void* a, const void* b);
  */
 struct heap* heap_create(heap_cmp);
 
+/**
+ * Create an empty heap where each node has the provided number of
+ * children. A higher arity gives a shallower heap, where the children
+ * of a node are stored within one cache line. This makes extracting
+ * items faster for large heaps, at the cost of more comparisons per
+ * level. An arity of 4 is often a good choice.
+ * heap_create creates a heap with arity 2.
+ * @param the order method to use when ordering the the heap.
+ * @param the arity, a power of two between 2 and 16.
+ * @return the newly created heap, or NULL if the arity is invalid or
+ *         no memory could be allocated.
+ */
+struct heap* heap_create_arity(heap_cmp, unsigned int);
+
+/**
+ * Create an empty heap with the provided arity and flags.
+ * An addressable heap returns a handle for each inserted item, that
+ * can be used to update the order of the item or to remove it.
+ * @param the order method to use when ordering the the heap.
+ * @param the arity, a power of two between 2 and 16.
+ * @param flags, HEAP_ADDRESSABLE or 0.
+ * @return the newly created heap, or NULL if the arity is invalid or
+ *         no memory could be allocated.
+ */
+struct heap* heap_create_flags(heap_cmp, unsigned int, unsigned int);
+
+/**
+ * Create an empty heap with room for the provided number of items before
+ * any memory is reallocated.
+ * @param the order method to use when ordering the the heap.
+ * @param the initial capacity.
+ * @return the newly created heap, or NULL on failure.
+ */
+struct heap* heap_create_cap(heap_cmp, size_t);
+
+/**
+ * Create a heap from an array of items in O(n), faster than inserting
+ * the items one by one. The array is copied. To create a heap with
+ * another arity or flags, use heap_insert_batch on an empty heap.
+ * @param the order method to use when ordering the the heap.
+ * @param the items.
+ * @param the number of items.
+ * @return the newly created heap, or NULL on failure.
+ */
+struct heap* heap_create_from(heap_cmp, void**, size_t);
+
+/**
+ * Make room for at least the provided number of items.
+ * @param the heap.
+ * @param the capacity.
+ * @return 0 on success, -1 if no memory could be allocated.
+ */
+int heap_reserve(struct heap*, size_t);
+
 /**
  * Clears all elements in the heap.
  * @param the heap to clear.
@@ -54,6 +112,38 @@ void heap_clear(struct heap*);
  */
 void* heap_min(struct heap*);
 
+/**
+ * Return the higest ordered item, without extracting it.
+ * @param the heap.
+ * @return the higest order item, or NULL if heap is empty.
+ */
+void* heap_peek(const struct heap*);
+
+/**
+ * Extract the higest ordered item and insert a new item, in a single
+ * pass down the heap. The new item is inserted even if it has higher
+ * order than the extracted one. On an addressable heap, the new item
+ * takes over the handle of the extracted item.
+ * @param the heap.
+ * @param the item to insert.
+ * @return the extracted item. If the heap was empty, NULL if the item
+ *         was inserted, the item if it could not be inserted. An empty
+ *         addressable heap has no handle to take over, the item is not
+ *         inserted and returned, use heap_insert_handle instead.
+ */
+void* heap_replace_top(struct heap*, void*);
+
+/**
+ * Insert a new item and extract the higest ordered item, in a single
+ * pass down the heap. If the new item has the highest order, it is
+ * returned and the heap is not modified. On an addressable heap, the
+ * new item takes over the handle of the extracted item.
+ * @param the heap.
+ * @param the item to insert.
+ * @return the extracted item, which may be the new item.
+ */
+void* heap_pushpop(struct heap*, void*);
+
 /**
  * Insert a new item into the heap.
  * @param the heap.
@@ -62,6 +152,49 @@ void* heap_min(struct heap*);
  */
 int heap_insert(struct heap*, void*);
 
+/**
+ * Insert a new item into the heap, and get a handle to it.
+ * The handle is valid until the item is extracted or removed, after that
+ * it may be reused for another item. Handles are small integers.
+ * @param the heap.
+ * @param the item to insert.
+ * @param the handle, written. Only meaningful if the heap is
+ *        addressable.
+ * @return 0 if the item was inserted, non-zero otherwise.
+ */
+int heap_insert_handle(struct heap*, void*, size_t*);
+
+/**
+ * Insert multiple items. Memory is allocated at most once. If more items
+ * are inserted than present in the heap, the heap is rebuilt in
+ * O(n), otherwise each item is inserted in O(log n).
+ * @param the heap.
+ * @param the items to insert.
+ * @param the number of items.
+ * @param array to write the handles of the items to, or NULL. Only
+ *        meaningful if the heap is addressable.
+ * @return 0 if the items were inserted, non-zero otherwise, in which
+ *         case no item is inserted.
+ */
+int heap_insert_batch(struct heap*, void**, size_t, size_t*);
+
+/**
+ * Restore the position of an item after its order has changed, in
+ * either direction. Runs in O(log n).
+ * @param the addressable heap.
+ * @param the handle of the item.
+ * @return 0 on success, -1 if the handle is not valid.
+ */
+int heap_update(struct heap*, size_t);
+
+/**
+ * Remove an item from the heap. Runs in O(log n).
+ * @param the addressable heap.
+ * @param the handle of the item.
+ * @return the item, or NULL if the handle is not valid.
+ */
+void* heap_remove(struct heap*, size_t);
+
 /**
  * Return the size of the heap.
  * @param the heap.
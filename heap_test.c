@@ -13,12 +13,19 @@
 
 #include <scut.h>
 #include "heap.h"
+#include <stdlib.h>
 
 static int test_heap_create(void);
 static int test_heap_insert(void);
 static int test_heap_clear(void);
 static int test_heap_min(void);
 static int test_heap_expand(void);
+static int test_heap_arity(void);
+static int test_heap_update(void);
+static int test_heap_remove(void);
+static int test_heap_create_from(void);
+static int test_heap_insert_batch(void);
+static int test_heap_replace(void);
 
 static int test_cmp(const void* a, const void* b)
 {
@@ -37,6 +44,19 @@ static int test_cmp(const void* a, const void* b)
         return 0;
 }
 
+/* Items of an addressable heap, ordered by key */
+struct keyed
+{
+        long key;
+        size_t handle;
+};
+
+static int key_cmp(const void* a, const void* b)
+{
+        return test_cmp((void*)((const struct keyed*)a)->key,
+                        (void*)((const struct keyed*)b)->key);
+}
+
 int test_heap(void)
 {
         int ret;
@@ -48,6 +68,12 @@ int test_heap(void)
         SCUT_ADD(test_heap_clear);
         SCUT_ADD(test_heap_min);
         SCUT_ADD(test_heap_expand);
+        SCUT_ADD(test_heap_arity);
+        SCUT_ADD(test_heap_update);
+        SCUT_ADD(test_heap_remove);
+        SCUT_ADD(test_heap_create_from);
+        SCUT_ADD(test_heap_insert_batch);
+        SCUT_ADD(test_heap_replace);
 
         ret = scut_run(0);
 
@@ -203,3 +229,327 @@ static int test_heap_expand(void)
         heap_destroy(h);
         return 0;
 }
+
+static int test_heap_arity(void)
+{
+        long size = 10000;
+
+        SCUT_ASSERT_IE(heap_create_arity(&test_cmp, 0), NULL);
+        SCUT_ASSERT_IE(heap_create_arity(&test_cmp, 1), NULL);
+        SCUT_ASSERT_IE(heap_create_arity(&test_cmp, 3), NULL);
+        SCUT_ASSERT_IE(heap_create_arity(&test_cmp, 32), NULL);
+
+        for (unsigned int a = 2; a <= 16; a *= 2)
+        {
+                struct heap* h = heap_create_arity(&test_cmp, a);
+
+                SCUT_ASSERT_TRUE(h);
+                /* Duplicates, out of order */
+                for (long i = 0; i < size; i++)
+                {
+                        SCUT_ASSERT_IE(heap_insert(h, (void*)((i * 7919) % (size / 2))), 0);
+                }
+                SCUT_ASSERT_IE(heap_size(h), size);
+                for (long i = 0; i < size; i++)
+                {
+                        SCUT_ASSERT_IE(heap_min(h), i / 2);
+                }
+                SCUT_ASSERT_IE(heap_min(h), NULL);
+
+                heap_destroy(h);
+        }
+
+        return 0;
+}
+
+static int test_heap_update(void)
+{
+        struct keyed items[1000];
+        long size = 1000;
+
+        for (unsigned int a = 2; a <= 8; a *= 2)
+        {
+                struct heap* h = heap_create_flags(&key_cmp, a, HEAP_ADDRESSABLE);
+                long prev = -size;
+
+                SCUT_ASSERT_TRUE(h);
+                for (long i = 0; i < size; i++)
+                {
+                        items[i].key = (i * 7919) % size;
+                        SCUT_ASSERT_IE(heap_insert_handle(h, &items[i],
+                                                          &items[i].handle), 0);
+                }
+
+                /* Move every third key up, and every third down */
+                for (long i = 0; i < size; i += 3)
+                {
+                        items[i].key -= 500;
+                        SCUT_ASSERT_IE(heap_update(h, items[i].handle), 0);
+                }
+                for (long i = 1; i < size; i += 3)
+                {
+                        items[i].key += 500;
+                        SCUT_ASSERT_IE(heap_update(h, items[i].handle), 0);
+                }
+                /* Unchanged keys */
+                for (long i = 2; i < size; i += 3)
+                {
+                        SCUT_ASSERT_IE(heap_update(h, items[i].handle), 0);
+                }
+
+                for (long i = 0; i < size; i++)
+                {
+                        struct keyed* k = heap_min(h);
+
+                        SCUT_ASSERT_TRUE(k);
+                        SCUT_ASSERT_TRUE(k->key >= prev);
+                        prev = k->key;
+                }
+                SCUT_ASSERT_IE(heap_size(h), 0);
+                /* Handles are released by heap_min */
+                SCUT_ASSERT_IE(heap_update(h, items[0].handle), -1);
+
+                heap_destroy(h);
+        }
+
+        return 0;
+}
+
+static int test_heap_remove(void)
+{
+        struct keyed items[1000];
+        long size = 1000;
+        struct heap* h = heap_create_flags(&key_cmp, 4, HEAP_ADDRESSABLE);
+        struct heap* p = heap_create(&key_cmp);
+        size_t hd;
+
+        for (long i = 0; i < size; i++)
+        {
+                items[i].key = (i * 7919) % size;
+                SCUT_ASSERT_IE(heap_insert_handle(h, &items[i],
+                                                  &items[i].handle), 0);
+        }
+
+        /* Remove all odd keys */
+        for (long i = 0; i < size; i++)
+        {
+                if (items[i].key & 1)
+                {
+                        SCUT_ASSERT_IE(heap_remove(h, items[i].handle), &items[i]);
+                        SCUT_ASSERT_IE(heap_remove(h, items[i].handle), NULL);
+                }
+        }
+        SCUT_ASSERT_IE(heap_size(h), size / 2);
+        SCUT_ASSERT_IE(heap_remove(h, (size_t)size), NULL);
+
+        /* Released handles are reused, and no more than size are used */
+        for (long i = 0; i < size; i++)
+        {
+                if (items[i].key & 1)
+                {
+                        SCUT_ASSERT_IE(heap_insert_handle(h, &items[i],
+                                                          &items[i].handle), 0);
+                        SCUT_ASSERT_TRUE(items[i].handle < (size_t)size);
+                }
+        }
+        /* More items than released handles */
+        SCUT_ASSERT_IE(heap_insert_handle(h, &items[0], &hd), 0);
+        SCUT_ASSERT_IE(hd, size);
+        SCUT_ASSERT_IE(heap_remove(h, hd), &items[0]);
+        for (long i = 0; i < size; i++)
+        {
+                struct keyed* k = heap_min(h);
+
+                SCUT_ASSERT_IE(k->key, i);
+        }
+
+        /* Not addressable */
+        SCUT_ASSERT_IE(heap_insert_handle(p, &items[0], &hd), 0);
+        SCUT_ASSERT_IE(heap_update(p, hd), -1);
+        SCUT_ASSERT_IE(heap_remove(p, hd), NULL);
+
+        heap_destroy(h);
+        heap_destroy(p);
+
+        return 0;
+}
+
+static int test_heap_create_from(void)
+{
+        long size = 10000;
+        void** items = malloc(size * sizeof(void*));
+        struct heap* h;
+
+        for (long i = 0; i < size; i++)
+        {
+                items[i] = (void*)((i * 7919) % size);
+        }
+        h = heap_create_from(&test_cmp, items, (size_t)size);
+        SCUT_ASSERT_TRUE(h);
+        SCUT_ASSERT_IE(heap_size(h), size);
+        /* The array is copied */
+        items[0] = (void*)-1l;
+        for (long i = 0; i < size; i++)
+        {
+                SCUT_ASSERT_IE(heap_min(h), i);
+        }
+        heap_destroy(h);
+
+        h = heap_create_from(&test_cmp, items, 0);
+        SCUT_ASSERT_TRUE(h);
+        SCUT_ASSERT_IE(heap_min(h), NULL);
+        SCUT_ASSERT_IE(heap_insert(h, (void*)1l), 0);
+        SCUT_ASSERT_IE(heap_insert(h, (void*)0l), 0);
+        SCUT_ASSERT_IE(heap_min(h), 0);
+        heap_destroy(h);
+
+        h = heap_create_cap(&test_cmp, 0);
+        SCUT_ASSERT_TRUE(h);
+        SCUT_ASSERT_IE(heap_reserve(h, (size_t)size), 0);
+        SCUT_ASSERT_IE(heap_insert(h, (void*)1l), 0);
+        SCUT_ASSERT_IE(heap_min(h), 1);
+        heap_destroy(h);
+        free(items);
+
+        return 0;
+}
+
+static int test_heap_insert_batch(void)
+{
+        struct keyed items[1000];
+        void* ptrs[1000];
+        size_t handles[1000];
+        long size = 1000;
+
+        for (long i = 0; i < size; i++)
+        {
+                items[i].key = (i * 7919) % size;
+                ptrs[i] = &items[i];
+        }
+
+        for (unsigned int a = 2; a <= 8; a *= 2)
+        {
+                struct heap* h = heap_create_flags(&key_cmp, a, HEAP_ADDRESSABLE);
+
+                /* Rebuilt, then inserted one by one */
+                SCUT_ASSERT_IE(heap_insert_batch(h, ptrs, 400, handles), 0);
+                SCUT_ASSERT_IE(heap_insert_batch(h, ptrs + 400, 300,
+                                                 handles + 400), 0);
+                SCUT_ASSERT_IE(heap_insert_batch(h, ptrs + 700, 300,
+                                                 handles + 700), 0);
+                SCUT_ASSERT_IE(heap_size(h), size);
+
+                /* Handles refer to the right items */
+                for (long i = 0; i < size; i += 2)
+                {
+                        SCUT_ASSERT_IE(heap_remove(h, handles[i]), &items[i]);
+                }
+                for (long i = 1; i < size; i += 2)
+                {
+                        items[i].key = size - items[i].key;
+                        SCUT_ASSERT_IE(heap_update(h, handles[i]), 0);
+                }
+                for (long i = 1; i < size; i += 2)
+                {
+                        items[i].key = size - items[i].key;
+                        SCUT_ASSERT_IE(heap_update(h, handles[i]), 0);
+                }
+                for (long i = 0; i < size; i += 2)
+                {
+                        SCUT_ASSERT_IE(heap_insert_handle(h, &items[i],
+                                                          &handles[i]), 0);
+                }
+                for (long i = 0; i < size; i++)
+                {
+                        struct keyed* k = heap_min(h);
+
+                        SCUT_ASSERT_IE(k->key, i);
+                }
+
+                heap_destroy(h);
+        }
+
+        return 0;
+}
+
+static int test_heap_replace(void)
+{
+        struct heap* h = heap_create_arity(&test_cmp, 4);
+        struct keyed items[3];
+        struct keyed k = {10, 0};
+        struct heap* a;
+
+        SCUT_ASSERT_IE(heap_peek(h), NULL);
+        SCUT_ASSERT_IE(heap_pushpop(h, (void*)5l), 5);
+        SCUT_ASSERT_IE(heap_size(h), 0);
+        SCUT_ASSERT_IE(heap_replace_top(h, (void*)5l), NULL);
+        SCUT_ASSERT_IE(heap_size(h), 1);
+        SCUT_ASSERT_IE(heap_peek(h), 5);
+
+        for (long i = 1; i <= 4; i++)
+        {
+                SCUT_ASSERT_IE(heap_insert(h, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(heap_peek(h), 1);
+        SCUT_ASSERT_IE(heap_size(h), 5);
+
+        /* Higher order than the top, returned directly */
+        SCUT_ASSERT_IE(heap_pushpop(h, (void*)0l), 0);
+        SCUT_ASSERT_IE(heap_size(h), 5);
+        /* Equal order is returned directly too */
+        SCUT_ASSERT_IE(heap_pushpop(h, (void*)1l), 1);
+        SCUT_ASSERT_IE(heap_pushpop(h, (void*)6l), 1);
+        SCUT_ASSERT_IE(heap_peek(h), 2);
+        /* Replace always inserts */
+        SCUT_ASSERT_IE(heap_replace_top(h, (void*)0l), 2);
+        SCUT_ASSERT_IE(heap_peek(h), 0);
+        SCUT_ASSERT_IE(heap_size(h), 5);
+
+        SCUT_ASSERT_IE(heap_min(h), 0);
+        SCUT_ASSERT_IE(heap_min(h), 3);
+        SCUT_ASSERT_IE(heap_min(h), 4);
+        SCUT_ASSERT_IE(heap_min(h), 5);
+        SCUT_ASSERT_IE(heap_min(h), 6);
+        SCUT_ASSERT_IE(heap_min(h), NULL);
+
+        /* Keep the 100 largest of a stream, the heap top is the
+           smallest of them */
+        for (long i = 0; i < 10000; i++)
+        {
+                long v = (i * 7919) % 10000;
+
+                if (heap_size(h) < 100)
+                {
+                        SCUT_ASSERT_IE(heap_insert(h, (void*)v), 0);
+                }
+                else
+                {
+                        heap_pushpop(h, (void*)v);
+                }
+        }
+        for (long i = 9900; i < 10000; i++)
+        {
+                SCUT_ASSERT_IE(heap_min(h), i);
+        }
+        heap_destroy(h);
+
+        /* The handle of the top moves to the new item */
+        a = heap_create_flags(&key_cmp, 2, HEAP_ADDRESSABLE);
+        /* Nothing to take over, the item is returned */
+        SCUT_ASSERT_IE(heap_replace_top(a, &k), &k);
+        SCUT_ASSERT_IE(heap_size(a), 0);
+        for (long i = 0; i < 3; i++)
+        {
+                items[i].key = i;
+                SCUT_ASSERT_IE(heap_insert_handle(a, &items[i],
+                                                  &items[i].handle), 0);
+        }
+        SCUT_ASSERT_IE(heap_pushpop(a, &k), &items[0]);
+        SCUT_ASSERT_IE(heap_remove(a, items[0].handle), &k);
+        SCUT_ASSERT_IE(heap_size(a), 2);
+        SCUT_ASSERT_IE(heap_remove(a, items[1].handle), &items[1]);
+        SCUT_ASSERT_IE(heap_peek(a), &items[2]);
+        heap_destroy(a);
+
+        return 0;
+}
@@ -0,0 +1,373 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <stdlib.h>
+#include "itree.h"
+
+struct inode
+{
+        int64_t lo;
+        int64_t hi;
+        /* Max high endpoint in the subtree */
+        int64_t max;
+        void* data;
+        struct inode* left;
+        struct inode* right;
+        /* AVL height, a leaf has height 1 */
+        int height;
+};
+
+struct itree
+{
+        struct inode* root;
+        size_t len;
+};
+
+/**
+ * Compare an interval with a node, by low and high endpoint and then by
+ * the data pointer.
+ * @return -1, 0 or 1 as the interval orders before, equal to or after
+ *         the node.
+ */
+static int cmp(const struct inode*, int64_t, int64_t, const void*);
+static int height(const struct inode*);
+/**
+ * Recalculate the height and max endpoint of a node from its children.
+ * @param the node.
+ * @return void.
+ */
+static void update(struct inode*);
+static struct inode* rotate_left(struct inode*);
+static struct inode* rotate_right(struct inode*);
+/**
+ * Restore the AVL property at a node whose subtrees are balanced.
+ * @param the node.
+ * @return the new root of the subtree.
+ */
+static struct inode* rebalance(struct inode*);
+static struct inode* insert(struct inode*, struct inode*);
+/**
+ * Remove an interval from a subtree.
+ * @param the subtree.
+ * @param the low endpoint.
+ * @param the high endpoint.
+ * @param the data.
+ * @param set to 1 if the interval was removed.
+ * @return the new root of the subtree.
+ */
+static struct inode* remove_node(struct inode*, int64_t, int64_t,
+                                 const void*, int*);
+/**
+ * Unlink the min node of a subtree.
+ * @param the subtree.
+ * @param the unlinked node, written.
+ * @return the new root of the subtree.
+ */
+static struct inode* remove_min(struct inode*, struct inode**);
+static int overlap(const struct inode*, int64_t, int64_t, itree_visit,
+                   void*);
+static void free_nodes(struct inode*);
+
+struct itree* itree_create(void)
+{
+        struct itree* t = malloc(sizeof(struct itree));
+
+        if (t == NULL)
+        {
+                return NULL;
+        }
+
+        t->root = NULL;
+        t->len = 0;
+
+        return t;
+}
+
+void itree_destroy(struct itree* t)
+{
+        free_nodes(t->root);
+        free(t);
+}
+
+int itree_insert(struct itree* t, int64_t lo, int64_t hi, void* d)
+{
+        struct inode* n;
+
+        if (lo > hi)
+        {
+                return -1;
+        }
+
+        n = malloc(sizeof(struct inode));
+        if (n == NULL)
+        {
+                return -1;
+        }
+        n->lo = lo;
+        n->hi = hi;
+        n->max = hi;
+        n->data = d;
+        n->left = NULL;
+        n->right = NULL;
+        n->height = 1;
+
+        t->root = insert(t->root, n);
+        t->len++;
+
+        return 0;
+}
+
+int itree_remove(struct itree* t, int64_t lo, int64_t hi, void* d)
+{
+        int removed = 0;
+
+        t->root = remove_node(t->root, lo, hi, d, &removed);
+        if (!removed)
+        {
+                return -1;
+        }
+        t->len--;
+
+        return 0;
+}
+
+int itree_stab(const struct itree* t, int64_t p, itree_visit fn, void* arg)
+{
+        return overlap(t->root, p, p, fn, arg);
+}
+
+int itree_overlap(const struct itree* t,
+                  int64_t lo,
+                  int64_t hi,
+                  itree_visit fn,
+                  void* arg)
+{
+        return overlap(t->root, lo, hi, fn, arg);
+}
+
+size_t itree_size(const struct itree* t)
+{
+        return t->len;
+}
+
+static int cmp(const struct inode* n, int64_t lo, int64_t hi, const void* d)
+{
+        if (lo != n->lo)
+        {
+                return lo < n->lo ? -1 : 1;
+        }
+        if (hi != n->hi)
+        {
+                return hi < n->hi ? -1 : 1;
+        }
+        if (d != n->data)
+        {
+                return (uintptr_t)d < (uintptr_t)n->data ? -1 : 1;
+        }
+
+        return 0;
+}
+
+static int height(const struct inode* n)
+{
+        return n ? n->height : 0;
+}
+
+static void update(struct inode* n)
+{
+        int l = height(n->left);
+        int r = height(n->right);
+
+        n->height = (l > r ? l : r) + 1;
+        n->max = n->hi;
+        if (n->left && n->left->max > n->max)
+        {
+                n->max = n->left->max;
+        }
+        if (n->right && n->right->max > n->max)
+        {
+                n->max = n->right->max;
+        }
+}
+
+static struct inode* rotate_left(struct inode* n)
+{
+        struct inode* r = n->right;
+
+        n->right = r->left;
+        r->left = n;
+        update(n);
+        update(r);
+
+        return r;
+}
+
+static struct inode* rotate_right(struct inode* n)
+{
+        struct inode* l = n->left;
+
+        n->left = l->right;
+        l->right = n;
+        update(n);
+        update(l);
+
+        return l;
+}
+
+static struct inode* rebalance(struct inode* n)
+{
+        int bf = height(n->left) - height(n->right);
+
+        update(n);
+        if (bf > 1)
+        {
+                if (height(n->left->left) < height(n->left->right))
+                {
+                        n->left = rotate_left(n->left);
+                }
+                n = rotate_right(n);
+        }
+        else if (bf < -1)
+        {
+                if (height(n->right->right) < height(n->right->left))
+                {
+                        n->right = rotate_right(n->right);
+                }
+                n = rotate_left(n);
+        }
+
+        return n;
+}
+
+static struct inode* insert(struct inode* n, struct inode* new)
+{
+        if (n == NULL)
+        {
+                return new;
+        }
+
+        /* Equal intervals go to the right */
+        if (cmp(n, new->lo, new->hi, new->data) < 0)
+        {
+                n->left = insert(n->left, new);
+        }
+        else
+        {
+                n->right = insert(n->right, new);
+        }
+
+        return rebalance(n);
+}
+
+static struct inode* remove_node(struct inode* n,
+                                 int64_t lo,
+                                 int64_t hi,
+                                 const void* d,
+                                 int* removed)
+{
+        int c;
+
+        if (n == NULL)
+        {
+                return NULL;
+        }
+
+        c = cmp(n, lo, hi, d);
+        if (c < 0)
+        {
+                n->left = remove_node(n->left, lo, hi, d, removed);
+        }
+        else if (c > 0)
+        {
+                n->right = remove_node(n->right, lo, hi, d, removed);
+        }
+        else
+        {
+                struct inode* r;
+
+                *removed = 1;
+                if (n->left == NULL || n->right == NULL)
+                {
+                        r = n->left ? n->left : n->right;
+                        free(n);
+                        return r;
+                }
+
+                /* Replace the node with its successor */
+                n->right = remove_min(n->right, &r);
+                r->left = n->left;
+                r->right = n->right;
+                free(n);
+                n = r;
+        }
+
+        return rebalance(n);
+}
+
+static struct inode* remove_min(struct inode* n, struct inode** min)
+{
+        if (n->left == NULL)
+        {
+                *min = n;
+                return n->right;
+        }
+
+        n->left = remove_min(n->left, min);
+
+        return rebalance(n);
+}
+
+static int overlap(const struct inode* n,
+                   int64_t lo,
+                   int64_t hi,
+                   itree_visit fn,
+                   void* arg)
+{
+        int r;
+
+        /* Nothing in the subtree reaches lo */
+        if (n == NULL || n->max < lo)
+        {
+                return 0;
+        }
+
+        if ((r = overlap(n->left, lo, hi, fn, arg)) != 0)
+        {
+                return r;
+        }
+        /* All intervals to the right start at or after n */
+        if (n->lo > hi)
+        {
+                return 0;
+        }
+        if (n->hi >= lo)
+        {
+                if ((r = fn(n->lo, n->hi, n->data, arg)) != 0)
+                {
+                        return r;
+                }
+        }
+
+        return overlap(n->right, lo, hi, fn, arg);
+}
+
+static void free_nodes(struct inode* n)
+{
+        /* Recursion depth is bounded by the height of the tree */
+        if (n)
+        {
+                free_nodes(n->left);
+                free_nodes(n->right);
+                free(n);
+        }
+}
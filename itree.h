@@ -0,0 +1,114 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#ifndef __ITREE_H__
+#define __ITREE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct itree;
+
+/*
+ * Interval tree over closed intervals [lo, hi].
+ * A balanced (AVL) binary tree ordered by the low endpoint, where every
+ * node also holds the max high endpoint in its subtree. The max values
+ * are maintained on insert, remove and during rotations, and let the
+ * queries skip any subtree that can't contain a match. A query runs in
+ * O(min(n, k log n)) where k is the number of matches, as each match
+ * costs at most one path of the tree.
+ *
+ * An interval is identified by its endpoints and its data pointer, the
+ * same interval may be inserted more than once.
+ *
+ * No methods are thread safe, external locking is required.
+ */
+
+/**
+ * Visitor method for queries.
+ * @param the low endpoint.
+ * @param the high endpoint.
+ * @param the data of the interval.
+ * @param the user provided argument.
+ * @return 0 to continue the query, non zero to stop.
+ */
+typedef int (*itree_visit)(int64_t, int64_t, void*, void*);
+
+/**
+ * Create an empty interval tree.
+ * @return the tree, or NULL on failure.
+ */
+extern struct itree* itree_create(void);
+
+/**
+ * Destroy the tree and free any memory occupied.
+ * @param the tree to destroy.
+ * @return void.
+ */
+extern void itree_destroy(struct itree*);
+
+/**
+ * Insert an interval.
+ * @param the tree.
+ * @param the low endpoint.
+ * @param the high endpoint, must not be less than the low endpoint.
+ * @param the data of the interval.
+ * @return 0 on success, -1 on invalid interval or if no memory could be
+ *         allocated.
+ */
+extern int itree_insert(struct itree*, int64_t, int64_t, void*);
+
+/**
+ * Remove an interval.
+ * @param the tree.
+ * @param the low endpoint.
+ * @param the high endpoint.
+ * @param the data of the interval.
+ * @return 0 if the interval was removed, -1 if not found.
+ */
+extern int itree_remove(struct itree*, int64_t, int64_t, void*);
+
+/**
+ * Visit all intervals that contain a point, in order of the low
+ * endpoint.
+ * @param the tree.
+ * @param the point.
+ * @param the visitor.
+ * @param argument passed to the visitor.
+ * @return 0 if all matches were visited, the visitor's return value if
+ *         the query was stopped.
+ */
+extern int itree_stab(const struct itree*, int64_t, itree_visit, void*);
+
+/**
+ * Visit all intervals that overlap [lo, hi], in order of the low
+ * endpoint.
+ * @param the tree.
+ * @param the low endpoint.
+ * @param the high endpoint.
+ * @param the visitor.
+ * @param argument passed to the visitor.
+ * @return 0 if all matches were visited, the visitor's return value if
+ *         the query was stopped.
+ */
+extern int itree_overlap(const struct itree*, int64_t, int64_t,
+                         itree_visit, void*);
+
+/**
+ * Return the number of intervals in the tree.
+ * @param the tree.
+ * @return the number of intervals.
+ */
+extern size_t itree_size(const struct itree*);
+
+#endif /* __ITREE_H__ */
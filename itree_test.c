@@ -0,0 +1,241 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <scut.h>
+#include "itree.h"
+
+#define NUM_IV 2000
+
+static int test_it_insert(void);
+static int test_it_stab(void);
+static int test_it_overlap(void);
+static int test_it_remove(void);
+
+struct iv
+{
+        int64_t lo;
+        int64_t hi;
+        int live;
+};
+
+struct match
+{
+        int64_t prev;
+        long count;
+        long sum;
+};
+
+static struct iv ivs[NUM_IV];
+
+int test_itree(void)
+{
+        int ret;
+
+        scut_create("Test interval tree");
+
+        SCUT_ADD(test_it_insert);
+        SCUT_ADD(test_it_stab);
+        SCUT_ADD(test_it_overlap);
+        SCUT_ADD(test_it_remove);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+/* Count matches and verify they are reported in order */
+static int visit_count(int64_t lo, int64_t hi, void* d, void* arg)
+{
+        struct match* m = arg;
+
+        (void)hi;
+        if (lo < m->prev)
+        {
+                return -1;
+        }
+        m->prev = lo;
+        m->count++;
+        m->sum += (long)d;
+
+        return 0;
+}
+
+static int visit_stop(int64_t lo, int64_t hi, void* d, void* arg)
+{
+        (void)lo;
+        (void)hi;
+        (void)d;
+
+        return --(*(int*)arg) == 0 ? 2 : 0;
+}
+
+static struct itree* build(void)
+{
+        struct itree* t = itree_create();
+        unsigned long seed = 4711;
+
+        for (long i = 0; i < NUM_IV; i++)
+        {
+                seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+                ivs[i].lo = (int64_t)((seed >> 33) % 10000);
+                ivs[i].hi = ivs[i].lo + (int64_t)((seed >> 20) % 200);
+                ivs[i].live = 1;
+                if (itree_insert(t, ivs[i].lo, ivs[i].hi, (void*)i))
+                {
+                        itree_destroy(t);
+                        return NULL;
+                }
+        }
+
+        return t;
+}
+
+/* Brute force reference */
+static void scan(int64_t lo, int64_t hi, long* count, long* sum)
+{
+        *count = 0;
+        *sum = 0;
+        for (long i = 0; i < NUM_IV; i++)
+        {
+                if (ivs[i].live && ivs[i].lo <= hi && ivs[i].hi >= lo)
+                {
+                        (*count)++;
+                        *sum += i;
+                }
+        }
+}
+
+static int test_it_insert(void)
+{
+        struct itree* t = itree_create();
+        struct match m = {INT64_MIN, 0, 0};
+
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_IE(itree_size(t), 0);
+        SCUT_ASSERT_IE(itree_stab(t, 1, &visit_count, &m), 0);
+        SCUT_ASSERT_IE(m.count, 0);
+
+        SCUT_ASSERT_IE(itree_insert(t, 10, 5, NULL), -1);
+        SCUT_ASSERT_IE(itree_insert(t, 10, 20, NULL), 0);
+        /* The same interval twice */
+        SCUT_ASSERT_IE(itree_insert(t, 10, 20, NULL), 0);
+        SCUT_ASSERT_IE(itree_insert(t, 5, 5, NULL), 0);
+        SCUT_ASSERT_IE(itree_size(t), 3);
+
+        SCUT_ASSERT_IE(itree_stab(t, 20, &visit_count, &m), 0);
+        SCUT_ASSERT_IE(m.count, 2);
+        m.prev = INT64_MIN;
+        m.count = 0;
+        SCUT_ASSERT_IE(itree_stab(t, 5, &visit_count, &m), 0);
+        SCUT_ASSERT_IE(m.count, 1);
+        m.prev = INT64_MIN;
+        m.count = 0;
+        SCUT_ASSERT_IE(itree_stab(t, 21, &visit_count, &m), 0);
+        SCUT_ASSERT_IE(m.count, 0);
+
+        itree_destroy(t);
+
+        return 0;
+}
+
+static int test_it_stab(void)
+{
+        struct itree* t = build();
+        int stop = 3;
+
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_IE(itree_size(t), NUM_IV);
+
+        for (int64_t p = -10; p < 10300; p += 7)
+        {
+                struct match m = {INT64_MIN, 0, 0};
+                long count;
+                long sum;
+
+                scan(p, p, &count, &sum);
+                SCUT_ASSERT_IE(itree_stab(t, p, &visit_count, &m), 0);
+                SCUT_ASSERT_IE(m.count, count);
+                SCUT_ASSERT_IE(m.sum, sum);
+        }
+
+        SCUT_ASSERT_IE(itree_stab(t, 5000, &visit_stop, &stop), 2);
+
+        itree_destroy(t);
+
+        return 0;
+}
+
+static int test_it_overlap(void)
+{
+        struct itree* t = build();
+
+        for (int64_t lo = -100; lo < 10300; lo += 97)
+        {
+                for (int64_t len = 0; len < 500; len += 83)
+                {
+                        struct match m = {INT64_MIN, 0, 0};
+                        long count;
+                        long sum;
+
+                        scan(lo, lo + len, &count, &sum);
+                        SCUT_ASSERT_IE(itree_overlap(t, lo, lo + len,
+                                                     &visit_count, &m), 0);
+                        SCUT_ASSERT_IE(m.count, count);
+                        SCUT_ASSERT_IE(m.sum, sum);
+                }
+        }
+
+        itree_destroy(t);
+
+        return 0;
+}
+
+static int test_it_remove(void)
+{
+        struct itree* t = build();
+
+        /* Wrong data pointer */
+        SCUT_ASSERT_IE(itree_remove(t, ivs[0].lo, ivs[0].hi, (void*)-1l), -1);
+
+        for (long i = 0; i < NUM_IV; i += 2)
+        {
+                SCUT_ASSERT_IE(itree_remove(t, ivs[i].lo, ivs[i].hi, (void*)i), 0);
+                ivs[i].live = 0;
+        }
+        SCUT_ASSERT_IE(itree_remove(t, ivs[0].lo, ivs[0].hi, (void*)0l), -1);
+        SCUT_ASSERT_IE(itree_size(t), NUM_IV / 2);
+
+        /* The max endpoints are maintained */
+        for (int64_t lo = -100; lo < 10300; lo += 37)
+        {
+                struct match m = {INT64_MIN, 0, 0};
+                long count;
+                long sum;
+
+                scan(lo, lo + 50, &count, &sum);
+                SCUT_ASSERT_IE(itree_overlap(t, lo, lo + 50, &visit_count, &m), 0);
+                SCUT_ASSERT_IE(m.count, count);
+                SCUT_ASSERT_IE(m.sum, sum);
+        }
+
+        for (long i = 1; i < NUM_IV; i += 2)
+        {
+                SCUT_ASSERT_IE(itree_remove(t, ivs[i].lo, ivs[i].hi, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(itree_size(t), 0);
+
+        itree_destroy(t);
+
+        return 0;
+}
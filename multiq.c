@@ -0,0 +1,277 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include "multiq.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define FETCH_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define CACHE_LINE 64
+/* Arity of each heap */
+#define MQ_ARITY 4
+
+struct mq_heap
+{
+        pthread_mutex_t lock;
+        struct heap* heap;
+        /* Size of the heap, readable without the lock */
+        size_t size;
+        /* Keep heaps in separate cache lines */
+        char pad[CACHE_LINE];
+};
+
+struct multiq
+{
+        struct mq_heap* heaps;
+        heap_cmp cmp;
+        unsigned int n;
+        /* Seeds per thread random state */
+        uint64_t seed;
+};
+
+/* Random state of the thread, 0 until seeded */
+static __thread uint64_t rnd_state;
+
+/**
+ * Draw a random number.
+ * @param the queue, for seeding.
+ * @return the number.
+ */
+static uint64_t rnd(struct multiq*);
+
+/**
+ * Extract the top of a locked heap.
+ * @param the heap.
+ * @return the item.
+ */
+static void* pop(struct mq_heap*);
+
+/**
+ * Extract from the first non empty heap, blocking on the locks.
+ * @param the queue.
+ * @return the item, or NULL if all heaps were empty.
+ */
+static void* scan(struct multiq*);
+
+struct multiq* multiq_create(heap_cmp cmp, unsigned int n)
+{
+        struct multiq* q;
+
+        if (n == 0)
+        {
+                return NULL;
+        }
+        q = malloc(sizeof(struct multiq));
+        if (q == NULL)
+        {
+                return NULL;
+        }
+        q->heaps = malloc(n * sizeof(struct mq_heap));
+        if (q->heaps == NULL)
+        {
+                free(q);
+                return NULL;
+        }
+        for (unsigned int i = 0; i < n; i++)
+        {
+                q->heaps[i].heap = heap_create_arity(cmp, MQ_ARITY);
+                if (q->heaps[i].heap == NULL)
+                {
+                        while (i-- > 0)
+                        {
+                                pthread_mutex_destroy(&q->heaps[i].lock);
+                                heap_destroy(q->heaps[i].heap);
+                        }
+                        free(q->heaps);
+                        free(q);
+                        return NULL;
+                }
+                pthread_mutex_init(&q->heaps[i].lock, NULL);
+                q->heaps[i].size = 0;
+        }
+        q->cmp = cmp;
+        q->n = n;
+        q->seed = 0;
+
+        return q;
+}
+
+void multiq_destroy(struct multiq* q)
+{
+        for (unsigned int i = 0; i < q->n; i++)
+        {
+                pthread_mutex_destroy(&q->heaps[i].lock);
+                heap_destroy(q->heaps[i].heap);
+        }
+        free(q->heaps);
+        free(q);
+}
+
+int multiq_insert(struct multiq* q, void* e)
+{
+        for (;;)
+        {
+                struct mq_heap* h = &q->heaps[rnd(q) % q->n];
+                int ret;
+
+                /* Try another heap rather than wait */
+                if (pthread_mutex_trylock(&h->lock))
+                {
+                        continue;
+                }
+                ret = heap_insert(h->heap, e);
+                if (ret == 0)
+                {
+                        STORE(&h->size, h->size + 1);
+                }
+                pthread_mutex_unlock(&h->lock);
+
+                return ret;
+        }
+}
+
+void* multiq_min(struct multiq* q)
+{
+        /* Give up on random picks after this many, and scan */
+        unsigned int tries = 2 * q->n + 8;
+
+        while (tries-- > 0)
+        {
+                uint64_t r = rnd(q);
+                struct mq_heap* a = &q->heaps[(r & 0xffffffff) % q->n];
+                struct mq_heap* b = &q->heaps[(r >> 32) % q->n];
+                struct mq_heap* h;
+                void* ret;
+
+                /* Skip empty heaps without locking them */
+                if (LOAD(&a->size) == 0)
+                {
+                        a = b;
+                }
+                else if (LOAD(&b->size) == 0)
+                {
+                        b = a;
+                }
+                if (LOAD(&a->size) == 0)
+                {
+                        continue;
+                }
+
+                /* The tops are compared with both heaps locked, as the
+                   top of an unlocked heap may be extracted and freed by
+                   another thread */
+                if (pthread_mutex_trylock(&a->lock))
+                {
+                        continue;
+                }
+                if (b != a && pthread_mutex_trylock(&b->lock))
+                {
+                        pthread_mutex_unlock(&a->lock);
+                        continue;
+                }
+                h = a;
+                if (b != a && b->size > 0 &&
+                    (a->size == 0 ||
+                     q->cmp(heap_peek(b->heap), heap_peek(a->heap)) > 0))
+                {
+                        h = b;
+                }
+                ret = h->size > 0 ? pop(h) : NULL;
+                if (b != a)
+                {
+                        pthread_mutex_unlock(&b->lock);
+                }
+                pthread_mutex_unlock(&a->lock);
+                if (ret)
+                {
+                        return ret;
+                }
+        }
+
+        return scan(q);
+}
+
+size_t multiq_size(const struct multiq* q)
+{
+        size_t size = 0;
+
+        for (unsigned int i = 0; i < q->n; i++)
+        {
+                size += LOAD(&q->heaps[i].size);
+        }
+
+        return size;
+}
+
+static uint64_t rnd(struct multiq* q)
+{
+        uint64_t x = rnd_state;
+
+        if (x == 0)
+        {
+                /* splitmix64 over a shared counter, once per thread */
+                x = FETCH_ADD(&q->seed, 0x9e3779b97f4a7c15ULL);
+                x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+                x = (x ^ (x >> 31)) | 1;
+        }
+
+        /* xorshift64 */
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        rnd_state = x;
+
+        return x;
+}
+
+static void* pop(struct mq_heap* h)
+{
+        void* ret = heap_min(h->heap);
+
+        STORE(&h->size, h->size - 1);
+
+        return ret;
+}
+
+static void* scan(struct multiq* q)
+{
+        unsigned int start = (unsigned int)(rnd(q) % q->n);
+
+        for (unsigned int k = 0; k < q->n; k++)
+        {
+                struct mq_heap* h = &q->heaps[(start + k) % q->n];
+                void* ret = NULL;
+
+                if (LOAD(&h->size) == 0)
+                {
+                        continue;
+                }
+                pthread_mutex_lock(&h->lock);
+                if (h->size > 0)
+                {
+                        ret = pop(h);
+                }
+                pthread_mutex_unlock(&h->lock);
+                if (ret)
+                {
+                        return ret;
+                }
+        }
+
+        return NULL;
+}
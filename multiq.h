@@ -0,0 +1,78 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#ifndef __MULTIQ_H__
+#define __MULTIQ_H__
+
+#include <stddef.h>
+#include "heap.h"
+
+struct multiq;
+
+/*
+ * Concurrent relaxed priority queue, a MultiQueue. Items are kept in a
+ * number of heaps, each with its own lock. An insert goes to a random
+ * heap. An extract picks two random heaps and takes the top of the one
+ * with the higher ordered top. Threads rarely contend for the same
+ * heap, so throughput scales with the number of threads.
+ *
+ * The order is relaxed: the extracted item is not always the highest
+ * ordered one. With q heaps, the expected rank of an extracted item
+ * among all items is O(q), and the probability of a rank error much
+ * larger than q falls exponentially. Two to four heaps per thread is a
+ * good choice. An extract returns NULL only if all heaps appeared empty
+ * while scanned.
+ *
+ * All methods except multiq_destroy are thread safe.
+ */
+
+/**
+ * Create an empty queue.
+ * @param the order method, as for heap.
+ * @param the number of heaps, at least 1.
+ * @return the queue, or NULL on failure.
+ */
+extern struct multiq* multiq_create(heap_cmp, unsigned int);
+
+/**
+ * Destroy the queue and free any memory it has allocated.
+ * @param the queue.
+ * @return void.
+ */
+extern void multiq_destroy(struct multiq*);
+
+/**
+ * Insert a new item.
+ * @param the queue.
+ * @param the item, not NULL.
+ * @return 0 if the item was inserted, non-zero otherwise.
+ */
+extern int multiq_insert(struct multiq*, void*);
+
+/**
+ * Extract a high ordered item, see above for the order guarantees.
+ * @param the queue.
+ * @return the item, or NULL if the queue is empty.
+ */
+extern void* multiq_min(struct multiq*);
+
+/**
+ * Return the number of items, only exact when no other thread
+ * modifies the queue.
+ * @param the queue.
+ * @return the number of items.
+ */
+extern size_t multiq_size(const struct multiq*);
+
+#endif /* __MULTIQ_H__ */
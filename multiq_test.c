@@ -0,0 +1,216 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include <scut.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "multiq.h"
+
+#define NUM_ITEMS 20000
+#define NUM_THREADS 4
+
+static int test_mq_single(void);
+static int test_mq_rank(void);
+static int test_mq_threads(void);
+
+/* State shared by the threads */
+struct shared
+{
+        struct multiq* q;
+        /* Number of times each item was extracted */
+        int* seen;
+        int id;
+};
+
+/* Lowest value has highest order */
+static int test_cmp(const void* a, const void* b)
+{
+        long t1 = (long)a;
+        long t2 = (long)b;
+
+        if (t1 < t2)
+        {
+                return 1;
+        }
+        else if (t1 > t2)
+        {
+                return -1;
+        }
+
+        return 0;
+}
+
+int test_multiq(void)
+{
+        int ret;
+
+        scut_create("Test multi queue");
+
+        SCUT_ADD(test_mq_single);
+        SCUT_ADD(test_mq_rank);
+        SCUT_ADD(test_mq_threads);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+static int test_mq_single(void)
+{
+        struct multiq* q;
+        static int seen[NUM_ITEMS + 1];
+
+        SCUT_ASSERT_IE(multiq_create(&test_cmp, 0), NULL);
+
+        /* A single heap is exact */
+        q = multiq_create(&test_cmp, 1);
+        SCUT_ASSERT_TRUE(q);
+        SCUT_ASSERT_IE(multiq_min(q), NULL);
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(multiq_insert(q, (void*)((i * 7919) % 1000 + 1)), 0);
+        }
+        SCUT_ASSERT_IE(multiq_size(q), 1000);
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(multiq_min(q), i);
+        }
+        SCUT_ASSERT_IE(multiq_min(q), NULL);
+        multiq_destroy(q);
+
+        /* All items are extracted once */
+        q = multiq_create(&test_cmp, 8);
+        for (long i = 1; i <= NUM_ITEMS; i++)
+        {
+                SCUT_ASSERT_IE(multiq_insert(q, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(multiq_size(q), NUM_ITEMS);
+        for (long i = 1; i <= NUM_ITEMS; i++)
+        {
+                long v = (long)multiq_min(q);
+
+                SCUT_ASSERT_TRUE(v >= 1 && v <= NUM_ITEMS);
+                seen[v]++;
+        }
+        SCUT_ASSERT_IE(multiq_min(q), NULL);
+        SCUT_ASSERT_IE(multiq_size(q), 0);
+        for (long i = 1; i <= NUM_ITEMS; i++)
+        {
+                SCUT_ASSERT_IE(seen[i], 1);
+        }
+        multiq_destroy(q);
+
+        return 0;
+}
+
+static int test_mq_rank(void)
+{
+        struct multiq* q = multiq_create(&test_cmp, 8);
+        static char present[NUM_ITEMS + 1];
+        long lowest = 1;
+        long total = 0;
+
+        for (long i = 1; i <= NUM_ITEMS; i++)
+        {
+                SCUT_ASSERT_IE(multiq_insert(q, (void*)i), 0);
+                present[i] = 1;
+        }
+
+        /* The rank of an extracted item is the number of present items
+           with higher order. Its mean is bounded by a small multiple of
+           the number of heaps. */
+        for (long i = 0; i < NUM_ITEMS / 2; i++)
+        {
+                long v = (long)multiq_min(q);
+
+                while (!present[lowest])
+                {
+                        lowest++;
+                }
+                for (long k = lowest; k < v; k++)
+                {
+                        total += present[k];
+                }
+                present[v] = 0;
+        }
+        SCUT_ASSERT_TRUE(total / (NUM_ITEMS / 2) <= 4 * 8);
+
+        multiq_destroy(q);
+
+        return 0;
+}
+
+/* Insert the items of one thread, extracting one for every two */
+static void* worker(void* arg)
+{
+        struct shared* s = arg;
+        long first = (long)s->id * (NUM_ITEMS / NUM_THREADS) + 1;
+
+        for (long i = 0; i < NUM_ITEMS / NUM_THREADS; i++)
+        {
+                if (multiq_insert(s->q, (void*)(first + i)))
+                {
+                        return (void*)1;
+                }
+                if (i & 1)
+                {
+                        long v = (long)multiq_min(s->q);
+
+                        if (v)
+                        {
+                                __atomic_fetch_add(&s->seen[v], 1, __ATOMIC_RELAXED);
+                        }
+                }
+        }
+
+        return NULL;
+}
+
+static int test_mq_threads(void)
+{
+        struct multiq* q = multiq_create(&test_cmp, 2 * NUM_THREADS);
+        static int seen[NUM_ITEMS + 1];
+        struct shared s[NUM_THREADS];
+        pthread_t thr[NUM_THREADS];
+        void* v;
+
+        for (int t = 0; t < NUM_THREADS; t++)
+        {
+                s[t].q = q;
+                s[t].seen = seen;
+                s[t].id = t;
+                SCUT_ASSERT_IE(pthread_create(&thr[t], NULL, &worker, &s[t]), 0);
+        }
+        for (int t = 0; t < NUM_THREADS; t++)
+        {
+                pthread_join(thr[t], &v);
+                SCUT_ASSERT_IE(v, NULL);
+        }
+
+        /* Extract the rest, each item is seen exactly once */
+        while ((v = multiq_min(q)) != NULL)
+        {
+                seen[(long)v]++;
+        }
+        SCUT_ASSERT_IE(multiq_size(q), 0);
+        for (long i = 1; i <= NUM_ITEMS; i++)
+        {
+                SCUT_ASSERT_IE(seen[i], 1);
+        }
+
+        multiq_destroy(q);
+
+        return 0;
+}
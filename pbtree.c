@@ -0,0 +1,480 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <stdlib.h>
+#include "pbtree.h"
+
+/* Reference counts are shared between trees that may live in different
+   threads */
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define INCREF(n) __atomic_add_fetch(&(n)->refs, 1, __ATOMIC_RELAXED)
+#define DECREF(n) __atomic_sub_fetch(&(n)->refs, 1, __ATOMIC_ACQ_REL)
+
+struct pnode
+{
+        void* data;
+        struct pnode* left;
+        struct pnode* right;
+        unsigned int refs;
+        /* AVL height, a leaf has height 1 */
+        int height;
+};
+
+struct pbtree
+{
+        struct pnode* root;
+        btree_cmp cmp;
+        size_t len;
+};
+
+static struct pnode* alloc_node(void*);
+/**
+ * Drop a reference to a node, and free it and release its children if
+ * it was the last reference.
+ * @param the node, may be NULL.
+ * @return void.
+ */
+static void release(struct pnode*);
+/**
+ * Make sure the node is only referenced from the tree being modified.
+ * If the node is shared it's copied, and the copy takes over the
+ * caller's reference.
+ * @param the node.
+ * @return the node to modify, or NULL if no memory could be allocated.
+ */
+static struct pnode* own(struct pnode*);
+static int height(const struct pnode*);
+static void update_height(struct pnode*);
+static struct pnode* rotate_left(struct pnode*);
+static struct pnode* rotate_right(struct pnode*);
+/**
+ * Restore the AVL property at a node whose subtrees are balanced.
+ * @param the owned node.
+ * @return the new root of the subtree.
+ */
+static struct pnode* rebalance(struct pnode*);
+/**
+ * Insert into a subtree.
+ * @param the tree.
+ * @param the subtree, may be NULL.
+ * @param the item.
+ * @param set to 1 if a node was added, -1 on failure.
+ * @return the new root of the subtree.
+ */
+static struct pnode* insert(struct pbtree*, struct pnode*, void*, int*);
+/**
+ * Remove from a subtree, the item must be present.
+ * @param the tree.
+ * @param the subtree.
+ * @param the item.
+ * @param the removed item, written.
+ * @return the new root of the subtree.
+ */
+static struct pnode* remove_node(struct pbtree*, struct pnode*,
+                                 const void*, void**);
+/**
+ * Remove the min node from a subtree.
+ * @param the subtree.
+ * @param the removed item, written.
+ * @return the new root of the subtree.
+ */
+static struct pnode* remove_min(struct pnode*, void**);
+static int walk(const struct pnode*, pbtree_visit, void*);
+
+struct pbtree* pbtree_create(btree_cmp cmp)
+{
+        struct pbtree* t = malloc(sizeof(struct pbtree));
+
+        if (t == NULL)
+        {
+                return NULL;
+        }
+
+        t->root = NULL;
+        t->cmp = cmp;
+        t->len = 0;
+
+        return t;
+}
+
+struct pbtree* pbtree_snapshot(const struct pbtree* t)
+{
+        struct pbtree* s = pbtree_create(t->cmp);
+
+        if (s == NULL)
+        {
+                return NULL;
+        }
+
+        s->root = t->root;
+        s->len = t->len;
+        if (s->root)
+        {
+                INCREF(s->root);
+        }
+
+        return s;
+}
+
+void pbtree_destroy(struct pbtree* t)
+{
+        release(t->root);
+        free(t);
+}
+
+int pbtree_insert(struct pbtree* t, void* d)
+{
+        int res = 0;
+
+        t->root = insert(t, t->root, d, &res);
+        if (res < 0)
+        {
+                return -1;
+        }
+        if (res > 0)
+        {
+                t->len++;
+        }
+
+        return 0;
+}
+
+void* pbtree_find(const struct pbtree* t, const void* d)
+{
+        const struct pnode* n = t->root;
+
+        while (n)
+        {
+                int c = t->cmp(n->data, d);
+
+                if (c == 0)
+                {
+                        return n->data;
+                }
+                n = c > 0 ? n->left : n->right;
+        }
+
+        return NULL;
+}
+
+void* pbtree_remove(struct pbtree* t, const void* d)
+{
+        void* ret = NULL;
+
+        /* Don't copy any path unless the item is present */
+        if (pbtree_find(t, d) == NULL)
+        {
+                return NULL;
+        }
+
+        t->root = remove_node(t, t->root, d, &ret);
+        if (ret)
+        {
+                t->len--;
+        }
+
+        return ret;
+}
+
+int pbtree_walk(const struct pbtree* t, pbtree_visit fn, void* arg)
+{
+        return walk(t->root, fn, arg);
+}
+
+size_t pbtree_size(const struct pbtree* t)
+{
+        return t->len;
+}
+
+static struct pnode* alloc_node(void* d)
+{
+        struct pnode* n = malloc(sizeof(struct pnode));
+
+        if (n == NULL)
+        {
+                return NULL;
+        }
+
+        n->data = d;
+        n->left = NULL;
+        n->right = NULL;
+        n->refs = 1;
+        n->height = 1;
+
+        return n;
+}
+
+static void release(struct pnode* n)
+{
+        /* Recursion depth is bounded by the height of the tree */
+        if (n && DECREF(n) == 0)
+        {
+                release(n->left);
+                release(n->right);
+                free(n);
+        }
+}
+
+static struct pnode* own(struct pnode* n)
+{
+        struct pnode* c;
+
+        /* A node referenced once can not become shared while we hold
+           the only reference */
+        if (LOAD(&n->refs) == 1)
+        {
+                return n;
+        }
+
+        c = alloc_node(n->data);
+        if (c == NULL)
+        {
+                return NULL;
+        }
+        c->left = n->left;
+        c->right = n->right;
+        c->height = n->height;
+        if (c->left)
+        {
+                INCREF(c->left);
+        }
+        if (c->right)
+        {
+                INCREF(c->right);
+        }
+        release(n);
+
+        return c;
+}
+
+static int height(const struct pnode* n)
+{
+        return n ? n->height : 0;
+}
+
+static void update_height(struct pnode* n)
+{
+        int l = height(n->left);
+        int r = height(n->right);
+
+        n->height = (l > r ? l : r) + 1;
+}
+
+static struct pnode* rotate_left(struct pnode* n)
+{
+        struct pnode* r = own(n->right);
+
+        if (r == NULL)
+        {
+                /* Leave the subtree unbalanced */
+                return n;
+        }
+
+        n->right = r->left;
+        r->left = n;
+        update_height(n);
+        update_height(r);
+
+        return r;
+}
+
+static struct pnode* rotate_right(struct pnode* n)
+{
+        struct pnode* l = own(n->left);
+
+        if (l == NULL)
+        {
+                /* Leave the subtree unbalanced */
+                return n;
+        }
+
+        n->left = l->right;
+        l->right = n;
+        update_height(n);
+        update_height(l);
+
+        return l;
+}
+
+static struct pnode* rebalance(struct pnode* n)
+{
+        int bf = height(n->left) - height(n->right);
+
+        update_height(n);
+        if (bf > 1)
+        {
+                if (height(n->left->left) < height(n->left->right))
+                {
+                        struct pnode* l = own(n->left);
+
+                        if (l == NULL)
+                        {
+                                return n;
+                        }
+                        n->left = rotate_left(l);
+                }
+                n = rotate_right(n);
+        }
+        else if (bf < -1)
+        {
+                if (height(n->right->right) < height(n->right->left))
+                {
+                        struct pnode* r = own(n->right);
+
+                        if (r == NULL)
+                        {
+                                return n;
+                        }
+                        n->right = rotate_right(r);
+                }
+                n = rotate_left(n);
+        }
+
+        return n;
+}
+
+static struct pnode* insert(struct pbtree* t,
+                            struct pnode* n,
+                            void* d,
+                            int* res)
+{
+        struct pnode* o;
+        int c;
+
+        if (n == NULL)
+        {
+                n = alloc_node(d);
+                *res = n ? 1 : -1;
+                return n;
+        }
+
+        o = own(n);
+        if (o == NULL)
+        {
+                *res = -1;
+                return n;
+        }
+
+        c = t->cmp(o->data, d);
+        if (c == 0)
+        {
+                /* Replace */
+                o->data = d;
+                return o;
+        }
+        if (c > 0)
+        {
+                o->left = insert(t, o->left, d, res);
+        }
+        else
+        {
+                o->right = insert(t, o->right, d, res);
+        }
+
+        return rebalance(o);
+}
+
+static struct pnode* remove_node(struct pbtree* t,
+                                 struct pnode* n,
+                                 const void* d,
+                                 void** ret)
+{
+        struct pnode* o = own(n);
+        int c;
+
+        if (o == NULL)
+        {
+                return n;
+        }
+
+        c = t->cmp(o->data, d);
+        if (c > 0)
+        {
+                o->left = remove_node(t, o->left, d, ret);
+        }
+        else if (c < 0)
+        {
+                o->right = remove_node(t, o->right, d, ret);
+        }
+        else
+        {
+                *ret = o->data;
+                if (o->left == NULL || o->right == NULL)
+                {
+                        /* The child takes over our reference */
+                        struct pnode* child = o->left ? o->left : o->right;
+
+                        free(o);
+                        return child;
+                }
+                else
+                {
+                        void* min = NULL;
+
+                        o->right = remove_min(o->right, &min);
+                        if (min == NULL)
+                        {
+                                /* Out of memory, nothing removed */
+                                *ret = NULL;
+                                return o;
+                        }
+                        o->data = min;
+                }
+        }
+
+        return rebalance(o);
+}
+
+static struct pnode* remove_min(struct pnode* n, void** min)
+{
+        struct pnode* o = own(n);
+
+        if (o == NULL)
+        {
+                return n;
+        }
+
+        if (o->left == NULL)
+        {
+                struct pnode* r = o->right;
+
+                *min = o->data;
+                free(o);
+                return r;
+        }
+
+        o->left = remove_min(o->left, min);
+
+        return rebalance(o);
+}
+
+static int walk(const struct pnode* n, pbtree_visit fn, void* arg)
+{
+        int r;
+
+        if (n == NULL)
+        {
+                return 0;
+        }
+
+        if ((r = walk(n->left, fn, arg)) != 0)
+        {
+                return r;
+        }
+        if ((r = fn(n->data, arg)) != 0)
+        {
+                return r;
+        }
+
+        return walk(n->right, fn, arg);
+}
@@ -0,0 +1,109 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#ifndef __PBTREE_H__
+#define __PBTREE_H__
+
+#include <stddef.h>
+#include "btree.h"
+
+struct pbtree;
+
+/*
+ * Persistent (copy on write) balanced binary tree.
+ * A snapshot is created in O(1) and shares all nodes with the tree it
+ * was created from. Updates copy the nodes on the path from the root
+ * that are shared with another tree, so a snapshot never observes any
+ * later modification, and vice versa. Nodes are reference counted and
+ * freed when the last tree referencing them is modified or destroyed.
+ *
+ * No methods are thread safe on the same tree, but a tree and its
+ * snapshots may be used concurrently from different threads.
+ */
+
+/**
+ * Visitor method for traversals.
+ * @param the item.
+ * @param the user provided argument.
+ * @return 0 to continue the traversal, non zero to stop.
+ */
+typedef int (*pbtree_visit)(void*, void*);
+
+/**
+ * Create an empty persistent tree.
+ * @param the compare method to use.
+ * @return the tree, or NULL on failure.
+ */
+extern struct pbtree* pbtree_create(btree_cmp);
+
+/**
+ * Create a snapshot of the tree in O(1).
+ * The snapshot is a tree of its own, and must be destroyed with
+ * pbtree_destroy.
+ * @param the tree.
+ * @return the snapshot, or NULL on failure.
+ */
+extern struct pbtree* pbtree_snapshot(const struct pbtree*);
+
+/**
+ * Destroy a tree, nodes shared with other trees are kept.
+ * @param the tree to destroy.
+ * @return void.
+ */
+extern void pbtree_destroy(struct pbtree*);
+
+/**
+ * Insert an item into the tree.
+ * If an item with the same order is present, it will be replaced with the
+ * new value.
+ * @param the tree.
+ * @param the item to insert.
+ * @return 0 on success, -1 if no memory could be allocated.
+ */
+extern int pbtree_insert(struct pbtree*, void*);
+
+/**
+ * Search for an item in the tree.
+ * @param the tree to search in.
+ * @param the item to look for.
+ * @return the item, or NULL if not found.
+ */
+extern void* pbtree_find(const struct pbtree*, const void*);
+
+/**
+ * Remove an item from the tree.
+ * @param the tree to update.
+ * @param the item to remove.
+ * @return the item, or NULL if not found or no memory could be
+ *         allocated.
+ */
+extern void* pbtree_remove(struct pbtree*, const void*);
+
+/**
+ * Visit all items in order.
+ * @param the tree.
+ * @param the visitor.
+ * @param argument passed to the visitor.
+ * @return 0 if all items were visited, the visitor's return value if
+ *         the traversal was stopped.
+ */
+extern int pbtree_walk(const struct pbtree*, pbtree_visit, void*);
+
+/**
+ * Return the number of items in the tree.
+ * @param the tree.
+ * @return the num of items in the tree.
+ */
+extern size_t pbtree_size(const struct pbtree*);
+
+#endif /* __PBTREE_H__ */
@@ -0,0 +1,243 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <scut.h>
+#include <pthread.h>
+#include "pbtree.h"
+
+static int test_pbt_insert(void);
+static int test_pbt_remove(void);
+static int test_pbt_snapshot(void);
+static int test_pbt_snapshot_thread(void);
+static int cmp_lng(const void*, const void*);
+
+struct check
+{
+        long next;
+        long step;
+        long count;
+};
+
+int test_pbtree(void)
+{
+        int ret;
+
+        scut_create("Test persistent tree");
+
+        SCUT_ADD(test_pbt_insert);
+        SCUT_ADD(test_pbt_remove);
+        SCUT_ADD(test_pbt_snapshot);
+        SCUT_ADD(test_pbt_snapshot_thread);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+static int cmp_lng(const void* a, const void* b)
+{
+        long s1 = (long)a;
+        long s2 = (long)b;
+        int ret = 0;
+
+        if (s1 > s2)
+        {
+                ret = 1;
+        }
+        if (s1 < s2)
+        {
+                ret = -1;
+        }
+
+        return ret;
+}
+
+/* Verify items are visited in order next, next + step, ... */
+static int visit_check(void* e, void* arg)
+{
+        struct check* c = arg;
+
+        if ((long)e != c->next)
+        {
+                return 1;
+        }
+        c->next += c->step;
+        c->count++;
+
+        return 0;
+}
+
+static int visit_stop(void* e, void* arg)
+{
+        (void)e;
+
+        return --(*(int*)arg) == 0 ? 2 : 0;
+}
+
+static int test_pbt_insert(void)
+{
+        struct pbtree* t = pbtree_create(&cmp_lng);
+        struct check c = {1, 1, 0};
+        int stop = 3;
+
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_IE(pbtree_size(t), 0);
+        SCUT_ASSERT_FALSE(pbtree_find(t, (void*)1l));
+
+        /* Sorted input shall not degenerate the tree */
+        for (long i = 1; i <= 10000; i++)
+        {
+                SCUT_ASSERT_IE(pbtree_insert(t, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(pbtree_insert(t, (void*)5l), 0);
+        SCUT_ASSERT_IE(pbtree_size(t), 10000);
+
+        for (long i = 1; i <= 10000; i++)
+        {
+                SCUT_ASSERT_IE(pbtree_find(t, (void*)i), i);
+        }
+        SCUT_ASSERT_IE(pbtree_walk(t, &visit_check, &c), 0);
+        SCUT_ASSERT_IE(c.count, 10000);
+        SCUT_ASSERT_IE(pbtree_walk(t, &visit_stop, &stop), 2);
+
+        pbtree_destroy(t);
+
+        return 0;
+}
+
+static int test_pbt_remove(void)
+{
+        struct pbtree* t = pbtree_create(&cmp_lng);
+        struct check c = {1, 2, 0};
+
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(pbtree_insert(t, (void*)((i * 7919) % 1000 + 1)), 0);
+        }
+        for (long i = 2; i <= 1000; i += 2)
+        {
+                SCUT_ASSERT_IE(pbtree_remove(t, (void*)i), i);
+        }
+        SCUT_ASSERT_FALSE(pbtree_remove(t, (void*)2l));
+        SCUT_ASSERT_IE(pbtree_size(t), 500);
+        SCUT_ASSERT_IE(pbtree_walk(t, &visit_check, &c), 0);
+        SCUT_ASSERT_IE(c.count, 500);
+
+        pbtree_destroy(t);
+
+        return 0;
+}
+
+static int test_pbt_snapshot(void)
+{
+        struct pbtree* t = pbtree_create(&cmp_lng);
+        struct pbtree* s1;
+        struct pbtree* s2;
+        struct check c;
+
+        for (long i = 1; i <= 1000; i++)
+        {
+                SCUT_ASSERT_IE(pbtree_insert(t, (void*)i), 0);
+        }
+
+        s1 = pbtree_snapshot(t);
+        SCUT_ASSERT_TRUE(s1);
+        SCUT_ASSERT_IE(pbtree_size(s1), 1000);
+
+        /* Modify the live tree */
+        for (long i = 1; i <= 1000; i += 2)
+        {
+                SCUT_ASSERT_IE(pbtree_remove(t, (void*)i), i);
+        }
+        for (long i = 1001; i <= 1500; i++)
+        {
+                SCUT_ASSERT_IE(pbtree_insert(t, (void*)i), 0);
+        }
+        s2 = pbtree_snapshot(t);
+
+        /* Snapshots are modifiable as well */
+        SCUT_ASSERT_IE(pbtree_remove(s2, (void*)1500l), 1500l);
+
+        /* s1 is unaffected */
+        c.next = 1;
+        c.step = 1;
+        c.count = 0;
+        SCUT_ASSERT_IE(pbtree_walk(s1, &visit_check, &c), 0);
+        SCUT_ASSERT_IE(c.count, 1000);
+        SCUT_ASSERT_FALSE(pbtree_find(s1, (void*)1001l));
+
+        /* Destroy the origin first, the snapshots keep the nodes */
+        pbtree_destroy(t);
+        SCUT_ASSERT_IE(pbtree_size(s2), 999);
+        SCUT_ASSERT_IE(pbtree_find(s2, (void*)2l), 2l);
+        SCUT_ASSERT_FALSE(pbtree_find(s2, (void*)3l));
+        SCUT_ASSERT_IE(pbtree_find(s2, (void*)1499l), 1499l);
+        SCUT_ASSERT_FALSE(pbtree_find(s2, (void*)1500l));
+        SCUT_ASSERT_IE(pbtree_find(s1, (void*)3l), 3l);
+
+        pbtree_destroy(s2);
+        pbtree_destroy(s1);
+
+        return 0;
+}
+
+static void* export_snapshot(void* arg)
+{
+        struct pbtree* s = arg;
+        struct check c = {1, 1, 0};
+
+        pbtree_walk(s, &visit_check, &c);
+        pbtree_destroy(s);
+
+        return (void*)c.count;
+}
+
+static int test_pbt_snapshot_thread(void)
+{
+        struct pbtree* t = pbtree_create(&cmp_lng);
+        pthread_t thr[8];
+
+        for (long i = 1; i <= 5000; i++)
+        {
+                SCUT_ASSERT_IE(pbtree_insert(t, (void*)i), 0);
+        }
+
+        /* Background jobs read and drop their snapshots while the
+           live tree is mutated */
+        for (int j = 0; j < 8; j++)
+        {
+                struct pbtree* s = pbtree_snapshot(t);
+
+                SCUT_ASSERT_IE(pthread_create(&thr[j], NULL, &export_snapshot, s), 0);
+                for (long i = 1; i <= 1000; i++)
+                {
+                        long v = 5000 + j * 1000 + i;
+
+                        SCUT_ASSERT_IE(pbtree_insert(t, (void*)v), 0);
+                        SCUT_ASSERT_IE(pbtree_remove(t, (void*)v), v);
+                }
+                SCUT_ASSERT_IE(pbtree_insert(t, (void*)(5001l + j)), 0);
+        }
+        for (int j = 0; j < 8; j++)
+        {
+                void* count;
+
+                pthread_join(thr[j], &count);
+                SCUT_ASSERT_IE(count, 5000 + j);
+        }
+
+        pbtree_destroy(t);
+
+        return 0;
+}
@@ -0,0 +1,412 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include "pheap.h"
+#include <stdlib.h>
+
+/* Number of nodes in a slab */
+#define PHEAP_SLAB 256
+
+struct pheap_node
+{
+        void* data;
+        /* Leftmost child */
+        struct pheap_node* child;
+        /* Right sibling, also links free nodes */
+        struct pheap_node* sibling;
+        /* Left sibling, or parent for the leftmost child */
+        struct pheap_node* prev;
+};
+
+struct pheap_slab
+{
+        struct pheap_slab* next;
+        struct pheap_node nodes[PHEAP_SLAB];
+};
+
+struct pheap
+{
+        struct pheap_node* root;
+        heap_cmp cmp;
+        size_t size;
+        /* Slabs, the first one is partially used */
+        struct pheap_slab* slabs;
+        struct pheap_slab* last;
+        size_t used;
+        /* Free nodes, with the tail kept to splice lists on meld */
+        struct pheap_node* free;
+        struct pheap_node* free_last;
+};
+
+/**
+ * Take a node from the pool.
+ * @param the heap.
+ * @return the node, or NULL if no memory could be allocated.
+ */
+static struct pheap_node* alloc_node(struct pheap*);
+
+/**
+ * Return a node to the pool.
+ * @param the heap.
+ * @param the node.
+ * @return void.
+ */
+static void free_node(struct pheap*, struct pheap_node*);
+
+/**
+ * Link two roots, the one of lower order becomes the leftmost child of
+ * the other.
+ * @param the heap.
+ * @param the first root.
+ * @param the second root.
+ * @return the new root.
+ */
+static struct pheap_node* link(const struct pheap*, struct pheap_node*,
+                               struct pheap_node*);
+
+/**
+ * Link a list of siblings into a single tree, first pairwise left to
+ * right and then right to left.
+ * @param the heap.
+ * @param the leftmost sibling, or NULL.
+ * @return the root of the tree, or NULL.
+ */
+static struct pheap_node* merge_pairs(const struct pheap*,
+                                      struct pheap_node*);
+
+/**
+ * Detach a non root node, with its children, from the tree.
+ * @param the node.
+ * @return void.
+ */
+static void cut(struct pheap_node*);
+
+struct pheap* pheap_create(heap_cmp cmp)
+{
+        struct pheap* h = malloc(sizeof(struct pheap));
+
+        if (h == NULL)
+        {
+                return NULL;
+        }
+        h->root = NULL;
+        h->cmp = cmp;
+        h->size = 0;
+        h->slabs = NULL;
+        h->last = NULL;
+        h->used = PHEAP_SLAB;
+        h->free = NULL;
+        h->free_last = NULL;
+
+        return h;
+}
+
+void pheap_destroy(struct pheap* h)
+{
+        pheap_clear(h);
+        free(h);
+}
+
+void pheap_clear(struct pheap* h)
+{
+        struct pheap_slab* s = h->slabs;
+
+        while (s)
+        {
+                struct pheap_slab* next = s->next;
+
+                free(s);
+                s = next;
+        }
+        h->root = NULL;
+        h->size = 0;
+        h->slabs = NULL;
+        h->last = NULL;
+        h->used = PHEAP_SLAB;
+        h->free = NULL;
+        h->free_last = NULL;
+}
+
+int pheap_insert(struct pheap* h, void* e)
+{
+        return pheap_insert_node(h, e) ? 0 : -1;
+}
+
+struct pheap_node* pheap_insert_node(struct pheap* h, void* e)
+{
+        struct pheap_node* n = alloc_node(h);
+
+        if (n == NULL)
+        {
+                return NULL;
+        }
+        n->data = e;
+        n->child = NULL;
+        n->sibling = NULL;
+        n->prev = NULL;
+        h->root = h->root ? link(h, h->root, n) : n;
+        h->size++;
+
+        return n;
+}
+
+void* pheap_peek(const struct pheap* h)
+{
+        return h->root ? h->root->data : NULL;
+}
+
+void* pheap_min(struct pheap* h)
+{
+        struct pheap_node* r = h->root;
+        void* ret;
+
+        if (r == NULL)
+        {
+                return NULL;
+        }
+
+        ret = r->data;
+        h->root = merge_pairs(h, r->child);
+        if (h->root)
+        {
+                h->root->prev = NULL;
+        }
+        free_node(h, r);
+        h->size--;
+
+        return ret;
+}
+
+void pheap_promote(struct pheap* h, struct pheap_node* n)
+{
+        if (n == h->root)
+        {
+                return;
+        }
+
+        /* The subtree of n is still ordered, only its link to the
+           parent may be violated */
+        cut(n);
+        h->root = link(h, h->root, n);
+}
+
+void* pheap_remove(struct pheap* h, struct pheap_node* n)
+{
+        struct pheap_node* sub;
+        void* ret;
+
+        if (n == h->root)
+        {
+                return pheap_min(h);
+        }
+
+        ret = n->data;
+        cut(n);
+        sub = merge_pairs(h, n->child);
+        if (sub)
+        {
+                sub->prev = NULL;
+                h->root = link(h, h->root, sub);
+        }
+        free_node(h, n);
+        h->size--;
+
+        return ret;
+}
+
+void pheap_meld(struct pheap* a, struct pheap* b)
+{
+        if (b->root)
+        {
+                a->root = a->root ? link(a, a->root, b->root) : b->root;
+        }
+        a->size += b->size;
+
+        /* Hand over the pool, the unused nodes of b's first slab are
+           put on the free list */
+        while (b->used < PHEAP_SLAB)
+        {
+                free_node(b, &b->slabs->nodes[b->used++]);
+        }
+        if (b->slabs)
+        {
+                if (a->last)
+                {
+                        a->last->next = b->slabs;
+                }
+                else
+                {
+                        a->slabs = b->slabs;
+                        a->used = PHEAP_SLAB;
+                }
+                a->last = b->last;
+        }
+        if (b->free)
+        {
+                if (a->free_last)
+                {
+                        a->free_last->sibling = b->free;
+                }
+                else
+                {
+                        a->free = b->free;
+                }
+                a->free_last = b->free_last;
+        }
+
+        b->root = NULL;
+        b->size = 0;
+        b->slabs = NULL;
+        b->last = NULL;
+        b->free = NULL;
+        b->free_last = NULL;
+}
+
+size_t pheap_size(const struct pheap* h)
+{
+        return h->size;
+}
+
+static struct pheap_node* alloc_node(struct pheap* h)
+{
+        struct pheap_node* n = h->free;
+
+        if (n)
+        {
+                h->free = n->sibling;
+                if (h->free == NULL)
+                {
+                        h->free_last = NULL;
+                }
+                return n;
+        }
+
+        if (h->used == PHEAP_SLAB)
+        {
+                struct pheap_slab* s = malloc(sizeof(struct pheap_slab));
+
+                if (s == NULL)
+                {
+                        return NULL;
+                }
+                s->next = h->slabs;
+                h->slabs = s;
+                if (h->last == NULL)
+                {
+                        h->last = s;
+                }
+                h->used = 0;
+        }
+
+        return &h->slabs->nodes[h->used++];
+}
+
+static void free_node(struct pheap* h, struct pheap_node* n)
+{
+        n->sibling = h->free;
+        if (h->free == NULL)
+        {
+                h->free_last = n;
+        }
+        h->free = n;
+}
+
+static struct pheap_node* link(const struct pheap* h,
+                               struct pheap_node* a,
+                               struct pheap_node* b)
+{
+        struct pheap_node* tmp;
+
+        if (h->cmp(b->data, a->data) > 0)
+        {
+                tmp = a;
+                a = b;
+                b = tmp;
+        }
+
+        /* b becomes the leftmost child of a */
+        b->sibling = a->child;
+        if (a->child)
+        {
+                a->child->prev = b;
+        }
+        b->prev = a;
+        a->child = b;
+        a->sibling = NULL;
+        a->prev = NULL;
+
+        return a;
+}
+
+static struct pheap_node* merge_pairs(const struct pheap* h,
+                                      struct pheap_node* first)
+{
+        struct pheap_node* pairs = NULL;
+        struct pheap_node* root;
+
+        /* Left to right, link pairs and push them on a stack linked
+           through the sibling pointer */
+        while (first)
+        {
+                struct pheap_node* a = first;
+                struct pheap_node* b = a->sibling;
+
+                if (b == NULL)
+                {
+                        a->sibling = pairs;
+                        pairs = a;
+                        break;
+                }
+                first = b->sibling;
+                a = link(h, a, b);
+                a->sibling = pairs;
+                pairs = a;
+        }
+
+        /* Right to left, link each pair into the result */
+        if (pairs == NULL)
+        {
+                return NULL;
+        }
+        root = pairs;
+        pairs = pairs->sibling;
+        root->sibling = NULL;
+        while (pairs)
+        {
+                struct pheap_node* next = pairs->sibling;
+
+                root = link(h, root, pairs);
+                pairs = next;
+        }
+
+        return root;
+}
+
+static void cut(struct pheap_node* n)
+{
+        if (n->prev->child == n)
+        {
+                n->prev->child = n->sibling;
+        }
+        else
+        {
+                n->prev->sibling = n->sibling;
+        }
+        if (n->sibling)
+        {
+                n->sibling->prev = n->prev;
+        }
+        n->sibling = NULL;
+        n->prev = NULL;
+}
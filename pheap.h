@@ -0,0 +1,124 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#ifndef __PHEAP_H__
+#define __PHEAP_H__
+
+#include <stddef.h>
+#include "heap.h"
+
+struct pheap;
+struct pheap_node;
+
+/*
+ * Pairing heap, a heap built from linked nodes rather than an array.
+ * Insert, meld and promote run in O(1), extracting the highest ordered
+ * item runs in amortized O(log n). Melding two heaps takes constant
+ * time, regardless of their sizes.
+ * Items are ordered with a heap_cmp, as for heap, the highest order
+ * item is at the root. Nodes are allocated from a per heap slab pool,
+ * that is handed over when heaps are melded.
+ *
+ * No methods are thread safe, external locking is required.
+ */
+
+/**
+ * Create an empty pairing heap.
+ * @param the order method to use when ordering the the heap.
+ * @return the newly created heap, or NULL on failure.
+ */
+extern struct pheap* pheap_create(heap_cmp);
+
+/**
+ * Destroy the heap and free any memory it has allocated.
+ * @param the heap.
+ * @return void.
+ */
+extern void pheap_destroy(struct pheap*);
+
+/**
+ * Remove all items from the heap.
+ * @param the heap.
+ * @return void.
+ */
+extern void pheap_clear(struct pheap*);
+
+/**
+ * Insert a new item into the heap.
+ * @param the heap.
+ * @param the item to insert.
+ * @return 0 if the item was inserted, non-zero otherwise.
+ */
+extern int pheap_insert(struct pheap*, void*);
+
+/**
+ * Insert a new item into the heap, and get the node holding it.
+ * The node is valid until the item is extracted or removed, and follows
+ * the item when the heap is melded into another heap.
+ * @param the heap.
+ * @param the item to insert.
+ * @return the node, or NULL if no memory could be allocated.
+ */
+extern struct pheap_node* pheap_insert_node(struct pheap*, void*);
+
+/**
+ * Return the higest ordered item, without extracting it.
+ * @param the heap.
+ * @return the higest order item, or NULL if heap is empty.
+ */
+extern void* pheap_peek(const struct pheap*);
+
+/**
+ * Extract the higest ordered item from the heap.
+ * @param the heap.
+ * @return the higest order item, or NULL if heap is empty.
+ */
+extern void* pheap_min(struct pheap*);
+
+/**
+ * Restore the position of an item after its order has been increased,
+ * the decrease key operation of a min heap. Runs in O(1). To lower the
+ * order of an item, remove it and insert it again.
+ * @param the heap.
+ * @param the node of the item.
+ * @return void.
+ */
+extern void pheap_promote(struct pheap*, struct pheap_node*);
+
+/**
+ * Remove an item from the heap. Runs in amortized O(log n).
+ * @param the heap.
+ * @param the node of the item.
+ * @return the item.
+ */
+extern void* pheap_remove(struct pheap*, struct pheap_node*);
+
+/**
+ * Move all items of the second heap into the first. Runs in O(1).
+ * The second heap is empty afterwards, but can still be used. Both
+ * heaps must use the same order method.
+ * @param the heap to meld into.
+ * @param the heap to meld from.
+ * @return void.
+ */
+extern void pheap_meld(struct pheap*, struct pheap*);
+
+/**
+ * Return the size of the heap.
+ * @param the heap.
+ * @return the number of items in the heap.
+ */
+extern size_t pheap_size(const struct pheap*);
+
+#endif /* __PHEAP_H__ */
@@ -0,0 +1,240 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include <scut.h>
+#include "pheap.h"
+
+static int test_ph_insert(void);
+static int test_ph_meld(void);
+static int test_ph_promote(void);
+static int test_ph_remove(void);
+
+/* Items of a heap, ordered by key */
+struct keyed
+{
+        long key;
+        struct pheap_node* node;
+};
+
+/* Lowest value has highest order */
+static int test_cmp(const void* a, const void* b)
+{
+        long t1 = (long)a;
+        long t2 = (long)b;
+
+        if (t1 < t2)
+        {
+                return 1;
+        }
+        else if (t1 > t2)
+        {
+                return -1;
+        }
+
+        return 0;
+}
+
+static int key_cmp(const void* a, const void* b)
+{
+        return test_cmp((void*)((const struct keyed*)a)->key,
+                        (void*)((const struct keyed*)b)->key);
+}
+
+int test_pheap(void)
+{
+        int ret;
+
+        scut_create("Test pairing heap");
+
+        SCUT_ADD(test_ph_insert);
+        SCUT_ADD(test_ph_meld);
+        SCUT_ADD(test_ph_promote);
+        SCUT_ADD(test_ph_remove);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+static int test_ph_insert(void)
+{
+        struct pheap* h = pheap_create(&test_cmp);
+        long size = 10000;
+
+        SCUT_ASSERT_TRUE(h);
+        SCUT_ASSERT_IE(pheap_size(h), 0);
+        SCUT_ASSERT_IE(pheap_peek(h), NULL);
+        SCUT_ASSERT_IE(pheap_min(h), NULL);
+
+        /* Duplicates, out of order */
+        for (long i = 0; i < size; i++)
+        {
+                SCUT_ASSERT_IE(pheap_insert(h, (void*)((i * 7919) % (size / 2))), 0);
+        }
+        SCUT_ASSERT_IE(pheap_size(h), size);
+        SCUT_ASSERT_IE(pheap_peek(h), 0);
+        for (long i = 0; i < size; i++)
+        {
+                SCUT_ASSERT_IE(pheap_min(h), i / 2);
+        }
+        SCUT_ASSERT_IE(pheap_size(h), 0);
+        SCUT_ASSERT_IE(pheap_min(h), NULL);
+
+        /* Nodes are reused after clear */
+        SCUT_ASSERT_IE(pheap_insert(h, (void*)2l), 0);
+        pheap_clear(h);
+        SCUT_ASSERT_IE(pheap_size(h), 0);
+        SCUT_ASSERT_IE(pheap_insert(h, (void*)1l), 0);
+        SCUT_ASSERT_IE(pheap_min(h), 1);
+
+        pheap_destroy(h);
+
+        return 0;
+}
+
+static int test_ph_meld(void)
+{
+        struct pheap* a = pheap_create(&test_cmp);
+        struct pheap* b = pheap_create(&test_cmp);
+        struct pheap* c = pheap_create(&test_cmp);
+        long size = 1000;
+
+        /* a has even, b odd values, b has a partially used slab */
+        for (long i = 0; i < size; i += 2)
+        {
+                SCUT_ASSERT_IE(pheap_insert(a, (void*)i), 0);
+                SCUT_ASSERT_IE(pheap_insert(b, (void*)(i + 1)), 0);
+        }
+        pheap_min(b);
+        pheap_meld(a, b);
+        SCUT_ASSERT_IE(pheap_size(a), size - 1);
+        SCUT_ASSERT_IE(pheap_size(b), 0);
+        SCUT_ASSERT_IE(pheap_min(b), NULL);
+
+        /* b is usable, and a can use b's nodes after b is gone */
+        SCUT_ASSERT_IE(pheap_insert(b, (void*)1l), 0);
+        pheap_meld(c, b);
+        pheap_meld(c, a);
+        pheap_destroy(a);
+        pheap_destroy(b);
+        SCUT_ASSERT_IE(pheap_size(c), size);
+        for (long i = 0; i < size; i++)
+        {
+                SCUT_ASSERT_IE(pheap_min(c), i);
+        }
+        for (long i = 0; i < 2 * size; i++)
+        {
+                SCUT_ASSERT_IE(pheap_insert(c, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(pheap_min(c), 0);
+        SCUT_ASSERT_IE(pheap_size(c), 2 * size - 1);
+
+        /* Melding an empty heap */
+        a = pheap_create(&test_cmp);
+        pheap_meld(c, a);
+        pheap_meld(a, c);
+        SCUT_ASSERT_IE(pheap_size(a), 2 * size - 1);
+        SCUT_ASSERT_IE(pheap_min(a), 1);
+
+        pheap_destroy(a);
+        pheap_destroy(c);
+
+        return 0;
+}
+
+static int test_ph_promote(void)
+{
+        struct keyed items[1000];
+        long size = 1000;
+        struct pheap* h = pheap_create(&key_cmp);
+
+        for (long i = 0; i < size; i++)
+        {
+                items[i].key = (i * 7919) % size + size;
+                items[i].node = pheap_insert_node(h, &items[i]);
+                SCUT_ASSERT_TRUE(items[i].node);
+        }
+        /* Extract once, so the heap is not a flat list */
+        SCUT_ASSERT_IE(((struct keyed*)pheap_min(h))->key, size);
+        for (long i = 0; i < size; i++)
+        {
+                if (items[i].key == size)
+                {
+                        items[i].node = NULL;
+                }
+        }
+
+        /* Move every other key to the other side of the rest */
+        for (long i = 0; i < size; i += 2)
+        {
+                if (items[i].node)
+                {
+                        items[i].key -= size;
+                        pheap_promote(h, items[i].node);
+                }
+        }
+        for (long i = 0, prev = 0; i < size - 1; i++)
+        {
+                struct keyed* k = pheap_min(h);
+
+                SCUT_ASSERT_TRUE(k->key >= prev);
+                prev = k->key;
+        }
+        SCUT_ASSERT_IE(pheap_size(h), 0);
+
+        pheap_destroy(h);
+
+        return 0;
+}
+
+static int test_ph_remove(void)
+{
+        struct keyed items[1000];
+        long size = 1000;
+        struct pheap* h = pheap_create(&key_cmp);
+
+        for (long i = 0; i < size; i++)
+        {
+                items[i].key = (i * 7919) % size;
+                items[i].node = pheap_insert_node(h, &items[i]);
+        }
+        SCUT_ASSERT_IE(pheap_min(h), &items[0]);
+
+        /* Remove all odd keys, including the root */
+        for (long i = size - 1; i > 0; i--)
+        {
+                if (items[i].key & 1)
+                {
+                        SCUT_ASSERT_IE(pheap_remove(h, items[i].node), &items[i]);
+                }
+        }
+        SCUT_ASSERT_IE(pheap_size(h), size / 2 - 1);
+        SCUT_ASSERT_IE(pheap_remove(h, items[2].node), &items[2]);
+        for (long i = 2; i < size; i += 2)
+        {
+                struct keyed* k = pheap_min(h);
+
+                if (i == items[2].key)
+                {
+                        i += 2;
+                }
+                SCUT_ASSERT_IE(k->key, i);
+        }
+        SCUT_ASSERT_IE(pheap_size(h), 0);
+
+        pheap_destroy(h);
+
+        return 0;
+}
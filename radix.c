@@ -0,0 +1,580 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "radix.h"
+
+/**
+ * A node holds the label of the edge leading to it, and its children
+ * sorted by the first byte of their label. Everything is stored in one
+ * allocation, the node is followed by:
+ * children[cap] | first byte of each child[cap] | label[len]
+ * A child is found by scanning the bytes, without touching the children
+ * themselves. The node is reallocated when the child array grows.
+ */
+struct rnode
+{
+        void* data;
+        uint32_t len;
+        /* No child starts with nul, so there are at most 255 */
+        uint8_t n;
+        uint8_t cap;
+        /* Set if the node terminates a key */
+        uint8_t key;
+};
+
+struct radix
+{
+        struct rnode* root;
+        size_t len;
+        size_t mem;
+};
+
+/**
+ * Buffer for the key during scans.
+ */
+struct keybuf
+{
+        char* buf;
+        size_t len;
+        size_t cap;
+};
+
+#define KIDS(n) ((struct rnode**)((n) + 1))
+#define BYTES(n) ((unsigned char*)(KIDS(n) + (n)->cap))
+#define LABEL(n) ((char*)(BYTES(n) + (n)->cap))
+#define NODE_SIZE(cap, len) (sizeof(struct rnode) + \
+                             (size_t)(cap) * (sizeof(struct rnode*) + 1) + \
+                             (len))
+
+/**
+ * Allocate a node without children.
+ * @param the tree.
+ * @param the label, NULL to leave it uninitialized.
+ * @param length of the label.
+ * @param capacity for children.
+ * @return the node, or NULL if no memory could be allocated.
+ */
+static struct rnode* alloc_node(struct radix*, const char*, size_t,
+                                uint8_t);
+static void free_node(struct radix*, struct rnode*);
+static void free_tree(struct radix*, struct rnode*);
+/**
+ * Find the slot of the child starting with a byte.
+ * @param the node.
+ * @param the byte.
+ * @return the slot, or NULL if there is no such child.
+ */
+static struct rnode** child(struct rnode*, unsigned char);
+/**
+ * Add a child, there must not be a child with the same first byte.
+ * The node may be moved.
+ * @param the tree.
+ * @param the slot referencing the node.
+ * @param the child.
+ * @return 0 on success.
+ */
+static int add_child(struct radix*, struct rnode**, struct rnode*);
+static void remove_child(struct rnode*, unsigned char);
+/**
+ * Reallocate a node with a new capacity for children.
+ * @param the tree.
+ * @param the slot referencing the node.
+ * @param the capacity, at least the number of children.
+ * @return 0 on success.
+ */
+static int resize(struct radix*, struct rnode**, unsigned int);
+/**
+ * Merge a node without key and with a single child with the child.
+ * @param the tree.
+ * @param the slot referencing the node.
+ * @return void.
+ */
+static void merge(struct radix*, struct rnode**);
+static size_t common(const char*, size_t, const char*);
+static int push(struct keybuf*, const char*, size_t);
+static int walk(struct rnode*, struct keybuf*, radix_visit, void*);
+
+struct radix* radix_create(void)
+{
+        struct radix* t = malloc(sizeof(struct radix));
+
+        if (t == NULL)
+        {
+                return NULL;
+        }
+
+        t->len = 0;
+        t->mem = sizeof(struct radix);
+        t->root = alloc_node(t, "", 0, 0);
+        if (t->root == NULL)
+        {
+                free(t);
+                return NULL;
+        }
+
+        return t;
+}
+
+void radix_destroy(struct radix* t)
+{
+        free_tree(t, t->root);
+        free(t);
+}
+
+int radix_insert(struct radix* t, const char* k, void* d)
+{
+        struct rnode** nslot = &t->root;
+
+        for (;;)
+        {
+                struct rnode* n = *nslot;
+                struct rnode** slot;
+                struct rnode* c;
+                size_t l;
+
+                if (*k == '\0')
+                {
+                        if (!n->key)
+                        {
+                                n->key = 1;
+                                t->len++;
+                        }
+                        n->data = d;
+                        return 0;
+                }
+
+                slot = child(n, (unsigned char)*k);
+                if (slot == NULL)
+                {
+                        c = alloc_node(t, k, strlen(k), 0);
+                        if (c == NULL)
+                        {
+                                return -1;
+                        }
+                        if (add_child(t, nslot, c))
+                        {
+                                free_node(t, c);
+                                return -1;
+                        }
+                        c->key = 1;
+                        c->data = d;
+                        t->len++;
+                        return 0;
+                }
+
+                c = *slot;
+                l = common(LABEL(c), c->len, k);
+                if (l < c->len)
+                {
+                        /* Split the edge, the new node takes the common
+                           part of the label and c as its only child */
+                        struct rnode* mid = alloc_node(t, LABEL(c), l, 2);
+                        struct rnode* shrunk;
+
+                        if (mid == NULL)
+                        {
+                                return -1;
+                        }
+                        memmove(LABEL(c), LABEL(c) + l, c->len - l);
+                        c->len -= (uint32_t)l;
+                        t->mem -= l;
+                        /* Shrinking can't fail in practice, if it does
+                           the node is just kept at its old size */
+                        shrunk = realloc(c, NODE_SIZE(c->cap, c->len));
+                        if (shrunk)
+                        {
+                                c = shrunk;
+                        }
+                        KIDS(mid)[0] = c;
+                        BYTES(mid)[0] = (unsigned char)LABEL(c)[0];
+                        mid->n = 1;
+                        *slot = mid;
+                }
+                nslot = slot;
+                k += l;
+        }
+}
+
+void* radix_find(const struct radix* t, const char* k)
+{
+        struct rnode* n = t->root;
+
+        while (*k)
+        {
+                struct rnode** slot = child(n, (unsigned char)*k);
+
+                if (slot == NULL)
+                {
+                        return NULL;
+                }
+                n = *slot;
+                /* The first byte is already matched */
+                if (strncmp(LABEL(n) + 1, k + 1, n->len - 1) != 0)
+                {
+                        return NULL;
+                }
+                k += n->len;
+        }
+
+        return n->key ? n->data : NULL;
+}
+
+void* radix_remove(struct radix* t, const char* k)
+{
+        struct rnode** pslot = NULL;
+        struct rnode** slot = &t->root;
+        struct rnode* n = t->root;
+        struct rnode* p;
+        void* ret;
+
+        while (*k)
+        {
+                struct rnode** s = child(n, (unsigned char)*k);
+
+                if (s == NULL ||
+                    strncmp(LABEL(*s) + 1, k + 1, (*s)->len - 1) != 0)
+                {
+                        return NULL;
+                }
+                pslot = slot;
+                slot = s;
+                n = *s;
+                k += n->len;
+        }
+        if (!n->key)
+        {
+                return NULL;
+        }
+
+        ret = n->data;
+        n->key = 0;
+        n->data = NULL;
+        t->len--;
+
+        if (n == t->root)
+        {
+                return ret;
+        }
+        if (n->n == 1)
+        {
+                merge(t, slot);
+        }
+        else if (n->n == 0)
+        {
+                p = *pslot;
+                remove_child(p, (unsigned char)LABEL(n)[0]);
+                free_node(t, n);
+                if (p != t->root && !p->key && p->n == 1)
+                {
+                        merge(t, pslot);
+                }
+                else if (p->n <= p->cap / 2)
+                {
+                        /* Give back unused space, a failure is harmless */
+                        resize(t, pslot, p->n);
+                }
+        }
+
+        return ret;
+}
+
+int radix_prefix(const struct radix* t,
+                 const char* p,
+                 radix_visit fn,
+                 void* arg)
+{
+        struct rnode* n = t->root;
+        struct keybuf kb = {NULL, 0, 0};
+        int r;
+
+        while (*p)
+        {
+                struct rnode** slot = child(n, (unsigned char)*p);
+                size_t plen = strlen(p);
+                size_t l;
+
+                if (slot == NULL)
+                {
+                        free(kb.buf);
+                        return 0;
+                }
+                n = *slot;
+                l = n->len < plen ? n->len : plen;
+                if (memcmp(LABEL(n), p, l) != 0)
+                {
+                        free(kb.buf);
+                        return 0;
+                }
+                /* The whole label is part of the keys, also when the
+                   prefix ends within it */
+                if (push(&kb, LABEL(n), n->len))
+                {
+                        free(kb.buf);
+                        return -1;
+                }
+                p += l;
+        }
+
+        r = walk(n, &kb, fn, arg);
+        free(kb.buf);
+
+        return r;
+}
+
+size_t radix_size(const struct radix* t)
+{
+        return t->len;
+}
+
+size_t radix_memory(const struct radix* t)
+{
+        return t->mem;
+}
+
+static struct rnode* alloc_node(struct radix* t,
+                                const char* label,
+                                size_t len,
+                                uint8_t cap)
+{
+        struct rnode* n = malloc(NODE_SIZE(cap, len));
+
+        if (n == NULL)
+        {
+                return NULL;
+        }
+
+        n->data = NULL;
+        n->len = (uint32_t)len;
+        n->n = 0;
+        n->cap = cap;
+        n->key = 0;
+        if (label)
+        {
+                memcpy(LABEL(n), label, len);
+        }
+        t->mem += NODE_SIZE(cap, len);
+
+        return n;
+}
+
+static void free_node(struct radix* t, struct rnode* n)
+{
+        t->mem -= NODE_SIZE(n->cap, n->len);
+        free(n);
+}
+
+static void free_tree(struct radix* t, struct rnode* n)
+{
+        /* Recursion depth is bounded by the length of the longest key */
+        for (size_t i = 0; i < n->n; i++)
+        {
+                free_tree(t, KIDS(n)[i]);
+        }
+        free_node(t, n);
+}
+
+static struct rnode** child(struct rnode* n, unsigned char b)
+{
+        const unsigned char* bytes = BYTES(n);
+        const unsigned char* f;
+
+        if (n->n == 0)
+        {
+                return NULL;
+        }
+        f = memchr(bytes, b, n->n);
+        if (f == NULL)
+        {
+                return NULL;
+        }
+
+        return &KIDS(n)[f - bytes];
+}
+
+static int add_child(struct radix* t, struct rnode** slot, struct rnode* c)
+{
+        struct rnode* n = *slot;
+        unsigned char b = (unsigned char)LABEL(c)[0];
+        unsigned char* bytes;
+        size_t pos;
+
+        if (n->n == n->cap)
+        {
+                /* Grow by half, most nodes have few children */
+                unsigned int cap = n->cap < 4 ? n->cap + 1u :
+                        n->cap + n->cap / 2u;
+
+                if (resize(t, slot, cap > 255 ? 255 : cap))
+                {
+                        return -1;
+                }
+                n = *slot;
+        }
+
+        bytes = BYTES(n);
+        pos = 0;
+        while (pos < n->n && bytes[pos] < b)
+        {
+                pos++;
+        }
+        memmove(KIDS(n) + pos + 1, KIDS(n) + pos,
+                (n->n - pos) * sizeof(struct rnode*));
+        memmove(bytes + pos + 1, bytes + pos, n->n - pos);
+        KIDS(n)[pos] = c;
+        bytes[pos] = b;
+        n->n++;
+
+        return 0;
+}
+
+static void remove_child(struct rnode* n, unsigned char b)
+{
+        unsigned char* bytes = BYTES(n);
+        size_t pos = (size_t)((unsigned char*)memchr(bytes, b, n->n) - bytes);
+
+        memmove(KIDS(n) + pos, KIDS(n) + pos + 1,
+                (n->n - pos - 1) * sizeof(struct rnode*));
+        memmove(bytes + pos, bytes + pos + 1, n->n - pos - 1);
+        n->n--;
+}
+
+static int resize(struct radix* t, struct rnode** slot, unsigned int cap)
+{
+        struct rnode* n = *slot;
+        struct rnode* g = malloc(NODE_SIZE(cap, n->len));
+
+        if (g == NULL)
+        {
+                return -1;
+        }
+        g->data = n->data;
+        g->len = n->len;
+        g->n = n->n;
+        g->cap = (uint8_t)cap;
+        g->key = n->key;
+        memcpy(KIDS(g), KIDS(n), n->n * sizeof(struct rnode*));
+        memcpy(BYTES(g), BYTES(n), n->n);
+        memcpy(LABEL(g), LABEL(n), n->len);
+        t->mem += NODE_SIZE(cap, n->len);
+        free_node(t, n);
+        *slot = g;
+
+        return 0;
+}
+
+static void merge(struct radix* t, struct rnode** slot)
+{
+        struct rnode* n = *slot;
+        struct rnode* c = KIDS(n)[0];
+        struct rnode* m = alloc_node(t, NULL, n->len + c->len, c->cap);
+
+        if (m == NULL)
+        {
+                /* Leave the tree uncompressed, it's still valid */
+                return;
+        }
+        memcpy(LABEL(m), LABEL(n), n->len);
+        memcpy(LABEL(m) + n->len, LABEL(c), c->len);
+        memcpy(KIDS(m), KIDS(c), c->n * sizeof(struct rnode*));
+        memcpy(BYTES(m), BYTES(c), c->n);
+        m->data = c->data;
+        m->key = c->key;
+        m->n = c->n;
+
+        *slot = m;
+        free_node(t, c);
+        free_node(t, n);
+}
+
+static size_t common(const char* label, size_t len, const char* k)
+{
+        size_t i = 0;
+
+        /* k is nul terminated, and label never contains nul */
+        while (i < len && label[i] == k[i])
+        {
+                i++;
+        }
+
+        return i;
+}
+
+static int push(struct keybuf* kb, const char* s, size_t len)
+{
+        if (kb->len + len + 1 > kb->cap)
+        {
+                size_t cap = kb->cap ? kb->cap : 64;
+                char* buf;
+
+                while (cap < kb->len + len + 1)
+                {
+                        cap *= 2;
+                }
+                buf = realloc(kb->buf, cap);
+                if (buf == NULL)
+                {
+                        return -1;
+                }
+                kb->buf = buf;
+                kb->cap = cap;
+        }
+        memcpy(kb->buf + kb->len, s, len);
+        kb->len += len;
+        kb->buf[kb->len] = '\0';
+
+        return 0;
+}
+
+static int walk(struct rnode* n,
+                struct keybuf* kb,
+                radix_visit fn,
+                void* arg)
+{
+        size_t len = kb->len;
+        int r;
+
+        if (kb->buf == NULL && push(kb, "", 0))
+        {
+                return -1;
+        }
+        if (n->key)
+        {
+                if ((r = fn(kb->buf, n->data, arg)) != 0)
+                {
+                        return r;
+                }
+        }
+        /* Children are sorted by their first byte, so keys are visited
+           in order */
+        for (size_t i = 0; i < n->n; i++)
+        {
+                struct rnode* c = KIDS(n)[i];
+
+                if (push(kb, LABEL(c), c->len))
+                {
+                        return -1;
+                }
+                r = walk(c, kb, fn, arg);
+                kb->len = len;
+                kb->buf[len] = '\0';
+                if (r)
+                {
+                        return r;
+                }
+        }
+
+        return 0;
+}
@@ -0,0 +1,105 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#ifndef __RADIX_H__
+#define __RADIX_H__
+
+#include <stddef.h>
+
+struct radix;
+
+/*
+ * Ordered map from strings to data pointers, implemented as a path
+ * compressed radix tree. A prefix shared by many keys is stored once,
+ * and a lookup compares each byte of the key at most once rather than
+ * comparing full keys at every level. Keys are copied into the tree.
+ * Keys are ordered as by strcmp.
+ *
+ * No methods are thread safe, external locking is required.
+ */
+
+/**
+ * Visitor method for scans.
+ * @param the key, only valid during the call.
+ * @param the data.
+ * @param the user provided argument.
+ * @return 0 to continue the scan, non zero to stop.
+ */
+typedef int (*radix_visit)(const char*, void*, void*);
+
+/**
+ * Create an empty tree.
+ * @return the tree, or NULL on failure.
+ */
+extern struct radix* radix_create(void);
+
+/**
+ * Destroy the tree and free any memory occupied.
+ * @param the tree to destroy.
+ * @return void.
+ */
+extern void radix_destroy(struct radix*);
+
+/**
+ * Insert a key. If the key is present, the data is replaced.
+ * @param the tree.
+ * @param the key.
+ * @param the data.
+ * @return 0 on success, -1 if no memory could be allocated.
+ */
+extern int radix_insert(struct radix*, const char*, void*);
+
+/**
+ * Search for a key.
+ * @param the tree.
+ * @param the key.
+ * @return the data, or NULL if not found.
+ */
+extern void* radix_find(const struct radix*, const char*);
+
+/**
+ * Remove a key.
+ * @param the tree.
+ * @param the key.
+ * @return the data, or NULL if not found.
+ */
+extern void* radix_remove(struct radix*, const char*);
+
+/**
+ * Visit all keys starting with a prefix, in order.
+ * The tree must not be modified during the scan.
+ * @param the tree.
+ * @param the prefix, "" visits all keys.
+ * @param the visitor.
+ * @param argument passed to the visitor.
+ * @return 0 if all keys were visited, the visitor's return value if the
+ *         scan was stopped, -1 if no memory could be allocated.
+ */
+extern int radix_prefix(const struct radix*, const char*, radix_visit,
+                        void*);
+
+/**
+ * Return the number of keys in the tree.
+ * @param the tree.
+ * @return the number of keys.
+ */
+extern size_t radix_size(const struct radix*);
+
+/**
+ * Return the number of bytes allocated by the tree.
+ * @param the tree.
+ * @return the number of bytes.
+ */
+extern size_t radix_memory(const struct radix*);
+
+#endif /* __RADIX_H__ */
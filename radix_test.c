@@ -0,0 +1,244 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+#include <scut.h>
+#include <stdio.h>
+#include <string.h>
+#include "radix.h"
+
+#define NUM_PATHS 5000
+
+static int test_rdx_insert(void);
+static int test_rdx_remove(void);
+static int test_rdx_prefix(void);
+static int test_rdx_memory(void);
+static void path(char*, long);
+
+struct scan
+{
+        char prev[128];
+        long count;
+};
+
+int test_radix(void)
+{
+        int ret;
+
+        scut_create("Test radix tree");
+
+        SCUT_ADD(test_rdx_insert);
+        SCUT_ADD(test_rdx_remove);
+        SCUT_ADD(test_rdx_prefix);
+        SCUT_ADD(test_rdx_memory);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+static void path(char* buf, long i)
+{
+        static const char* svc[] = {"users", "orders", "items", "user"};
+
+        sprintf(buf, "https://static.example.com/assets/images/thumbnails/%s/%ld",
+                svc[i % 4], i / 4);
+}
+
+/* Verify keys are visited in increasing order */
+static int visit_order(const char* k, void* d, void* arg)
+{
+        struct scan* s = arg;
+
+        (void)d;
+        if (s->count > 0 && strcmp(s->prev, k) >= 0)
+        {
+                return -1;
+        }
+        strcpy(s->prev, k);
+        s->count++;
+
+        return 0;
+}
+
+static int test_rdx_insert(void)
+{
+        struct radix* t = radix_create();
+
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_IE(radix_size(t), 0);
+        SCUT_ASSERT_FALSE(radix_find(t, "a"));
+        SCUT_ASSERT_FALSE(radix_find(t, ""));
+
+        /* Keys being prefixes of each other, in both orders */
+        SCUT_ASSERT_IE(radix_insert(t, "romane", (void*)1l), 0);
+        SCUT_ASSERT_IE(radix_insert(t, "romanus", (void*)2l), 0);
+        SCUT_ASSERT_IE(radix_insert(t, "romulus", (void*)3l), 0);
+        SCUT_ASSERT_IE(radix_insert(t, "rom", (void*)4l), 0);
+        SCUT_ASSERT_IE(radix_insert(t, "romanesque", (void*)5l), 0);
+        SCUT_ASSERT_IE(radix_insert(t, "r", (void*)6l), 0);
+        SCUT_ASSERT_IE(radix_insert(t, "", (void*)7l), 0);
+        SCUT_ASSERT_IE(radix_insert(t, "rubens", (void*)8l), 0);
+        SCUT_ASSERT_IE(radix_size(t), 8);
+
+        SCUT_ASSERT_IE(radix_find(t, "romane"), 1);
+        SCUT_ASSERT_IE(radix_find(t, "romanus"), 2);
+        SCUT_ASSERT_IE(radix_find(t, "romulus"), 3);
+        SCUT_ASSERT_IE(radix_find(t, "rom"), 4);
+        SCUT_ASSERT_IE(radix_find(t, "romanesque"), 5);
+        SCUT_ASSERT_IE(radix_find(t, "r"), 6);
+        SCUT_ASSERT_IE(radix_find(t, ""), 7);
+        SCUT_ASSERT_IE(radix_find(t, "rubens"), 8);
+        SCUT_ASSERT_FALSE(radix_find(t, "ro"));
+        SCUT_ASSERT_FALSE(radix_find(t, "roman"));
+        SCUT_ASSERT_FALSE(radix_find(t, "romanes"));
+        SCUT_ASSERT_FALSE(radix_find(t, "romanesques"));
+        SCUT_ASSERT_FALSE(radix_find(t, "rubicon"));
+
+        /* Replace */
+        SCUT_ASSERT_IE(radix_insert(t, "rom", (void*)9l), 0);
+        SCUT_ASSERT_IE(radix_size(t), 8);
+        SCUT_ASSERT_IE(radix_find(t, "rom"), 9);
+
+        radix_destroy(t);
+
+        return 0;
+}
+
+static int test_rdx_remove(void)
+{
+        struct radix* t = radix_create();
+        const char* keys[] = {
+                "romane", "romanus", "romulus", "rom", "romanesque", "r",
+                "", "rubens", "ruber", "rubicon", "rubicundus"
+        };
+        size_t n = sizeof(keys) / sizeof(keys[0]);
+
+        for (size_t i = 0; i < n; i++)
+        {
+                SCUT_ASSERT_IE(radix_insert(t, keys[i], (void*)(i + 1)), 0);
+        }
+
+        SCUT_ASSERT_FALSE(radix_remove(t, "roma"));
+        SCUT_ASSERT_FALSE(radix_remove(t, "rubiconx"));
+        SCUT_ASSERT_IE(radix_size(t), n);
+
+        /* Remove every other key, and check the rest are intact */
+        for (size_t i = 0; i < n; i += 2)
+        {
+                SCUT_ASSERT_IE(radix_remove(t, keys[i]), i + 1);
+                SCUT_ASSERT_FALSE(radix_remove(t, keys[i]));
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+                if (i & 1)
+                {
+                        SCUT_ASSERT_IE(radix_find(t, keys[i]), i + 1);
+                }
+                else
+                {
+                        SCUT_ASSERT_FALSE(radix_find(t, keys[i]));
+                }
+        }
+        for (size_t i = 1; i < n; i += 2)
+        {
+                SCUT_ASSERT_IE(radix_remove(t, keys[i]), i + 1);
+        }
+        SCUT_ASSERT_IE(radix_size(t), 0);
+
+        /* The tree is usable after being emptied */
+        SCUT_ASSERT_IE(radix_insert(t, "rubens", (void*)1l), 0);
+        SCUT_ASSERT_IE(radix_find(t, "rubens"), 1);
+
+        radix_destroy(t);
+
+        return 0;
+}
+
+static int test_rdx_prefix(void)
+{
+        struct radix* t = radix_create();
+        const char* prefixes[] = {
+                "", "h", "https://static.example.com/assets/images/thumbnails/user",
+                "https://static.example.com/assets/images/thumbnails/users/",
+                "https://static.example.com/assets/images/thumbnails/users/1",
+                "https://static.example.com/assets/images/thumbnails/items/999",
+                "https://static.example.com/assets/images/thumbnails/items/9990",
+                "https://static.example.com/assets/images/thumbnails/itemsx", "x"
+        };
+        char buf[128];
+
+        for (long i = 0; i < NUM_PATHS; i++)
+        {
+                path(buf, i);
+                SCUT_ASSERT_IE(radix_insert(t, buf, (void*)i), 0);
+        }
+
+        for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++)
+        {
+                struct scan s;
+                long count = 0;
+
+                for (long i = 0; i < NUM_PATHS; i++)
+                {
+                        path(buf, i);
+                        if (strncmp(buf, prefixes[p], strlen(prefixes[p])) == 0)
+                        {
+                                count++;
+                        }
+                }
+                s.count = 0;
+                SCUT_ASSERT_IE(radix_prefix(t, prefixes[p], &visit_order, &s), 0);
+                SCUT_ASSERT_IE(s.count, count);
+        }
+
+        radix_destroy(t);
+
+        return 0;
+}
+
+static int test_rdx_memory(void)
+{
+        struct radix* t = radix_create();
+        size_t empty = radix_memory(t);
+        size_t key_bytes = 0;
+        char buf[128];
+
+        for (long i = 0; i < NUM_PATHS; i++)
+        {
+                path(buf, i);
+                key_bytes += strlen(buf) + 1;
+                SCUT_ASSERT_IE(radix_insert(t, buf, (void*)i), 0);
+        }
+        SCUT_ASSERT_IE(radix_size(t), NUM_PATHS);
+
+        /* Shared prefixes are stored once */
+        SCUT_ASSERT_TRUE(radix_memory(t) < key_bytes / 2);
+
+        for (long i = 0; i < NUM_PATHS; i++)
+        {
+                path(buf, i);
+                SCUT_ASSERT_IE(radix_find(t, buf), i);
+        }
+        for (long i = 0; i < NUM_PATHS; i++)
+        {
+                path(buf, i);
+                SCUT_ASSERT_IE(radix_remove(t, buf), i);
+        }
+        SCUT_ASSERT_IE(radix_size(t), 0);
+        SCUT_ASSERT_IE(radix_memory(t), empty);
+
+        radix_destroy(t);
+
+        return 0;
+}
@@ -0,0 +1,231 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include "rheap.h"
+#include <stdlib.h>
+
+#define NUM_BUCKETS 65
+/* Initial capacity of a bucket */
+#define BUCKET_CAP 16
+/* Bucket of a key, given the last extracted key */
+#define BUCKET(k, l) ((k) == (l) ? 0 : 64 - __builtin_clzll((k) ^ (l)))
+
+struct rentry
+{
+        uint64_t key;
+        void* data;
+};
+
+struct rbucket
+{
+        struct rentry* e;
+        size_t n;
+        size_t cap;
+};
+
+struct rheap
+{
+        struct rbucket b[NUM_BUCKETS];
+        /* Bit i - 1 is set if bucket i is not empty */
+        uint64_t used;
+        uint64_t last;
+        size_t size;
+};
+
+/**
+ * Make room for a number of entries in a bucket.
+ * @param the bucket.
+ * @param the number of entries.
+ * @return 0 on success, -1 if no memory could be allocated.
+ */
+static int reserve(struct rbucket*, size_t);
+
+/**
+ * Move the lowest non empty bucket into lower buckets, making its lowest
+ * key the last extracted key.
+ * @param the heap.
+ * @return 0 on success, -1 if no memory could be allocated, in which
+ *         case the heap is not modified.
+ */
+static int redistribute(struct rheap*);
+
+struct rheap* rheap_create(void)
+{
+        struct rheap* h = malloc(sizeof(struct rheap));
+
+        if (h == NULL)
+        {
+                return NULL;
+        }
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+                h->b[i].e = NULL;
+                h->b[i].n = 0;
+                h->b[i].cap = 0;
+        }
+        h->used = 0;
+        h->last = 0;
+        h->size = 0;
+
+        return h;
+}
+
+void rheap_destroy(struct rheap* h)
+{
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+                free(h->b[i].e);
+        }
+        free(h);
+}
+
+void rheap_clear(struct rheap* h)
+{
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+                h->b[i].n = 0;
+        }
+        h->used = 0;
+        h->last = 0;
+        h->size = 0;
+}
+
+int rheap_insert(struct rheap* h, uint64_t key, void* data)
+{
+        int i;
+
+        if (key < h->last)
+        {
+                return -1;
+        }
+
+        i = BUCKET(key, h->last);
+        if (reserve(&h->b[i], h->b[i].n + 1))
+        {
+                return -1;
+        }
+        h->b[i].e[h->b[i].n].key = key;
+        h->b[i].e[h->b[i].n].data = data;
+        h->b[i].n++;
+        if (i > 0)
+        {
+                h->used |= (uint64_t)1 << (i - 1);
+        }
+        h->size++;
+
+        return 0;
+}
+
+void* rheap_min(struct rheap* h, uint64_t* key)
+{
+        struct rentry* e;
+
+        if (h->size == 0)
+        {
+                return NULL;
+        }
+
+        if (h->b[0].n == 0 && redistribute(h))
+        {
+                return NULL;
+        }
+
+        e = &h->b[0].e[--h->b[0].n];
+        if (key)
+        {
+                *key = e->key;
+        }
+        h->size--;
+
+        return e->data;
+}
+
+uint64_t rheap_last(const struct rheap* h)
+{
+        return h->last;
+}
+
+size_t rheap_size(const struct rheap* h)
+{
+        return h->size;
+}
+
+static int reserve(struct rbucket* b, size_t n)
+{
+        size_t cap = b->cap ? b->cap : BUCKET_CAP;
+        struct rentry* e;
+
+        if (n <= b->cap)
+        {
+                return 0;
+        }
+        while (cap < n)
+        {
+                cap *= 2;
+        }
+        e = realloc(b->e, cap * sizeof(struct rentry));
+        if (e == NULL)
+        {
+                return -1;
+        }
+        b->e = e;
+        b->cap = cap;
+
+        return 0;
+}
+
+static int redistribute(struct rheap* h)
+{
+        /* All items of the lowest non empty bucket differ from its
+           lowest key in a lower bit, and move to lower buckets */
+        int i = __builtin_ctzll(h->used) + 1;
+        struct rbucket* b = &h->b[i];
+        size_t count[NUM_BUCKETS] = {0};
+        uint64_t min = b->e[0].key;
+
+        for (size_t j = 1; j < b->n; j++)
+        {
+                if (b->e[j].key < min)
+                {
+                        min = b->e[j].key;
+                }
+        }
+        for (size_t j = 0; j < b->n; j++)
+        {
+                count[BUCKET(b->e[j].key, min)]++;
+        }
+        for (int k = 0; k < i; k++)
+        {
+                if (count[k] && reserve(&h->b[k], h->b[k].n + count[k]))
+                {
+                        return -1;
+                }
+        }
+
+        for (size_t j = 0; j < b->n; j++)
+        {
+                int k = BUCKET(b->e[j].key, min);
+
+                h->b[k].e[h->b[k].n++] = b->e[j];
+                if (k > 0)
+                {
+                        h->used |= (uint64_t)1 << (k - 1);
+                }
+        }
+        b->n = 0;
+        h->used &= ~((uint64_t)1 << (i - 1));
+        h->last = min;
+
+        return 0;
+}
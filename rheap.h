@@ -0,0 +1,88 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#ifndef __RHEAP_H__
+#define __RHEAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct rheap;
+
+/*
+ * Radix heap, a min heap for unsigned integer keys where no inserted key
+ * is lower than the last extracted key, e.g timestamps of scheduled
+ * events. Items are kept in 65 buckets by the highest bit in which their
+ * key differs from the last extracted key. No comparison callbacks are
+ * made, and each item is moved between buckets at most 64 times, giving
+ * amortized O(1) insert and O(log C) extract, where C is the key range.
+ * Items with equal keys are extracted in no defined order.
+ *
+ * No methods are thread safe, external locking is required.
+ */
+
+/**
+ * Create an empty heap, with the last extracted key 0.
+ * @return the heap, or NULL on failure.
+ */
+extern struct rheap* rheap_create(void);
+
+/**
+ * Destroy the heap and free any memory it has allocated.
+ * @param the heap.
+ * @return void.
+ */
+extern void rheap_destroy(struct rheap*);
+
+/**
+ * Remove all items from the heap, and reset the last extracted key to 0.
+ * @param the heap.
+ * @return void.
+ */
+extern void rheap_clear(struct rheap*);
+
+/**
+ * Insert a new item.
+ * @param the heap.
+ * @param the key, not lower than the last extracted key.
+ * @param the item.
+ * @return 0 if the item was inserted, -1 if the key is lower than the
+ *         last extracted key or no memory could be allocated.
+ */
+extern int rheap_insert(struct rheap*, uint64_t, void*);
+
+/**
+ * Extract the item with the lowest key.
+ * @param the heap.
+ * @param the key of the item, written if not NULL.
+ * @return the item, or NULL if the heap is empty or no memory could be
+ *         allocated to reorganize it.
+ */
+extern void* rheap_min(struct rheap*, uint64_t*);
+
+/**
+ * Return the last extracted key, the lowest key that can be inserted.
+ * @param the heap.
+ * @return the key.
+ */
+extern uint64_t rheap_last(const struct rheap*);
+
+/**
+ * Return the size of the heap.
+ * @param the heap.
+ * @return the number of items in the heap.
+ */
+extern size_t rheap_size(const struct rheap*);
+
+#endif /* __RHEAP_H__ */
@@ -0,0 +1,139 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include <scut.h>
+#include "rheap.h"
+
+static int test_rh_insert(void);
+static int test_rh_monotone(void);
+static int test_rh_wide(void);
+
+int test_rheap(void)
+{
+        int ret;
+
+        scut_create("Test radix heap");
+
+        SCUT_ADD(test_rh_insert);
+        SCUT_ADD(test_rh_monotone);
+        SCUT_ADD(test_rh_wide);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+static int test_rh_insert(void)
+{
+        struct rheap* h = rheap_create();
+        long size = 10000;
+        uint64_t k;
+
+        SCUT_ASSERT_TRUE(h);
+        SCUT_ASSERT_IE(rheap_size(h), 0);
+        SCUT_ASSERT_IE(rheap_min(h, &k), NULL);
+
+        /* Duplicates, out of order */
+        for (long i = 0; i < size; i++)
+        {
+                uint64_t v = (uint64_t)((i * 7919) % (size / 2));
+
+                SCUT_ASSERT_IE(rheap_insert(h, v, (void*)(v + 1)), 0);
+        }
+        SCUT_ASSERT_IE(rheap_size(h), size);
+        for (long i = 0; i < size; i++)
+        {
+                SCUT_ASSERT_IE(rheap_min(h, &k), i / 2 + 1);
+                SCUT_ASSERT_IE(k, i / 2);
+                SCUT_ASSERT_IE(rheap_last(h), i / 2);
+        }
+        SCUT_ASSERT_IE(rheap_min(h, NULL), NULL);
+
+        /* Keys below the last extracted one are rejected */
+        SCUT_ASSERT_IE(rheap_insert(h, 100, (void*)1l), -1);
+        SCUT_ASSERT_IE(rheap_insert(h, (uint64_t)size / 2 - 1, (void*)1l), 0);
+
+        rheap_clear(h);
+        SCUT_ASSERT_IE(rheap_size(h), 0);
+        SCUT_ASSERT_IE(rheap_last(h), 0);
+        SCUT_ASSERT_IE(rheap_insert(h, 0, (void*)1l), 0);
+        SCUT_ASSERT_IE(rheap_min(h, &k), 1);
+        SCUT_ASSERT_IE(k, 0);
+
+        rheap_destroy(h);
+
+        return 0;
+}
+
+static int test_rh_monotone(void)
+{
+        struct rheap* h = rheap_create();
+        uint64_t last = 0;
+        uint64_t k;
+        uint64_t seed = 1;
+
+        /* Event simulation, each extracted event schedules new events
+           at a later time */
+        for (uint64_t i = 0; i < 100; i++)
+        {
+                SCUT_ASSERT_IE(rheap_insert(h, i * 3, (void*)1l), 0);
+        }
+        for (int i = 0; i < 100000; i++)
+        {
+                SCUT_ASSERT_IE(rheap_min(h, &k), 1);
+                SCUT_ASSERT_TRUE(k >= last);
+                last = k;
+                seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+                SCUT_ASSERT_IE(rheap_insert(h, k + (seed >> 54), (void*)1l), 0);
+        }
+        SCUT_ASSERT_IE(rheap_size(h), 100);
+
+        rheap_destroy(h);
+
+        return 0;
+}
+
+static int test_rh_wide(void)
+{
+        struct rheap* h = rheap_create();
+        uint64_t keys[] = {
+                UINT64_MAX, (uint64_t)1 << 63, ((uint64_t)1 << 63) + 1,
+                (uint64_t)1 << 32, 1, 0, UINT64_MAX - 1, (uint64_t)1 << 32
+        };
+        uint64_t sorted[] = {
+                0, 1, (uint64_t)1 << 32, (uint64_t)1 << 32, (uint64_t)1 << 63,
+                ((uint64_t)1 << 63) + 1, UINT64_MAX - 1, UINT64_MAX
+        };
+        uint64_t k;
+
+        /* Keys using all 64 bits */
+        for (size_t i = 0; i < 8; i++)
+        {
+                SCUT_ASSERT_IE(rheap_insert(h, keys[i], (void*)1l), 0);
+        }
+        for (size_t i = 0; i < 8; i++)
+        {
+                SCUT_ASSERT_IE(rheap_min(h, &k), 1);
+                SCUT_ASSERT_TRUE(k == sorted[i]);
+        }
+        SCUT_ASSERT_IE(rheap_size(h), 0);
+        SCUT_ASSERT_IE(rheap_insert(h, UINT64_MAX, (void*)1l), 0);
+        SCUT_ASSERT_IE(rheap_min(h, &k), 1);
+        SCUT_ASSERT_TRUE(k == UINT64_MAX);
+
+        rheap_destroy(h);
+
+        return 0;
+}
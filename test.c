@@ -16,6 +16,17 @@ extern int test_hmap(void);
 extern int test_heap(void);
 extern int test_llist(void);
 extern int test_stack(void);
+extern int test_cmap(void);
+extern int test_pbtree(void);
+extern int test_bptree(void);
+extern int test_itree(void);
+extern int test_btree_spec(void);
+extern int test_radix(void);
+extern int test_topk(void);
+extern int test_pheap(void);
+extern int test_rheap(void);
+extern int test_twheel(void);
+extern int test_multiq(void);
 
 int main(void)
 {
@@ -41,6 +52,50 @@ int main(void)
         {
                 ret = 1;
         }
+        if (test_cmap())
+        {
+                ret = 1;
+        }
+        if (test_pbtree())
+        {
+                ret = 1;
+        }
+        if (test_bptree())
+        {
+                ret = 1;
+        }
+        if (test_itree())
+        {
+                ret = 1;
+        }
+        if (test_btree_spec())
+        {
+                ret = 1;
+        }
+        if (test_radix())
+        {
+                ret = 1;
+        }
+        if (test_topk())
+        {
+                ret = 1;
+        }
+        if (test_pheap())
+        {
+                ret = 1;
+        }
+        if (test_rheap())
+        {
+                ret = 1;
+        }
+        if (test_twheel())
+        {
+                ret = 1;
+        }
+        if (test_multiq())
+        {
+                ret = 1;
+        }
 
         return ret;
 }
@@ -0,0 +1,233 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include "topk.h"
+#include "heap.h"
+#include <stdlib.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Arity of the heap */
+#define TOPK_ARITY 4
+
+struct topk_item
+{
+        double score;
+        void* data;
+};
+
+struct topk
+{
+        struct heap* heap;
+        /* Storage for the K items, the first size are in use when not
+           full */
+        struct topk_item* items;
+        size_t k;
+        size_t size;
+        /* Score of the heap root when full, copied out of the heap to
+           reject items without a memory indirection. Only valid as a
+           threshold when full. */
+        double min;
+};
+
+/**
+ * Order items by lowest score first.
+ * @param the first item.
+ * @param the second item.
+ * @return 1 if a has lower score, -1 if higher, 0 otherwise.
+ */
+static int cmp_item(const void*, const void*);
+
+struct topk* topk_create(size_t k)
+{
+        struct topk* t;
+
+        if (k == 0)
+        {
+                return NULL;
+        }
+
+        t = malloc(sizeof(struct topk));
+        if (t == NULL)
+        {
+                return NULL;
+        }
+        t->items = malloc(k * sizeof(struct topk_item));
+        t->heap = heap_create_arity(&cmp_item, TOPK_ARITY);
+        if (t->items == NULL || t->heap == NULL || heap_reserve(t->heap, k))
+        {
+                if (t->heap)
+                {
+                        heap_destroy(t->heap);
+                }
+                free(t->items);
+                free(t);
+                return NULL;
+        }
+        t->k = k;
+        t->size = 0;
+        t->min = -HUGE_VAL;
+
+        return t;
+}
+
+void topk_destroy(struct topk* t)
+{
+        heap_destroy(t->heap);
+        free(t->items);
+        free(t);
+}
+
+int topk_insert(struct topk* t, double score, void* data)
+{
+        struct topk_item* it;
+
+        if (isnan(score))
+        {
+                return 0;
+        }
+
+        /* Any score is kept until K items are, -HUGE_VAL included */
+        if (t->size < t->k)
+        {
+                it = &t->items[t->size++];
+                it->score = score;
+                it->data = data;
+                /* Can not fail, capacity is reserved */
+                heap_insert(t->heap, it);
+                if (t->size == t->k)
+                {
+                        t->min = ((struct topk_item*)heap_peek(t->heap))->score;
+                }
+                return 1;
+        }
+
+        /* Fast reject */
+        if (!(score > t->min))
+        {
+                return 0;
+        }
+
+        /* Reuse the evicted item's storage */
+        it = heap_peek(t->heap);
+        it->score = score;
+        it->data = data;
+        heap_replace_top(t->heap, it);
+        t->min = ((struct topk_item*)heap_peek(t->heap))->score;
+
+        return 1;
+}
+
+size_t topk_insert_batch(struct topk* t,
+                         const double* scores,
+                         void** data,
+                         size_t n)
+{
+        size_t kept = 0;
+        size_t i = 0;
+
+        /* The threshold only applies once K items are kept */
+        for (; i < n && t->size < t->k; i++)
+        {
+                kept += (size_t)topk_insert(t, scores[i],
+                                            data ? data[i] : NULL);
+        }
+
+#ifdef __SSE2__
+        /* Two scores per compare, four per iteration */
+        for (; i + 4 <= n; i += 4)
+        {
+                __m128d min = _mm_set1_pd(t->min);
+                __m128d a = _mm_loadu_pd(scores + i);
+                __m128d b = _mm_loadu_pd(scores + i + 2);
+                int mask;
+
+                mask = _mm_movemask_pd(_mm_cmpgt_pd(a, min)) |
+                        (_mm_movemask_pd(_mm_cmpgt_pd(b, min)) << 2);
+                /* Candidates are checked again, as the threshold may
+                   have been raised by the previous one */
+                for (size_t j = 0; mask; j++, mask >>= 1)
+                {
+                        if (mask & 1)
+                        {
+                                kept += (size_t)topk_insert(t, scores[i + j],
+                                                            data ? data[i + j] : NULL);
+                        }
+                }
+        }
+#endif
+        for (; i < n; i++)
+        {
+                if (scores[i] > t->min)
+                {
+                        kept += (size_t)topk_insert(t, scores[i],
+                                                    data ? data[i] : NULL);
+                }
+        }
+
+        return kept;
+}
+
+double topk_threshold(const struct topk* t)
+{
+        return t->min;
+}
+
+size_t topk_size(const struct topk* t)
+{
+        return t->size;
+}
+
+size_t topk_extract(struct topk* t, double* scores, void** data)
+{
+        size_t n = t->size;
+
+        /* Lowest score is extracted first, fill from the end */
+        for (size_t i = n; i-- > 0;)
+        {
+                struct topk_item* it = heap_min(t->heap);
+
+                if (scores)
+                {
+                        scores[i] = it->score;
+                }
+                if (data)
+                {
+                        data[i] = it->data;
+                }
+        }
+        t->size = 0;
+        t->min = -HUGE_VAL;
+
+        return n;
+}
+
+static int cmp_item(const void* a, const void* b)
+{
+        double sa = ((const struct topk_item*)a)->score;
+        double sb = ((const struct topk_item*)b)->score;
+
+        if (sa < sb)
+        {
+                return 1;
+        }
+        else if (sa > sb)
+        {
+                return -1;
+        }
+
+        return 0;
+}
@@ -0,0 +1,96 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#ifndef __TOPK_H__
+#define __TOPK_H__
+
+#include <stddef.h>
+
+struct topk;
+
+/*
+ * Bounded top-K over a stream of scored items. The K items with the
+ * highest score seen so far are kept in a heap with the lowest kept
+ * score at the root. That score is the threshold: an item not scoring
+ * above it is rejected with a single compare, without touching the
+ * heap. For most streams nearly all items are rejected this way.
+ * Items scoring equal to the threshold, or NaN, are rejected.
+ *
+ * No methods are thread safe, external locking is required.
+ */
+
+/**
+ * Create an empty top-K. All memory is allocated up front.
+ * @param K, the max number of items to keep, at least 1.
+ * @return the top-K, or NULL on failure.
+ */
+extern struct topk* topk_create(size_t);
+
+/**
+ * Destroy the top-K and free any memory occupied.
+ * @param the top-K.
+ * @return void.
+ */
+extern void topk_destroy(struct topk*);
+
+/**
+ * Offer an item. Until K items are kept any score but NaN is accepted.
+ * If K items are kept, the lowest scored item is evicted to make room
+ * for an item with a higher score.
+ * @param the top-K.
+ * @param the score.
+ * @param the data.
+ * @return 1 if the item was kept, 0 if it was rejected.
+ */
+extern int topk_insert(struct topk*, double, void*);
+
+/**
+ * Offer multiple items. Scores are compared with the threshold several
+ * at a time, using SSE2 when available.
+ * @param the top-K.
+ * @param array of n scores.
+ * @param array of n data pointers, or NULL to use NULL as data.
+ * @param the number of items, n.
+ * @return the number of items kept when offered, some may have been
+ *         evicted by later items in the batch.
+ */
+extern size_t topk_insert_batch(struct topk*, const double*, void**,
+                                size_t);
+
+/**
+ * Return the current threshold.
+ * @param the top-K.
+ * @return the lowest kept score if K items are kept, otherwise
+ *         -HUGE_VAL.
+ */
+extern double topk_threshold(const struct topk*);
+
+/**
+ * Return the number of kept items.
+ * @param the top-K.
+ * @return the number of items, at most K.
+ */
+extern size_t topk_size(const struct topk*);
+
+/**
+ * Extract all kept items, by decreasing score. The top-K is empty
+ * afterwards, and can be reused.
+ * @param the top-K.
+ * @param array of at least topk_size scores, written, or NULL.
+ * @param array of at least topk_size data pointers, written, or NULL.
+ * @return the number of extracted items.
+ */
+extern size_t topk_extract(struct topk*, double*, void**);
+
+#endif /* __TOPK_H__ */
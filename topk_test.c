@@ -0,0 +1,164 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include <scut.h>
+#include <math.h>
+#include "topk.h"
+
+#define NUM_SCORES 100000
+
+static int test_topk_insert(void);
+static int test_topk_batch(void);
+static int test_topk_ties(void);
+static double score(long);
+
+int test_topk(void)
+{
+        int ret;
+
+        scut_create("Test top-K");
+
+        SCUT_ADD(test_topk_insert);
+        SCUT_ADD(test_topk_batch);
+        SCUT_ADD(test_topk_ties);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+/* A permutation of 0 to NUM_SCORES - 1, scaled */
+static double score(long i)
+{
+        return (double)((i * 7919) % NUM_SCORES) / 4.0;
+}
+
+static int test_topk_insert(void)
+{
+        struct topk* t = topk_create(10);
+        double scores[10];
+        void* data[10];
+        long kept = 0;
+
+        SCUT_ASSERT_IE(topk_create(0), NULL);
+        SCUT_ASSERT_TRUE(t);
+        SCUT_ASSERT_TRUE(topk_threshold(t) == -HUGE_VAL);
+        SCUT_ASSERT_IE(topk_extract(t, scores, data), 0);
+
+        for (long i = 0; i < NUM_SCORES; i++)
+        {
+                kept += topk_insert(t, score(i), (void*)i);
+        }
+        SCUT_ASSERT_IE(topk_size(t), 10);
+        /* Most items are rejected */
+        SCUT_ASSERT_TRUE(kept < NUM_SCORES / 100);
+        SCUT_ASSERT_TRUE(topk_threshold(t) == (NUM_SCORES - 10) / 4.0);
+
+        SCUT_ASSERT_IE(topk_extract(t, scores, data), 10);
+        for (long i = 0; i < 10; i++)
+        {
+                SCUT_ASSERT_TRUE(scores[i] == (double)(NUM_SCORES - 1 - i) / 4.0);
+                SCUT_ASSERT_TRUE(score((long)data[i]) == scores[i]);
+        }
+        SCUT_ASSERT_IE(topk_size(t), 0);
+
+        /* Fewer items than K */
+        SCUT_ASSERT_IE(topk_insert(t, 1.0, NULL), 1);
+        SCUT_ASSERT_IE(topk_insert(t, -1.0, NULL), 1);
+        SCUT_ASSERT_IE(topk_extract(t, scores, NULL), 2);
+        SCUT_ASSERT_TRUE(scores[0] == 1.0);
+        SCUT_ASSERT_TRUE(scores[1] == -1.0);
+
+        topk_destroy(t);
+
+        return 0;
+}
+
+static int test_topk_batch(void)
+{
+        static double scores[NUM_SCORES];
+        double top[100];
+        void* data[100];
+
+        for (long i = 0; i < NUM_SCORES; i++)
+        {
+                scores[i] = score(i);
+        }
+
+        /* Batch sizes not a multiple of the vector width */
+        for (size_t k = 1; k <= 100; k += 33)
+        {
+                struct topk* t = topk_create(k);
+                size_t off = 0;
+
+                while (off < NUM_SCORES)
+                {
+                        size_t n = NUM_SCORES - off < 997 ? NUM_SCORES - off : 997;
+
+                        topk_insert_batch(t, scores + off, NULL, n);
+                        off += n;
+                }
+                SCUT_ASSERT_IE(topk_extract(t, top, data), k);
+                for (size_t i = 0; i < k; i++)
+                {
+                        SCUT_ASSERT_TRUE(top[i] == (NUM_SCORES - 1 - (double)i) / 4.0);
+                        SCUT_ASSERT_IE(data[i], NULL);
+                }
+
+                topk_destroy(t);
+        }
+
+        return 0;
+}
+
+static int test_topk_ties(void)
+{
+        struct topk* t = topk_create(3);
+        double scores[] = {1.0, NAN, 2.0, 2.0, 2.0, 2.0, 3.0, NAN, 1.0};
+        void* data[] = {
+                (void*)1l, (void*)2l, (void*)3l, (void*)4l, (void*)5l,
+                (void*)6l, (void*)7l, (void*)8l, (void*)9l
+        };
+        double top[3];
+        void* out[3];
+
+        /* NaN is never kept, and an item equal to the threshold does
+           not evict */
+        SCUT_ASSERT_IE(topk_insert_batch(t, scores, data, 9), 5);
+        SCUT_ASSERT_TRUE(topk_threshold(t) == 2.0);
+        SCUT_ASSERT_IE(topk_extract(t, top, out), 3);
+        SCUT_ASSERT_TRUE(top[0] == 3.0);
+        SCUT_ASSERT_TRUE(top[1] == 2.0);
+        SCUT_ASSERT_TRUE(top[2] == 2.0);
+        SCUT_ASSERT_IE(out[0], 7);
+
+        /* -HUGE_VAL is kept while there is room, one at a time and in
+           a batch */
+        SCUT_ASSERT_IE(topk_insert(t, -HUGE_VAL, (void*)1l), 1);
+        SCUT_ASSERT_IE(topk_size(t), 1);
+        for (int i = 0; i < 9; i++)
+        {
+                scores[i] = -HUGE_VAL;
+        }
+        SCUT_ASSERT_IE(topk_insert_batch(t, scores, data, 9), 2);
+        SCUT_ASSERT_IE(topk_size(t), 3);
+        SCUT_ASSERT_TRUE(topk_threshold(t) == -HUGE_VAL);
+        SCUT_ASSERT_IE(topk_insert(t, -HUGE_VAL, NULL), 0);
+        SCUT_ASSERT_IE(topk_insert(t, 0.0, NULL), 1);
+
+        topk_destroy(t);
+
+        return 0;
+}
@@ -0,0 +1,426 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include "twheel.h"
+#include <stdlib.h>
+
+#define WHEEL_BITS 8
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define NUM_WHEELS 4
+/* Lists besides the wheel slots */
+#define OVERFLOW (NUM_WHEELS * WHEEL_SIZE)
+#define EXPIRED (OVERFLOW + 1)
+#define NUM_LISTS (EXPIRED + 1)
+/* Slot of a free timer */
+#define FREE_SLOT UINT32_MAX
+#define NIL UINT32_MAX
+/* Initial number of timers */
+#define TIMER_CAP 64
+/* Slot of a tick in a wheel */
+#define SLOT(t, w) ((uint32_t)((t) >> ((w) * WHEEL_BITS)) & WHEEL_MASK)
+
+struct timer
+{
+        uint64_t expire;
+        void* data;
+        uint32_t next;
+        uint32_t prev;
+        /* List the timer is in */
+        uint32_t slot;
+        uint32_t gen;
+};
+
+struct twheel
+{
+        struct timer* timers;
+        uint32_t cap;
+        uint32_t used;
+        uint32_t free;
+        uint32_t head[NUM_LISTS];
+        /* Non empty slots of each wheel */
+        uint64_t bits[NUM_WHEELS][WHEEL_SIZE / 64];
+        /* Lower bound of the expiry of timers in the overflow list */
+        uint64_t overflow_min;
+        uint64_t now;
+        size_t size;
+};
+
+/**
+ * Add a timer to the list of its slot, relative to the current tick.
+ * @param the wheel.
+ * @param the timer.
+ * @return void.
+ */
+static void place(struct twheel*, uint32_t);
+
+/**
+ * Remove a timer from its list.
+ * @param the wheel.
+ * @param the timer.
+ * @return void.
+ */
+static void unlink_timer(struct twheel*, uint32_t);
+
+/**
+ * Find the first non empty slot of a wheel after a slot.
+ * @param the wheel.
+ * @param the wheel number.
+ * @param the slot.
+ * @return the slot, or -1 if none.
+ */
+static int next_slot(const struct twheel*, int, uint32_t);
+
+/**
+ * Move all timers of a list to the slots they belong in at the current
+ * tick.
+ * @param the wheel.
+ * @param the list.
+ * @return void.
+ */
+static void cascade(struct twheel*, uint32_t);
+
+/**
+ * Expire all timers in the slot of the current tick.
+ * @param the wheel.
+ * @param the expire method.
+ * @param argument passed to the expire method.
+ * @return the number of expired timers.
+ */
+static size_t expire(struct twheel*, twheel_expire, void*);
+
+struct twheel* twheel_create(uint64_t now)
+{
+        struct twheel* t = malloc(sizeof(struct twheel));
+
+        if (t == NULL)
+        {
+                return NULL;
+        }
+        t->timers = malloc(TIMER_CAP * sizeof(struct timer));
+        if (t->timers == NULL)
+        {
+                free(t);
+                return NULL;
+        }
+        t->cap = TIMER_CAP;
+        t->used = 0;
+        t->free = NIL;
+        for (int i = 0; i < NUM_LISTS; i++)
+        {
+                t->head[i] = NIL;
+        }
+        for (int w = 0; w < NUM_WHEELS; w++)
+        {
+                for (int i = 0; i < WHEEL_SIZE / 64; i++)
+                {
+                        t->bits[w][i] = 0;
+                }
+        }
+        t->overflow_min = UINT64_MAX;
+        t->now = now;
+        t->size = 0;
+
+        return t;
+}
+
+void twheel_destroy(struct twheel* t)
+{
+        free(t->timers);
+        free(t);
+}
+
+int twheel_schedule(struct twheel* t,
+                    uint64_t tick,
+                    void* data,
+                    uint64_t* handle)
+{
+        uint32_t i;
+
+        if (t->free != NIL)
+        {
+                i = t->free;
+                t->free = t->timers[i].next;
+        }
+        else
+        {
+                if (t->used == t->cap)
+                {
+                        struct timer* n;
+
+                        if (t->cap > UINT32_MAX / 2)
+                        {
+                                return -1;
+                        }
+                        n = realloc(t->timers, 2 * t->cap * sizeof(struct timer));
+                        if (n == NULL)
+                        {
+                                return -1;
+                        }
+                        t->timers = n;
+                        t->cap *= 2;
+                }
+                i = t->used++;
+                t->timers[i].gen = 0;
+        }
+
+        /* The slot of the current tick has already expired */
+        t->timers[i].expire = tick > t->now ? tick : t->now + 1;
+        t->timers[i].data = data;
+        place(t, i);
+        t->size++;
+        *handle = ((uint64_t)t->timers[i].gen << 32) | i;
+
+        return 0;
+}
+
+void* twheel_cancel(struct twheel* t, uint64_t handle)
+{
+        uint32_t i = (uint32_t)handle;
+        struct timer* tm;
+
+        if (i >= t->used)
+        {
+                return NULL;
+        }
+        tm = &t->timers[i];
+        if (tm->slot == FREE_SLOT || tm->gen != (uint32_t)(handle >> 32))
+        {
+                return NULL;
+        }
+
+        unlink_timer(t, i);
+        tm->slot = FREE_SLOT;
+        tm->gen++;
+        tm->next = t->free;
+        t->free = i;
+        t->size--;
+
+        return tm->data;
+}
+
+size_t twheel_advance(struct twheel* t,
+                      uint64_t tick,
+                      twheel_expire fn,
+                      void* arg)
+{
+        size_t count = 0;
+
+        while (t->now < tick)
+        {
+                uint64_t next = 0;
+                int w;
+                int s = -1;
+
+                /* The next tick with a timer is the first non empty slot
+                   of the lowest non empty wheel. Lower wheels only hold
+                   timers in slots after the current tick's. */
+                for (w = 0; w < NUM_WHEELS; w++)
+                {
+                        s = next_slot(t, w, SLOT(t->now, w));
+                        if (s >= 0)
+                        {
+                                int shift = w * WHEEL_BITS;
+                                uint64_t high = ~(((uint64_t)1 << (shift + WHEEL_BITS)) - 1);
+
+                                next = (t->now & high) | ((uint64_t)s << shift);
+                                break;
+                        }
+                }
+                if (s < 0)
+                {
+                        if (t->head[OVERFLOW] == NIL)
+                        {
+                                break;
+                        }
+                        /* Start of the range of the top wheel holding the
+                           earliest overflow timer */
+                        next = t->overflow_min &
+                                ~(((uint64_t)1 << (NUM_WHEELS * WHEEL_BITS)) - 1);
+                }
+                if (next > tick)
+                {
+                        break;
+                }
+
+                t->now = next;
+                if (s < 0)
+                {
+                        t->overflow_min = UINT64_MAX;
+                        cascade(t, OVERFLOW);
+                }
+                else if (w > 0)
+                {
+                        cascade(t, (uint32_t)(w * WHEEL_SIZE + s));
+                }
+                count += expire(t, fn, arg);
+        }
+        if (t->now < tick)
+        {
+                t->now = tick;
+        }
+
+        return count;
+}
+
+uint64_t twheel_now(const struct twheel* t)
+{
+        return t->now;
+}
+
+size_t twheel_size(const struct twheel* t)
+{
+        return t->size;
+}
+
+static void place(struct twheel* t, uint32_t i)
+{
+        struct timer* tm = &t->timers[i];
+        uint64_t x = tm->expire ^ t->now;
+        uint32_t slot = OVERFLOW;
+
+        /* Wheel of the highest group of bits that differs */
+        for (int w = 0; w < NUM_WHEELS; w++)
+        {
+                if (x < ((uint64_t)1 << ((w + 1) * WHEEL_BITS)))
+                {
+                        uint32_t s = SLOT(tm->expire, w);
+
+                        slot = (uint32_t)(w * WHEEL_SIZE) + s;
+                        t->bits[w][s / 64] |= (uint64_t)1 << (s % 64);
+                        break;
+                }
+        }
+
+        if (slot == OVERFLOW && tm->expire < t->overflow_min)
+        {
+                t->overflow_min = tm->expire;
+        }
+        tm->slot = slot;
+        tm->prev = NIL;
+        tm->next = t->head[slot];
+        if (tm->next != NIL)
+        {
+                t->timers[tm->next].prev = i;
+        }
+        t->head[slot] = i;
+}
+
+static void unlink_timer(struct twheel* t, uint32_t i)
+{
+        struct timer* tm = &t->timers[i];
+
+        if (tm->prev != NIL)
+        {
+                t->timers[tm->prev].next = tm->next;
+        }
+        else
+        {
+                t->head[tm->slot] = tm->next;
+                if (tm->next == NIL && tm->slot < OVERFLOW)
+                {
+                        uint32_t w = tm->slot / WHEEL_SIZE;
+                        uint32_t s = tm->slot % WHEEL_SIZE;
+
+                        t->bits[w][s / 64] &= ~((uint64_t)1 << (s % 64));
+                }
+        }
+        if (tm->next != NIL)
+        {
+                t->timers[tm->next].prev = tm->prev;
+        }
+}
+
+static int next_slot(const struct twheel* t, int w, uint32_t s)
+{
+        /* Slots after s */
+        for (uint32_t i = (s + 1) / 64; i < WHEEL_SIZE / 64; i++)
+        {
+                uint64_t b = t->bits[w][i];
+
+                if (i == (s + 1) / 64)
+                {
+                        b &= ~(uint64_t)0 << ((s + 1) % 64);
+                }
+                if (b)
+                {
+                        return (int)(i * 64) + __builtin_ctzll(b);
+                }
+        }
+
+        return -1;
+}
+
+static void cascade(struct twheel* t, uint32_t list)
+{
+        uint32_t i = t->head[list];
+
+        t->head[list] = NIL;
+        if (list < OVERFLOW)
+        {
+                uint32_t w = list / WHEEL_SIZE;
+                uint32_t s = list % WHEEL_SIZE;
+
+                t->bits[w][s / 64] &= ~((uint64_t)1 << (s % 64));
+        }
+        while (i != NIL)
+        {
+                uint32_t next = t->timers[i].next;
+
+                place(t, i);
+                i = next;
+        }
+}
+
+static size_t expire(struct twheel* t, twheel_expire fn, void* arg)
+{
+        uint32_t s = SLOT(t->now, 0);
+        size_t count = 0;
+        uint32_t i;
+
+        if (t->head[s] == NIL)
+        {
+                return 0;
+        }
+
+        /* Move the slot to the expired list, the expire method may
+           schedule and cancel timers meanwhile */
+        t->head[EXPIRED] = t->head[s];
+        t->head[s] = NIL;
+        t->bits[0][s / 64] &= ~((uint64_t)1 << (s % 64));
+        for (i = t->head[EXPIRED]; i != NIL; i = t->timers[i].next)
+        {
+                t->timers[i].slot = EXPIRED;
+        }
+
+        while ((i = t->head[EXPIRED]) != NIL)
+        {
+                struct timer* tm = &t->timers[i];
+                void* data = tm->data;
+
+                unlink_timer(t, i);
+                tm->slot = FREE_SLOT;
+                tm->gen++;
+                tm->next = t->free;
+                t->free = i;
+                t->size--;
+                count++;
+                if (fn)
+                {
+                        fn(data, arg);
+                }
+        }
+
+        return count;
+}
@@ -0,0 +1,110 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#ifndef __TWHEEL_H__
+#define __TWHEEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct twheel;
+
+/*
+ * Hierarchical timer wheel. Timers expire at an absolute tick, and are
+ * kept in four wheels of 256 slots, each wheel covering 256 times the
+ * ticks of the one below. A timer is placed in the wheel of the highest
+ * 8 bit group in which its expiry differs from the current tick, and is
+ * moved to a lower wheel when the current tick reaches its slot.
+ * Timers more than 2^32 ticks ahead are kept in an overflow list.
+ *
+ * Scheduling and cancelling a timer are O(1). Advancing the wheel skips
+ * empty slots, and each timer is moved at most four times before it
+ * expires, which makes the wheel cheap for timers that are mostly
+ * cancelled before they expire.
+ *
+ * No methods are thread safe, external locking is required.
+ */
+
+/**
+ * Method called for each expired timer.
+ * @param the data of the timer.
+ * @param the user provided argument.
+ * @return void.
+ */
+typedef void (*twheel_expire)(void*, void*);
+
+/**
+ * Create an empty timer wheel.
+ * @param the current tick.
+ * @return the wheel, or NULL on failure.
+ */
+extern struct twheel* twheel_create(uint64_t);
+
+/**
+ * Destroy the wheel and free any memory it has allocated.
+ * @param the wheel.
+ * @return void.
+ */
+extern void twheel_destroy(struct twheel*);
+
+/**
+ * Schedule a timer. A timer due at or before the current tick expires
+ * at the next tick.
+ * @param the wheel.
+ * @param the tick the timer expires at.
+ * @param the data of the timer.
+ * @param the handle of the timer, written.
+ * @return 0 on success, -1 if no memory could be allocated.
+ */
+extern int twheel_schedule(struct twheel*, uint64_t, void*, uint64_t*);
+
+/**
+ * Cancel a pending timer. Handles carry a generation count, so
+ * cancelling an expired or cancelled timer is safe and does not cancel
+ * a later timer.
+ * @param the wheel.
+ * @param the handle of the timer.
+ * @return the data of the timer, or NULL if the timer is not pending.
+ */
+extern void* twheel_cancel(struct twheel*, uint64_t);
+
+/**
+ * Advance the current tick, and expire all timers due up to and
+ * including it, in order of expiry. Timers due at the same tick expire
+ * in no defined order. The expire method may schedule and cancel
+ * timers.
+ * @param the wheel.
+ * @param the new current tick, ignored if lower than the current tick.
+ * @param the method to call for each expired timer.
+ * @param argument passed to the expire method.
+ * @return the number of expired timers.
+ */
+extern size_t twheel_advance(struct twheel*, uint64_t, twheel_expire,
+                             void*);
+
+/**
+ * Return the current tick.
+ * @param the wheel.
+ * @return the tick.
+ */
+extern uint64_t twheel_now(const struct twheel*);
+
+/**
+ * Return the number of pending timers.
+ * @param the wheel.
+ * @return the number of timers.
+ */
+extern size_t twheel_size(const struct twheel*);
+
+#endif /* __TWHEEL_H__ */
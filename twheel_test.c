@@ -0,0 +1,229 @@
+/*
+* Copyright (C) 2016 Fredrik Skogman, skogman - at - gmail.com.
+* This file is part of libeds.
+*
+* The contents of this file are subject to the terms of the Common
+* Development and Distribution License (the "License"). You may not use this
+* file except in compliance with the License. You can obtain a copy of the
+* License at http://opensource.org/licenses/CDDL-1.0. See the License for the
+* specific language governing permissions and limitations under the License.
+* When distributing the software, include this License Header Notice in each
+* file and include the License file at http://opensource.org/licenses/CDDL-1.0.
+*/
+
+
+#include <scut.h>
+#include "twheel.h"
+
+#define NUM_TIMERS 10000
+
+static int test_tw_schedule(void);
+static int test_tw_cancel(void);
+static int test_tw_far(void);
+static int test_tw_reschedule(void);
+
+/* Verifies timers expire in order, and at their tick */
+struct check
+{
+        struct twheel* t;
+        uint64_t last;
+        long count;
+        int ok;
+};
+
+int test_twheel(void)
+{
+        int ret;
+
+        scut_create("Test timer wheel");
+
+        SCUT_ADD(test_tw_schedule);
+        SCUT_ADD(test_tw_cancel);
+        SCUT_ADD(test_tw_far);
+        SCUT_ADD(test_tw_reschedule);
+        ret = scut_run(0);
+
+        scut_destroy();
+
+        return ret;
+}
+
+/* Data of a timer is its expiry tick */
+static void on_expire(void* data, void* arg)
+{
+        struct check* c = arg;
+        uint64_t tick = (uint64_t)data;
+
+        if (tick < c->last || tick != twheel_now(c->t))
+        {
+                c->ok = 0;
+        }
+        c->last = tick;
+        c->count++;
+}
+
+static int test_tw_schedule(void)
+{
+        struct twheel* t = twheel_create(1000);
+        struct check c = {NULL, 0, 0, 1};
+        uint64_t hd;
+
+        SCUT_ASSERT_TRUE(t);
+        c.t = t;
+        SCUT_ASSERT_IE(twheel_now(t), 1000);
+        SCUT_ASSERT_IE(twheel_advance(t, 2000, &on_expire, &c), 0);
+        SCUT_ASSERT_IE(twheel_now(t), 2000);
+
+        /* Spread over all wheels */
+        for (long i = 1; i <= NUM_TIMERS; i++)
+        {
+                uint64_t tick = 2000 + (uint64_t)((i * 7919) % NUM_TIMERS) *
+                        (uint64_t)(i % 4 == 0 ? 1 : i % 4 == 1 ? 300 : 70001);
+
+                if (tick == 2000)
+                {
+                        tick++;
+                }
+                SCUT_ASSERT_IE(twheel_schedule(t, tick, (void*)tick, &hd), 0);
+        }
+        SCUT_ASSERT_IE(twheel_size(t), NUM_TIMERS);
+
+        /* In steps of varying size */
+        for (uint64_t now = 2000; twheel_size(t) > 0; now += 1 + now % 7919)
+        {
+                twheel_advance(t, now, &on_expire, &c);
+                SCUT_ASSERT_TRUE(c.ok);
+        }
+        SCUT_ASSERT_IE(c.count, NUM_TIMERS);
+
+        /* A timer in the past expires at the next tick */
+        c.last = 0;
+        SCUT_ASSERT_IE(twheel_schedule(t, 5, (void*)(twheel_now(t) + 1), &hd), 0);
+        SCUT_ASSERT_IE(twheel_advance(t, twheel_now(t), &on_expire, &c), 0);
+        SCUT_ASSERT_IE(twheel_advance(t, twheel_now(t) + 1, &on_expire, &c), 1);
+        SCUT_ASSERT_TRUE(c.ok);
+
+        twheel_destroy(t);
+
+        return 0;
+}
+
+static int test_tw_cancel(void)
+{
+        struct twheel* t = twheel_create(0);
+        struct check c = {NULL, 0, 0, 1};
+        static uint64_t handles[NUM_TIMERS];
+
+        c.t = t;
+        for (long i = 0; i < NUM_TIMERS; i++)
+        {
+                uint64_t tick = 1 + (uint64_t)((i * 7919) % NUM_TIMERS) * 37;
+
+                SCUT_ASSERT_IE(twheel_schedule(t, tick, (void*)tick, &handles[i]), 0);
+        }
+
+        /* Cancel all but every tenth */
+        for (long i = 0; i < NUM_TIMERS; i++)
+        {
+                if (i % 10)
+                {
+                        SCUT_ASSERT_TRUE(twheel_cancel(t, handles[i]));
+                        SCUT_ASSERT_IE(twheel_cancel(t, handles[i]), NULL);
+                }
+        }
+        SCUT_ASSERT_IE(twheel_size(t), NUM_TIMERS / 10);
+        SCUT_ASSERT_IE(twheel_advance(t, (uint64_t)NUM_TIMERS * 37, &on_expire, &c),
+                       NUM_TIMERS / 10);
+        SCUT_ASSERT_TRUE(c.ok);
+        SCUT_ASSERT_IE(twheel_size(t), 0);
+
+        /* Handles of expired timers, and reused timers */
+        SCUT_ASSERT_IE(twheel_cancel(t, handles[0]), NULL);
+        SCUT_ASSERT_IE(twheel_schedule(t, twheel_now(t) + 10, (void*)1l, &handles[1]), 0);
+        SCUT_ASSERT_IE(twheel_cancel(t, handles[0]), NULL);
+        SCUT_ASSERT_IE(twheel_cancel(t, handles[2]), NULL);
+        SCUT_ASSERT_IE(twheel_cancel(t, (uint64_t)NUM_TIMERS + 1), NULL);
+        SCUT_ASSERT_IE(twheel_cancel(t, handles[1]), 1);
+
+        twheel_destroy(t);
+
+        return 0;
+}
+
+static int test_tw_far(void)
+{
+        uint64_t start = UINT64_C(0xFFFFFFFF00) - 3;
+        struct twheel* t = twheel_create(start);
+        struct check c = {NULL, 0, 0, 1};
+        uint64_t ticks[] = {
+                start + 1, start + 4, start + 5, start + 70000,
+                start + UINT64_C(0x100000000), start + UINT64_C(0x100000001),
+                start + UINT64_C(0x500000000), UINT64_MAX - 1
+        };
+        uint64_t hd;
+
+        c.t = t;
+        for (size_t i = 0; i < 8; i++)
+        {
+                SCUT_ASSERT_IE(twheel_schedule(t, ticks[i], (void*)ticks[i], &hd), 0);
+        }
+
+        /* Crossing the range of the top wheel */
+        SCUT_ASSERT_IE(twheel_advance(t, start + 4, &on_expire, &c), 2);
+        SCUT_ASSERT_IE(twheel_advance(t, start + UINT64_C(0x100000000), &on_expire, &c), 3);
+        SCUT_ASSERT_IE(twheel_advance(t, start + UINT64_C(0x100000000), &on_expire, &c), 0);
+        SCUT_ASSERT_IE(twheel_advance(t, UINT64_MAX - 2, &on_expire, &c), 2);
+        SCUT_ASSERT_IE(twheel_size(t), 1);
+        SCUT_ASSERT_IE(twheel_advance(t, UINT64_MAX, &on_expire, &c), 1);
+        SCUT_ASSERT_TRUE(c.ok);
+        SCUT_ASSERT_IE(c.count, 8);
+
+        twheel_destroy(t);
+
+        return 0;
+}
+
+/* Reschedules each timer until it has expired ten times, and cancels
+   the timer in the data of the expired one */
+struct resched
+{
+        struct twheel* t;
+        uint64_t handles[100];
+        long count;
+};
+
+static void on_resched(void* data, void* arg)
+{
+        struct resched* r = arg;
+        long i = (long)data;
+
+        r->count++;
+        if (r->count % 10 == 0)
+        {
+                twheel_cancel(r->t, r->handles[(i + 1) % 100]);
+        }
+        twheel_schedule(r->t, twheel_now(r->t) + (uint64_t)i, data,
+                        &r->handles[i]);
+}
+
+static int test_tw_reschedule(void)
+{
+        struct resched r;
+
+        r.t = twheel_create(0);
+        r.count = 0;
+        for (long i = 1; i < 100; i++)
+        {
+                SCUT_ASSERT_IE(twheel_schedule(r.t, (uint64_t)i, (void*)i, &r.handles[i]), 0);
+        }
+        /* Timers at the current tick, expire at the next */
+        SCUT_ASSERT_IE(twheel_schedule(r.t, 0, (void*)0l, &r.handles[0]), 0);
+
+        twheel_advance(r.t, 100000, &on_resched, &r);
+        SCUT_ASSERT_TRUE(r.count > 1000);
+        SCUT_ASSERT_TRUE(twheel_size(r.t) <= 100);
+
+        twheel_destroy(r.t);
+
+        return 0;
+}